@@ -0,0 +1,42 @@
+
+#include <hal/pin.h>
+#include <hal/edge.h>
+#include <libopencm3/cm3/nvic.h>
+
+#define TACHO		PA0	// dependent on board
+#define CPU_FREQ	168000000
+
+static struct edge_capture tacho;
+
+/* Measured speed, read by the debugger */
+volatile uint32_t rpm;
+
+/* EXTI line 0 handler, only timestamps the edge */
+void exti0_isr(void)
+{
+	edge_capture_isr(&tacho, TACHO);
+}
+
+int main(void)
+{
+	struct edge_result res;
+
+	cycle_counter_enable();
+
+	pin_clock_enable(TACHO);
+	pin_input(TACHO);
+	pin_pull_up(TACHO);
+
+	rcc_periph_clock_enable(RCC_SYSCFG);
+	edge_capture_init(&tacho, TACHO);
+	nvic_enable_irq(NVIC_EXTI0_IRQ);
+
+	while (true) {
+		edge_capture_process(&tacho);
+
+		/* two pulses per revolution */
+		if (edge_capture_get(&tacho, &res)) {
+			rpm = edge_frequency_mhz(&res, CPU_FREQ) * 60 / 2 / 1000;
+		}
+	}
+}
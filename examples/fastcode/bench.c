@@ -0,0 +1,76 @@
+
+#include <hal/pin.h>
+#include <hal/cycle.h>
+#include <hal/delay.h>
+
+#define PIN		PA8	// dependent on board
+#define RUNS		100
+
+/* Cycles of the burst run from flash and from RAM, read by the debugger */
+struct bench {
+	uint32_t min;
+	uint32_t max;
+};
+
+volatile struct bench bench_flash, bench_fast;
+
+/* Bit-banged burst, as in the protocol drivers */
+static void __attribute__((noinline)) burst_flash(void)
+{
+	int i;
+
+	for (i = 0; i < 32; i++) {
+		pin_set(PIN, true);
+		delay_loops(2);
+		pin_set(PIN, false);
+		delay_loops(2);
+	}
+}
+
+/* The same burst without flash wait states and prefetch misses */
+static void __attribute__((noinline)) HAL_FASTCODE burst_fast(void)
+{
+	int i;
+
+	for (i = 0; i < 32; i++) {
+		pin_set(PIN, true);
+		delay_loops(2);
+		pin_set(PIN, false);
+		delay_loops(2);
+	}
+}
+
+static void measure(void (*burst)(void), volatile struct bench *b)
+{
+	uint32_t start, dt;
+	int i;
+
+	b->min = 0xFFFFFFFF;
+	b->max = 0;
+	for (i = 0; i < RUNS; i++) {
+		start = cycle_counter_get();
+		burst();
+		dt = cycle_diff(start, cycle_counter_get());
+
+		if (dt < b->min)
+			b->min = dt;
+		if (dt > b->max)
+			b->max = dt;
+	}
+}
+
+int main(void)
+{
+	/* copies the code to the CCM or ITCM with HAL_FASTCODE_TCM */
+	hal_fast_init();
+	cycle_counter_enable();
+
+	pin_clock_enable(PIN);
+	pin_output_pushpull(PIN);
+
+	/* max - min is the timing jitter, zero expected from RAM */
+	measure(burst_flash, &bench_flash);
+	measure(burst_fast, &bench_fast);
+
+	while (true);
+}
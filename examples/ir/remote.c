@@ -0,0 +1,59 @@
+
+#include <hal/pin.h>
+#include <hal/ir.h>
+#include <libopencm3/cm3/nvic.h>
+#include <libopencm3/cm3/systick.h>
+
+#define IR_IN		PA0	// dependent on board
+#define LED		PC13	// dependent on board
+#define CPU_FREQ	72000000
+
+static struct ir_rx remote;
+
+/* EXTI line 0 handler, decodes the edge of the receiver output */
+void exti0_isr(void)
+{
+	ir_rx_isr(&remote, IR_IN);
+}
+
+/* 1ms tick at the same priority, ends the SIRC frames */
+void sys_tick_handler(void)
+{
+	ir_rx_idle(&remote, cycle_counter_get());
+}
+
+int main(void)
+{
+	struct ir_frame frame;
+
+	cycle_counter_enable();
+
+	pin_clock_enable(LED);
+	pin_output_pushpull(LED);
+
+	pin_clock_enable(IR_IN);
+	pin_input(IR_IN);
+	pin_pull_up(IR_IN);
+
+	/* TSOP-like receivers pull the output low during the burst */
+	ir_rx_init(&remote, CPU_FREQ, false);
+
+	rcc_periph_clock_enable(RCC_AFIO);
+	ir_rx_pin_init(IR_IN);
+	nvic_enable_irq(NVIC_EXTI0_IRQ);
+
+	systick_set_clocksource(STK_CSR_CLKSOURCE_AHB);
+	systick_set_reload(CPU_FREQ / 1000 - 1);
+	systick_interrupt_enable();
+	systick_counter_enable();
+
+	while (true) {
+		if (!ir_rx_get(&remote, &frame))
+			continue;
+
+		/* power key of the NEC remote toggles the LED, held key not */
+		if (frame.protocol == IR_NEC && frame.command == 0x45 &&
+		    !frame.repeat)
+			pin_toggle(LED);
+	}
+}
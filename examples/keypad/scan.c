@@ -0,0 +1,34 @@
+
+#include <hal/pin.h>
+#include <hal/keypad.h>
+
+#define LED		PC13	// dependent on board
+#define CPU_FREQ	72000000
+
+/* 4x4 keypad without diodes, dependent on board */
+static const uint32_t cols[] = { PB12, PB13, PB14, PB15 };
+static const uint32_t rows[] = { PA8, PA9, PA10, PA11 };
+
+static struct keypad keys;
+
+int main(void)
+{
+	uint8_t ev;
+
+	pin_clock_enable(LED);
+	pin_output_pushpull(LED);
+
+	/* open-drain columns, internal pull-ups need about 1us to settle */
+	keypad_init(&keys, cols, 4, rows, 4, KEYPAD_OPENDRAIN, 1, CPU_FREQ);
+
+	while (true) {
+		keypad_scan(&keys);
+
+		/* key in column 0, row 0 toggles the LED on press */
+		while (keypad_get(&keys, &ev))
+			if (ev == (KEYPAD_PRESS | 0))
+				pin_toggle(LED);
+
+		delay_ms(2, CPU_FREQ);
+	}
+}
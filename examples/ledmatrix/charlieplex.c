@@ -0,0 +1,45 @@
+
+#include <hal/pin.h>
+#include <hal/ledmatrix.h>
+#include <libopencm3/stm32/rcc.h>
+#include <libopencm3/stm32/timer.h>
+#include <libopencm3/cm3/nvic.h>
+
+/* 6 pins drive 30 LEDs, dependent on board */
+static const uint32_t pins[] = { PA0, PA1, PA2, PA3, PA4, PA5 };
+
+#define N		6
+
+static struct ledmatrix leds;
+static uint8_t frame[N * N];
+
+/* timer ticks 1us, the update applies the next slot */
+void tim2_isr(void)
+{
+	TIM_SR(TIM2) = ~TIM_SR_UIF;
+	TIM_ARR(TIM2) = ledmatrix_isr(&leds) - 1;
+}
+
+int main(void)
+{
+	uint32_t i, t = 0;
+
+	pin_clock_enable(PA0);
+	ledmatrix_init(&leds, pins, N, NULL, 0, LEDMATRIX_CHARLIEPLEX, 8);
+
+	rcc_periph_clock_enable(RCC_TIM2);
+	TIM_PSC(TIM2) = 72 - 1;			/* 72MHz clock */
+	TIM_ARR(TIM2) = 100;
+	TIM_DIER(TIM2) = TIM_DIER_UIE;
+	TIM_CR1(TIM2) = TIM_CR1_CEN;
+	nvic_enable_irq(NVIC_TIM2_IRQ);
+
+	while (true) {
+		/* running brightness gradient */
+		for (i = 0; i < N * N; i++)
+			frame[i] = (i + t / 4096) & LEDMATRIX_MAX_LEVEL;
+
+		if (ledmatrix_draw(&leds, frame))
+			t++;
+	}
+}
@@ -0,0 +1,53 @@
+
+#include <hal/pin.h>
+#include <hal/manchester.h>
+#include <libopencm3/stm32/rcc.h>
+#include <libopencm3/stm32/exti.h>
+#include <libopencm3/cm3/nvic.h>
+
+#define LINE		PA0	// dependent on board
+#define CPU_FREQ	72000000
+#define BITRATE		10000
+
+static struct manchester_rx rx;
+
+/* Received bytes, read by the debugger */
+volatile uint8_t received[64];
+volatile uint32_t received_count;
+
+/* EXTI line 0 handler, timestamps and decodes the edge */
+void exti0_isr(void)
+{
+	const uint32_t now = cycle_counter_get();
+
+	EXTI_PR = _pin_pin(LINE);
+	manchester_rx_edge(&rx, now, pin_get(LINE));
+}
+
+int main(void)
+{
+	uint8_t byte;
+
+	cycle_counter_enable();
+
+	pin_clock_enable(LINE);
+	pin_input(LINE);
+	pin_pull_up(LINE);
+
+	/* 25% tolerance, drop the 8 preamble bits of every frame */
+	manchester_rx_init(&rx, BITRATE, CPU_FREQ, 25, 8);
+
+	rcc_periph_clock_enable(RCC_AFIO);
+	exti_select_source(_pin_pin(LINE), _pin_port(LINE));
+	exti_set_trigger(_pin_pin(LINE), EXTI_TRIGGER_BOTH);
+	exti_reset_request(_pin_pin(LINE));
+	exti_enable_request(_pin_pin(LINE));
+	nvic_enable_irq(NVIC_EXTI0_IRQ);
+
+	while (true) {
+		if (manchester_rx_get(&rx, &byte)) {
+			received[received_count % 64] = byte;
+			received_count++;
+		}
+	}
+}
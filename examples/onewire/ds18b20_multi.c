@@ -0,0 +1,51 @@
+
+#include <hal/pin.h>
+#include <hal/delay.h>
+#include <hal/onewire.h>
+
+#define CPU_FREQ	168000000
+
+#define DS18B20_CONVERT_T		0x44
+#define DS18B20_READ_SCRATCHPAD		0xBE
+
+/* one sensor chain per pin, all on the same port */
+static const uint32_t buses[] = { PB0, PB1, PB2, PB3 };
+
+/* Temperatures of the buses in 1/16 C, read by the debugger */
+volatile int16_t temperature[16];
+
+int main(void)
+{
+	struct onewire ow;
+	uint8_t scratchpad[9][16];
+
+	pin_clock_enable(PB0);
+	onewire_init_multi(&ow, buses, 4, CPU_FREQ);
+
+	while (true) {
+		/* start conversion in all sensors on all buses at once */
+		onewire_skip_rom(&ow);
+		onewire_write_byte(&ow, DS18B20_CONVERT_T);
+		delay_ms(750, CPU_FREQ);
+
+		/* read the scratchpads of all buses in parallel */
+		onewire_skip_rom(&ow);
+		onewire_write_byte(&ow, DS18B20_READ_SCRATCHPAD);
+		for (int i = 0; i < 9; i++) {
+			onewire_read_multi(&ow, scratchpad[i]);
+		}
+
+		for (int n = 0; n < 4; n++) {
+			const uint32_t pinno = buses[n] & 15;
+			uint8_t data[9];
+
+			for (int i = 0; i < 9; i++) {
+				data[i] = scratchpad[i][pinno];
+			}
+
+			if (onewire_crc8(data, 9) == 0) {
+				temperature[pinno] = (int16_t)(data[0] | (data[1] << 8));
+			}
+		}
+	}
+}
@@ -0,0 +1,52 @@
+
+#include <hal/pin.h>
+#include <hal/parallel.h>
+#include <libopencm3/cm3/cortex.h>
+
+/* 8-bit camera, D0..D7 on PB8..PB15, dependent on board */
+#define CAM_D0		PB8
+#define CAM_PCLK	PB6
+#define CAM_VSYNC	PB7
+#define CAM_HREF	PA4
+
+#define WIDTH		160
+#define HEIGHT		120
+
+static uint8_t line_buf[WIDTH];
+static uint32_t sum;
+
+/* consume the line in the line blanking, before the next line starts */
+static void *line_done(void *ctx, uint32_t line, void *data)
+{
+	const uint8_t *px = data;
+	uint32_t i;
+
+	(void)ctx;
+	(void)line;
+
+	for (i = 0; i < WIDTH; i++)
+		sum += px[i];
+
+	/* the line is consumed, capture the next one to the same buffer */
+	return data;
+}
+
+int main(void)
+{
+	struct parallel_port cam;
+	uint32_t mask;
+
+	pin_clock_enable(PA0);
+	pin_clock_enable(PB0);
+
+	parallel_init(&cam, CAM_D0, 8, CAM_PCLK, true);
+	parallel_sync(&cam, CAM_VSYNC, true, CAM_HREF, true, 10000000);
+
+	while (true) {
+		sum = 0;
+
+		mask = cm_mask_interrupts(1);
+		parallel_frame8(&cam, line_buf, WIDTH, HEIGHT, line_done, NULL);
+		cm_mask_interrupts(mask);
+	}
+}
@@ -0,0 +1,63 @@
+
+#include <hal/pin.h>
+#include <hal/pdm.h>
+#include <libopencm3/stm32/rcc.h>
+#include <libopencm3/stm32/timer.h>
+#include <libopencm3/stm32/dma.h>
+#include <libopencm3/cm3/nvic.h>
+
+#define OUT		PA0	// dependent on board, RC filter 1k + 10nF
+#define WORDS		256	/* 2 halves of 128 bits */
+#define OSR		64	/* 500kHz bits, 7812Hz samples */
+
+/* One period of the sine, 16 samples, 488Hz */
+static const int16_t sine[16] = {
+	0, 9598, 17733, 23170, 25080, 23170, 17733, 9598,
+	0, -9598, -17733, -23170, -25080, -23170, -17733, -9598,
+};
+
+static struct pdm pdm;
+static uint32_t buf[WORDS];
+
+/* TIM3 update requests DMA1 channel 3 on STM32F0 */
+void dma1_channel2_3_isr(void)
+{
+	if (DMA_ISR(DMA1) & DMA_ISR_HTIF(DMA_CHANNEL3)) {
+		DMA_IFCR(DMA1) = DMA_IFCR_CHTIF(DMA_CHANNEL3);
+		pdm_refill(&pdm, 0);
+	}
+	if (DMA_ISR(DMA1) & DMA_ISR_TCIF(DMA_CHANNEL3)) {
+		DMA_IFCR(DMA1) = DMA_IFCR_CTCIF(DMA_CHANNEL3);
+		pdm_refill(&pdm, 1);
+	}
+}
+
+int main(void)
+{
+	uint32_t i = 0;
+
+	pin_clock_enable(OUT);
+	pdm_init(&pdm, OUT, 2, OSR, buf, WORDS);
+
+	rcc_periph_clock_enable(RCC_DMA);
+	DMA_CPAR(DMA1, DMA_CHANNEL3) = (uint32_t)&GPIO_BSRR(GPIOA);
+	DMA_CMAR(DMA1, DMA_CHANNEL3) = (uint32_t)buf;
+	DMA_CNDTR(DMA1, DMA_CHANNEL3) = WORDS;
+	DMA_CCR(DMA1, DMA_CHANNEL3) = DMA_CCR_DIR | DMA_CCR_CIRC |
+		DMA_CCR_MINC | DMA_CCR_PSIZE_32BIT | DMA_CCR_MSIZE_32BIT |
+		DMA_CCR_PL_VERY_HIGH | DMA_CCR_HTIE | DMA_CCR_TCIE |
+		DMA_CCR_EN;
+	nvic_enable_irq(NVIC_DMA1_CHANNEL2_3_IRQ);
+
+	rcc_periph_clock_enable(RCC_TIM3);
+	TIM_PSC(TIM3) = 0;			/* 48MHz clock */
+	TIM_ARR(TIM3) = 96 - 1;
+	TIM_DIER(TIM3) = TIM_DIER_UDE;
+	TIM_CR1(TIM3) = TIM_CR1_CEN;
+
+	while (true) {
+		/* keep the queue full, the tone falls back to the setpoint */
+		if (pdm_write(&pdm, &sine[i], 1) == 1)
+			i = (i + 1) & 15;
+	}
+}
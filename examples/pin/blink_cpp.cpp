@@ -0,0 +1,27 @@
+
+#include <hal/pin.hpp>
+
+using Led = hal::Pin<PA8>;			// dependent on board
+using Leds = hal::PinGroup<PA1, PA5, PB3, PB4>;	// dependent on board
+using Usart = hal::PinGroup<PA2, PA3>;
+
+int main(void)
+{
+	pin_clock_enable_multi((const uint32_t[]){ GPIOA, GPIOB }, 2);
+
+	/* one store per port */
+	Led::clear();
+	Leds::clear();
+	Led::configure<hal::Mode::Output>();
+	Leds::configure<hal::Mode::Output>();
+
+	Usart::configure<hal::Mode::Af>();
+	Usart::af<7>();
+
+	/* PA1 and PB3 high, PA5 and PB4 low: one BSRR write for each port */
+	Leds::write(0b0101);
+
+	while (true) {
+		Led::toggle();
+	}
+}
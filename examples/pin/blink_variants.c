@@ -0,0 +1,65 @@
+
+#include <hal/pin.h>
+#include <hal/pinmap.h>
+
+/* Signals of the board */
+enum {
+	LED,
+	BUTTON,
+	SIGNALS
+};
+
+/* Board revision straps, dependent on board */
+static const uint32_t straps[] = {PB12, PB13};
+
+/* Pins of the board revisions, selected by the straps */
+static const uint32_t board_pins[][SIGNALS] = {
+	{PA8, PC1},
+	{PC3, PC1},
+	{PA1, PB6},
+	{PA1, PINMAP_NONE},	/* no button */
+};
+
+/* Pressed level, the missing button reads low, so never pressed */
+static const bool button_level[] = {false, false, true, true};
+
+static struct pin_handle board[SIGNALS];
+
+int main(void)
+{
+	uint32_t variant;
+	bool level;
+
+	variant = pinmap_detect(straps, 2);
+	if (!pinmap_select(board, &board_pins[0][0], SIGNALS, 4, variant))
+		while (true);	/* unsupported board */
+
+	level = button_level[variant];
+
+	/* Enable the clocks for pins */
+	pin_clock_enable(board[LED].pin);
+
+	/* Configure LED */
+	pinmap_set(&board[LED], false);
+	pin_output_pushpull(board[LED].pin);
+	pin_speed_fast(board[LED].pin);
+
+	/* Configure button, when the board has one */
+	if (pinmap_present(&board[BUTTON])) {
+		pin_clock_enable(board[BUTTON].pin);
+		pin_input(board[BUTTON].pin);
+		if (level) {
+			pin_pull_down(board[BUTTON].pin);
+		} else {
+			pin_pull_up(board[BUTTON].pin);
+		}
+	}
+
+	while (true) {
+		pinmap_toggle(&board[LED]);
+		if (pinmap_get(&board[BUTTON]) == level) {
+			/* when button was pressed, slow down blinking */
+			delay_cycles(10000);
+		}
+	}
+}
@@ -0,0 +1,64 @@
+
+#include <hal/pin.h>
+#include <hal/boot.h>
+
+#define HEATER		PA8	// dependent on board, active high
+#define VALVE		PB5	// dependent on board, active low
+#define LED		PC13	// dependent on board
+
+/* Safe state of the outputs, kept in flash */
+#if defined(STM32F1)
+/* the valve is open drain, pulled up externally */
+static const struct pin_boot_port safe_pins[] = {
+	{
+		.port = GPIOA,
+		.pins = PIN_BOOT_BIT(HEATER),
+		.odr = 0,
+		.crh = PIN_BOOT_CRH(HEATER, GPIO_MODE_OUTPUT_2_MHZ |
+				    (GPIO_CNF_OUTPUT_PUSHPULL << 2)),
+	},
+	{
+		.port = GPIOB,
+		.pins = PIN_BOOT_BIT(VALVE),
+		.odr = PIN_BOOT_BIT(VALVE),
+		.crl = PIN_BOOT_CRL(VALVE, GPIO_MODE_OUTPUT_2_MHZ |
+				    (GPIO_CNF_OUTPUT_OPENDRAIN << 2)),
+	},
+};
+#else
+static const struct pin_boot_port safe_pins[] = {
+	{
+		.port = GPIOA,
+		.pins = PIN_BOOT_BIT(HEATER),
+		.odr = 0,
+		.moder = PIN_BOOT_FIELD2(HEATER, GPIO_MODE_OUTPUT),
+	},
+	{
+		.port = GPIOB,
+		.pins = PIN_BOOT_BIT(VALVE),
+		.odr = PIN_BOOT_BIT(VALVE),
+		.otyper = PIN_BOOT_BIT(VALVE),
+		.moder = PIN_BOOT_FIELD2(VALVE, GPIO_MODE_OUTPUT),
+		.pupdr = PIN_BOOT_FIELD2(VALVE, GPIO_PUPD_PULLUP),
+	},
+};
+#endif
+
+/* Runs before .data and .bss are initialized */
+static void safe_state(void)
+{
+	pin_boot_apply(safe_pins, sizeof(safe_pins) / sizeof(safe_pins[0]));
+}
+
+BOOT_RESET_HANDLER(safe_state)
+
+int main(void)
+{
+	/* the heater and valve are already driven to the safe levels */
+	pin_clock_enable(LED);
+	pin_output_pushpull(LED);
+
+	while (true) {
+		pin_toggle(LED);
+	}
+}
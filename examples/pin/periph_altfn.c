@@ -29,15 +29,17 @@
 /* Initialize pins in complex peripheral */
 void init_eth(void)
 {
-	int phy_pins[] = {
+	const uint32_t phy_pins[] = {
 		PHY_CRSDV,	PHY_RXD0,	PHY_RXD1,	PHY_REFCLK,
 		PHY_TXEN,	PHY_TXD0,	PHY_TXD1,	PHY_MDIO,
 		PHY_MDC
 	};
 	
+	/* Enable clocks of all ports by single RCC access */
+	pin_clock_enable_multi(phy_pins, sizeof(phy_pins) / sizeof(phy_pins[0]));
+
 	/* Initialize all pins that belongs to RMII */
 	for (int i = 0; i < sizeof(phy_pins) / sizeof(phy_pins[0]); i++) {
-		pin_clock_enable(phy_pins[i]);
 		pin_af_pushpull(phy_pins[i]);
 		pin_speed_high(phy_pins[i]);
 		pin_af_map(phy_pins[i], GPIO_AF_ETH);
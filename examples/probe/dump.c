@@ -0,0 +1,42 @@
+
+#include <hal/probe.h>
+
+/* the ports and masks fold to constants, keep the pins static const */
+static const struct swd_pins target = {
+	.swclk = PB13,	// dependent on board
+	.swdio = PB14,	// dependent on board
+};
+
+#define AP_CSW		0x00
+#define AP_TAR		0x04
+#define AP_DRW		0x0C
+
+static uint32_t idcode;
+static uint32_t words[16];
+
+int main(void)
+{
+	struct swd_queue q;
+	uint32_t i;
+
+	swd_init(&target);
+	swd_connect(&target);
+
+	if (swd_read(&target, SWD_DP, SWD_DP_IDCODE, &idcode) != SWD_ACK_OK)
+		while (true);
+
+	/* power up the debug domain, select the MEM-AP 0 */
+	swd_write(&target, SWD_DP, SWD_DP_CTRL_STAT, 0x50000000);
+	swd_write(&target, SWD_DP, SWD_DP_SELECT, 0);
+
+	/* read the vector table of the target by one batch */
+	swd_queue_init(&q);
+	swd_queue_write(&q, SWD_AP, AP_CSW, 0x23000012);	/* 32-bit, inc */
+	swd_queue_write(&q, SWD_AP, AP_TAR, 0x08000000);
+	for (i = 0; i < 16; i++)
+		swd_queue_read(&q, SWD_AP, AP_DRW, &words[i]);
+
+	swd_queue_run(&target, &q);
+
+	while (true);
+}
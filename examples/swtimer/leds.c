@@ -0,0 +1,54 @@
+
+#include <hal/pin.h>
+#include <hal/swtimer.h>
+#include <libopencm3/cm3/systick.h>
+
+#define LED1		PC13	// dependent on board
+#define LED2		PC14	// dependent on board
+#define CPU_FREQ	72000000
+
+static struct swtimer_wheel wheel;
+static struct swtimer blink, report;
+
+/* 1ms tick */
+void sys_tick_handler(void)
+{
+	swtimer_tick(&wheel);
+}
+
+/* runs in the SysTick handler */
+static void blink_expired(struct swtimer *timer)
+{
+	(void)timer;
+	pin_toggle(LED1);
+}
+
+/* runs in the main loop */
+static void report_expired(struct swtimer *timer)
+{
+	(void)timer;
+	pin_toggle(LED2);
+}
+
+int main(void)
+{
+	pin_clock_enable(LED1);
+	pin_output_pushpull(LED1);
+	pin_output_pushpull(LED2);
+
+	swtimer_wheel_init(&wheel);
+	swtimer_init(&blink, blink_expired, 0);
+	swtimer_init(&report, report_expired, SWTIMER_DEFERRED);
+
+	swtimer_start(&wheel, &blink, 250, 250);
+	swtimer_start(&wheel, &report, 1000, 1000);
+
+	systick_set_clocksource(STK_CSR_CLKSOURCE_AHB);
+	systick_set_reload(CPU_FREQ / 1000 - 1);
+	systick_interrupt_enable();
+	systick_counter_enable();
+
+	while (true) {
+		swtimer_run_deferred(&wheel);
+	}
+}
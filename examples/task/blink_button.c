@@ -0,0 +1,87 @@
+
+#include <hal/pin.h>
+#include <hal/task.h>
+#include <hal/timebase.h>
+#include <libopencm3/cm3/systick.h>
+#include <libopencm3/cm3/nvic.h>
+#include <libopencm3/stm32/rcc.h>
+#include <libopencm3/stm32/timer.h>
+
+#define LED		PC13	// dependent on board
+#define BUTTON		PA0	// dependent on board
+#define CPU_FREQ	72000000
+
+static uint32_t blink_ms = 500;
+
+/* keeps the timebase, and wakes the scheduler on DWT cores */
+void sys_tick_handler(void)
+{
+	timebase_isr();
+}
+
+/* wakes the scheduler every 1ms on STM32F0/L0 */
+void tim3_isr(void)
+{
+	TIM_SR(TIM3) = ~TIM_SR_UIF;
+}
+
+static enum task_state blink(struct task *t)
+{
+	TASK_BEGIN(t);
+	while (true) {
+		pin_toggle(LED);
+		TASK_SLEEP_MS(t, blink_ms);
+	}
+	TASK_END(t);
+}
+
+/* each press of the button toggles the blinking speed */
+static enum task_state button(struct task *t)
+{
+	TASK_BEGIN(t);
+	while (true) {
+		TASK_AWAIT_EDGE(t, BUTTON, false);
+		blink_ms = (blink_ms == 500) ? 100 : 500;
+
+		/* debounce */
+		TASK_SLEEP_MS(t, 20);
+		TASK_AWAIT_PIN(t, BUTTON, true);
+		TASK_SLEEP_MS(t, 20);
+	}
+	TASK_END(t);
+}
+
+static struct task tasks[] = {
+	TASK_INIT(blink),
+	TASK_INIT(button),
+};
+
+int main(void)
+{
+	pin_clock_enable(LED);
+	pin_clock_enable(BUTTON);
+	pin_output_pushpull(LED);
+	pin_input(BUTTON);
+	pin_pull_up(BUTTON);
+
+	timebase_init(CPU_FREQ);
+
+#if CYCLE_COUNTER_BITS == 32
+	/* SysTick is free on DWT cores, use it as the periodic tick */
+	systick_set_clocksource(STK_CSR_CLKSOURCE_AHB);
+	systick_set_reload(CPU_FREQ / 1000 - 1);
+	systick_interrupt_enable();
+	systick_counter_enable();
+#else
+	/* SysTick counts the timebase, the wakeup tick needs a timer */
+	rcc_periph_clock_enable(RCC_TIM3);
+	TIM_PSC(TIM3) = CPU_FREQ / 1000000 - 1;	/* 1us */
+	TIM_ARR(TIM3) = 1000 - 1;
+	TIM_DIER(TIM3) = TIM_DIER_UIE;
+	TIM_CR1(TIM3) = TIM_CR1_CEN;
+	nvic_enable_irq(NVIC_TIM3_IRQ);
+#endif
+
+	task_run(tasks, sizeof(tasks) / sizeof(tasks[0]));
+	return 0;
+}
@@ -0,0 +1,41 @@
+
+#include <hal/pin.h>
+#include <hal/timebase.h>
+#include <libopencm3/cm3/systick.h>
+
+#define LED		PC13	// dependent on board
+#define CPU_FREQ	72000000
+
+/* 1ms tick, keeps the upper part of the timebase */
+void sys_tick_handler(void)
+{
+	timebase_isr();
+}
+
+int main(void)
+{
+	uint64_t next;
+
+	pin_clock_enable(LED);
+	pin_output_pushpull(LED);
+
+	timebase_init(CPU_FREQ);
+
+#if CYCLE_COUNTER_BITS == 32
+	/* SysTick is free on DWT cores, use it as the periodic tick */
+	systick_set_clocksource(STK_CSR_CLKSOURCE_AHB);
+	systick_set_reload(CPU_FREQ / 1000 - 1);
+	systick_interrupt_enable();
+	systick_counter_enable();
+#endif
+
+	next = timebase_now() + timebase_us_to_cycles(500000);
+
+	while (true) {
+		/* 1Hz blink, not drifting by the loop overhead */
+		if ((int64_t)(timebase_now() - next) >= 0) {
+			next += timebase_us_to_cycles(500000);
+			pin_toggle(LED);
+		}
+	}
+}
@@ -0,0 +1,34 @@
+
+#include <hal/pin.h>
+#include <hal/touch.h>
+
+#define LED		PC13	// dependent on board
+
+/* pads with 1M resistors to VDD, dependent on board */
+static const uint32_t pads[] = {
+	PA0, PA1, PA2, PA3, PA4, PA5, PA6, PA7,
+	PB0, PB1, PB10, PB11, PB12, PB13, PB14, PB15,
+};
+
+static struct touch_panel panel;
+
+int main(void)
+{
+	uint32_t touched;
+
+	cycle_counter_enable();
+
+	pin_clock_enable(LED);
+	pin_output_pushpull(LED);
+
+	/* touch adds 40 cycles to the charge, released below 20 cycles */
+	touch_init(&panel, pads, sizeof(pads) / sizeof(pads[0]), 40, 20);
+	touch_calibrate(&panel, 32);
+
+	while (true) {
+		touched = touch_scan(&panel);
+
+		/* any pad lights the LED */
+		pin_set(LED, touched == 0);
+	}
+}
@@ -0,0 +1,56 @@
+/*
+ * This file is part of the HAL project, inline library above libopencm3.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef HAL_CYCLE_STM32_DWT_H_INCLUDED
+#define HAL_CYCLE_STM32_DWT_H_INCLUDED
+
+#if !defined(HAL_CYCLE_H_INCLUDED)
+# error please do not include HAL library internals directly
+#endif
+
+#include <libopencm3/cm3/scs.h>
+#include <libopencm3/cm3/dwt.h>
+
+/*****************************************************************************/
+/* API definitions                                                           */
+/*****************************************************************************/
+
+#define CYCLE_COUNTER_BITS	32
+#define CYCLE_COUNTER_MASK	0xFFFFFFFFUL
+
+BEGIN_DECLS
+
+/*****************************************************************************/
+
+INLINE void cycle_counter_enable(void)
+{
+	SCS_DEMCR |= SCS_DEMCR_TRCENA;
+#if defined(STM32F7)
+	/* unlock the DWT registers */
+	DWT_LAR = 0xC5ACCE55;
+#endif
+	DWT_CYCCNT = 0;
+	DWT_CTRL |= DWT_CTRL_CYCCNTENA;
+}
+
+INLINE uint32_t cycle_counter_get(void)
+{
+	return DWT_CYCCNT;
+}
+
+END_DECLS
+
+#endif /* HAL_CYCLE_STM32_DWT_H_INCLUDED */
@@ -0,0 +1,53 @@
+/*
+ * This file is part of the HAL project, inline library above libopencm3.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef HAL_CYCLE_STM32_SYSTICK_H_INCLUDED
+#define HAL_CYCLE_STM32_SYSTICK_H_INCLUDED
+
+#if !defined(HAL_CYCLE_H_INCLUDED)
+# error please do not include HAL library internals directly
+#endif
+
+#include <libopencm3/cm3/systick.h>
+
+/*****************************************************************************/
+/* API definitions                                                           */
+/*****************************************************************************/
+
+#define CYCLE_COUNTER_BITS	24
+#define CYCLE_COUNTER_MASK	0x00FFFFFFUL
+
+BEGIN_DECLS
+
+/*****************************************************************************/
+
+INLINE void cycle_counter_enable(void)
+{
+	STK_RVR = STK_RVR_RELOAD;
+	STK_CVR = 0;
+	STK_CSR = (STK_CSR & STK_CSR_TICKINT) | STK_CSR_CLKSOURCE_AHB |
+		  STK_CSR_ENABLE;
+}
+
+/* SysTick counts down, so the value is inverted to count up */
+INLINE uint32_t cycle_counter_get(void)
+{
+	return ~STK_CVR & CYCLE_COUNTER_MASK;
+}
+
+END_DECLS
+
+#endif /* HAL_CYCLE_STM32_SYSTICK_H_INCLUDED */
@@ -24,6 +24,10 @@
 #include <libopencm3/stm32/rcc.h>
 #include <libopencm3/stm32/gpio.h>
 
+#if defined(HAL_PIN_ATOMIC)
+# include <hal/atomic.h>
+#endif
+
 /*****************************************************************************/
 /* API definitions                                                           */
 /*****************************************************************************/
@@ -199,13 +203,208 @@
 #define PI15	(GPIOI | 15)
 #endif
 
+/*****************************************************************************/
+/* Clock cache                                                               */
+/*****************************************************************************/
+
+/* RCC enable bits of the ports already enabled, shared by all units */
+#if defined(HAL_PIN_CLOCK_CACHE)
+__attribute__((weak)) uint32_t _pin_clock_cache;
+#endif
+
+/*****************************************************************************/
+/* Port list                                                                 */
+/*****************************************************************************/
+
+/* _PIN_PORTS(x) expands x(name, port, index) for every port present on the
+ * chip, where index is the position of the port letter in the alphabet.
+ */
+#if defined(GPIO_PORT_A_BASE)
+# define _PIN_PORT_A(x)	x(a, GPIOA, 0)
+#else
+# define _PIN_PORT_A(x)
+#endif
+#if defined(GPIO_PORT_B_BASE)
+# define _PIN_PORT_B(x)	x(b, GPIOB, 1)
+#else
+# define _PIN_PORT_B(x)
+#endif
+#if defined(GPIO_PORT_C_BASE)
+# define _PIN_PORT_C(x)	x(c, GPIOC, 2)
+#else
+# define _PIN_PORT_C(x)
+#endif
+#if defined(GPIO_PORT_D_BASE)
+# define _PIN_PORT_D(x)	x(d, GPIOD, 3)
+#else
+# define _PIN_PORT_D(x)
+#endif
+#if defined(GPIO_PORT_E_BASE)
+# define _PIN_PORT_E(x)	x(e, GPIOE, 4)
+#else
+# define _PIN_PORT_E(x)
+#endif
+#if defined(GPIO_PORT_F_BASE)
+# define _PIN_PORT_F(x)	x(f, GPIOF, 5)
+#else
+# define _PIN_PORT_F(x)
+#endif
+#if defined(GPIO_PORT_G_BASE)
+# define _PIN_PORT_G(x)	x(g, GPIOG, 6)
+#else
+# define _PIN_PORT_G(x)
+#endif
+#if defined(GPIO_PORT_H_BASE)
+# define _PIN_PORT_H(x)	x(h, GPIOH, 7)
+#else
+# define _PIN_PORT_H(x)
+#endif
+#if defined(GPIO_PORT_I_BASE)
+# define _PIN_PORT_I(x)	x(i, GPIOI, 8)
+#else
+# define _PIN_PORT_I(x)
+#endif
+
+#define _PIN_PORTS(x)	_PIN_PORT_A(x) _PIN_PORT_B(x) _PIN_PORT_C(x) \
+			_PIN_PORT_D(x) _PIN_PORT_E(x) _PIN_PORT_F(x) \
+			_PIN_PORT_G(x) _PIN_PORT_H(x) _PIN_PORT_I(x)
+
+/*****************************************************************************/
+/* Compact pin encoding                                                      */
+/*****************************************************************************/
+
+/** Compact pin name, port index in upper nibble and pin number in lower one.
+ *
+ * Use @ref PIN8 to convert the pin name to this encoding, the result is
+ * constant expression usable in initializers of the flash resident tables.
+ * All pin functions accept both encodings.
+ */
+typedef uint8_t pin8_t;
+
+#if defined(GPIO_PORT_A_BASE)
+# define _PIN8_A(pin)	((((pin) & ~15) == GPIOA) ? 0x00 : 0)
+# define _PIN8_BASE_A	GPIOA
+#else
+# define _PIN8_A(pin)	0
+# define _PIN8_BASE_A	0
+#endif
+#if defined(GPIO_PORT_B_BASE)
+# define _PIN8_B(pin)	((((pin) & ~15) == GPIOB) ? 0x10 : 0)
+# define _PIN8_BASE_B	GPIOB
+#else
+# define _PIN8_B(pin)	0
+# define _PIN8_BASE_B	0
+#endif
+#if defined(GPIO_PORT_C_BASE)
+# define _PIN8_C(pin)	((((pin) & ~15) == GPIOC) ? 0x20 : 0)
+# define _PIN8_BASE_C	GPIOC
+#else
+# define _PIN8_C(pin)	0
+# define _PIN8_BASE_C	0
+#endif
+#if defined(GPIO_PORT_D_BASE)
+# define _PIN8_D(pin)	((((pin) & ~15) == GPIOD) ? 0x30 : 0)
+# define _PIN8_BASE_D	GPIOD
+#else
+# define _PIN8_D(pin)	0
+# define _PIN8_BASE_D	0
+#endif
+#if defined(GPIO_PORT_E_BASE)
+# define _PIN8_E(pin)	((((pin) & ~15) == GPIOE) ? 0x40 : 0)
+# define _PIN8_BASE_E	GPIOE
+#else
+# define _PIN8_E(pin)	0
+# define _PIN8_BASE_E	0
+#endif
+#if defined(GPIO_PORT_F_BASE)
+# define _PIN8_F(pin)	((((pin) & ~15) == GPIOF) ? 0x50 : 0)
+# define _PIN8_BASE_F	GPIOF
+#else
+# define _PIN8_F(pin)	0
+# define _PIN8_BASE_F	0
+#endif
+#if defined(GPIO_PORT_G_BASE)
+# define _PIN8_G(pin)	((((pin) & ~15) == GPIOG) ? 0x60 : 0)
+# define _PIN8_BASE_G	GPIOG
+#else
+# define _PIN8_G(pin)	0
+# define _PIN8_BASE_G	0
+#endif
+#if defined(GPIO_PORT_H_BASE)
+# define _PIN8_H(pin)	((((pin) & ~15) == GPIOH) ? 0x70 : 0)
+# define _PIN8_BASE_H	GPIOH
+#else
+# define _PIN8_H(pin)	0
+# define _PIN8_BASE_H	0
+#endif
+#if defined(GPIO_PORT_I_BASE)
+# define _PIN8_I(pin)	((((pin) & ~15) == GPIOI) ? 0x80 : 0)
+# define _PIN8_BASE_I	GPIOI
+#else
+# define _PIN8_I(pin)	0
+# define _PIN8_BASE_I	0
+#endif
+
+/** Convert pin name (@ref pin_name_base) to the compact encoding */
+#define PIN8(pin)	((pin8_t)(_PIN8_A(pin) | _PIN8_B(pin) | _PIN8_C(pin) | \
+			 _PIN8_D(pin) | _PIN8_E(pin) | _PIN8_F(pin) | \
+			 _PIN8_G(pin) | _PIN8_H(pin) | _PIN8_I(pin) | \
+			 ((pin) & 15)))
+
 /*****************************************************************************/
 /* API Functions                                                             */
 /*****************************************************************************/
 
 BEGIN_DECLS
 
+/* Read-modify-write of the shared port register. When HAL_PIN_ATOMIC is
+ * defined, the update cannot be lost by concurrent interrupt handler
+ * reconfiguring other pin of the same port.
+ */
+INLINE void _pin_modify(volatile uint32_t *reg, const uint32_t clear,
+			const uint32_t set)
+{
+#if defined(HAL_PIN_ATOMIC)
+	atomic_modify32(reg, clear, set);
+#else
+	*reg = (*reg & ~clear) | set;
+#endif
+}
+
+/* Decode port base address of the compact pin by one table load */
+INLINE uint32_t _pin8_port(const uint32_t pin8)
+{
+	static const uint32_t ports[16] = {
+		_PIN8_BASE_A, _PIN8_BASE_B, _PIN8_BASE_C,
+		_PIN8_BASE_D, _PIN8_BASE_E, _PIN8_BASE_F,
+		_PIN8_BASE_G, _PIN8_BASE_H, _PIN8_BASE_I,
+	};
+
+	return ports[(pin8 >> 4) & 15];
+}
+
+/* Spread 16 bit pin mask to the 2 bit wide fields of the port register */
+INLINE uint32_t _pin_mask2(const uint32_t mask)
+{
+	uint32_t x = mask & 0xFFFF;
+
+	x = (x | (x << 8)) & 0x00FF00FF;
+	x = (x | (x << 4)) & 0x0F0F0F0F;
+	x = (x | (x << 2)) & 0x33333333;
+	x = (x | (x << 1)) & 0x55555555;
+	return x * 3;
+}
+
+/* Spread 8 bit pin mask to the 4 bit wide fields of the port register */
+INLINE uint32_t _pin_mask4(const uint32_t mask)
+{
+	uint32_t x = mask & 0xFF;
 
+	x = (x | (x << 12)) & 0x000F000F;
+	x = (x | (x << 6)) & 0x03030303;
+	x = (x | (x << 3)) & 0x11111111;
+	return x * 15;
+}
 
 END_DECLS
 
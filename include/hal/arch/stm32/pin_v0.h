@@ -24,12 +24,54 @@
 #include <hal/arch/stm32/pin_common.h>
 #include <libopencm3/cm3/nvic.h>
 
+/*****************************************************************************/
+/* API definitions                                                           */
+/*****************************************************************************/
+
+/** Configuration and output state of one port */
+struct pin_port_state {
+	uint32_t crl;
+	uint32_t crh;
+	uint32_t odr;
+};
+
+#define _PIN_SNAPSHOT_MEMBER(name, port, index)	struct pin_port_state name;
+
+/** Configuration and output state of all ports present on the chip */
+struct pin_snapshot {
+	_PIN_PORTS(_PIN_SNAPSHOT_MEMBER)
+};
+
+/** Early boot configuration of the pins in the mask of one port */
+struct pin_boot_port {
+	uint32_t port;		/* GPIOx */
+	uint16_t pins;		/* PIN_BOOT_BIT of the pins */
+	uint16_t odr;		/* PIN_BOOT_BIT of the pins set high or pulled up */
+	uint32_t crl;		/* PIN_BOOT_CRL(pin, mode | (cnf << 2)) */
+	uint32_t crh;		/* PIN_BOOT_CRH(pin, mode | (cnf << 2)) */
+};
+
+/** Bit of the pin in the 1-bit per pin registers */
+#define PIN_BOOT_BIT(pin)		(1U << ((pin) & 15))
+
+/** Field of the pin 0..7 in the CRL register */
+#define PIN_BOOT_CRL(pin, val)						\
+	(((pin) & 15) < 8 ? (uint32_t)(val) << (4 * ((pin) & 7)) : 0)
+
+/** Field of the pin 8..15 in the CRH register */
+#define PIN_BOOT_CRH(pin, val)						\
+	(((pin) & 15) >= 8 ? (uint32_t)(val) << (4 * ((pin) & 7)) : 0)
+
 BEGIN_DECLS
 
 /*****************************************************************************/
 
 INLINE uint32_t _pin_port(const uint32_t pin)
 {
+	/* compact pin8_t names are below any port base address */
+	if (pin < 0x100)
+		return _pin8_port(pin);
+
 	return pin & ~15;
 }
 
@@ -43,8 +85,52 @@ INLINE uint32_t _pin_pinno(const uint32_t pin)
 	return pin & 15;
 }
 
+INLINE uint32_t _pin_clock_bit(const uint32_t pin)
+{
+	switch (_pin_port(pin)) {
+#if defined(GPIO_PORT_A_BASE)
+	case GPIOA: return _RCC_BIT(RCC_GPIOA);
+#endif
+#if defined(GPIO_PORT_B_BASE)
+	case GPIOB: return _RCC_BIT(RCC_GPIOB);
+#endif
+#if defined(GPIO_PORT_C_BASE)
+	case GPIOC: return _RCC_BIT(RCC_GPIOC);
+#endif
+#if defined(GPIO_PORT_D_BASE)
+	case GPIOD: return _RCC_BIT(RCC_GPIOD);
+#endif
+#if defined(GPIO_PORT_E_BASE)
+	case GPIOE: return _RCC_BIT(RCC_GPIOE);
+#endif
+#if defined(GPIO_PORT_F_BASE)
+	case GPIOF: return _RCC_BIT(RCC_GPIOF);
+#endif
+#if defined(GPIO_PORT_G_BASE)
+	case GPIOG: return _RCC_BIT(RCC_GPIOG);
+#endif
+#if defined(GPIO_PORT_H_BASE)
+	case GPIOH: return _RCC_BIT(RCC_GPIOH);
+#endif
+#if defined(GPIO_PORT_I_BASE)
+	case GPIOI: return _RCC_BIT(RCC_GPIOI);
+#endif
+	default:
+		return 0;
+	}
+}
+
 INLINE void pin_clock_enable(const uint32_t pin)
 {
+#if defined(HAL_PIN_CLOCK_CACHE)
+	const uint32_t bit = _pin_clock_bit(pin);
+
+	if (_pin_clock_cache & bit)
+		return;
+
+	_pin_clock_cache |= bit;
+	_RCC_REG(RCC_GPIOA) |= bit;
+#else
 	switch (_pin_port(pin)) {
 #if defined(GPIO_PORT_A_BASE)
 	case GPIOA: rcc_periph_clock_enable(RCC_GPIOA); break;
@@ -76,33 +162,56 @@ INLINE void pin_clock_enable(const uint32_t pin)
 	default:
 		break;
 	}
+#endif
+}
+
+/* All port clock enable bits are located in the same RCC register */
+INLINE void pin_clock_enable_multi(const uint32_t *pins, uint32_t count)
+{
+	uint32_t bits = 0;
+	uint32_t i;
+
+	for (i = 0; i < count; i++)
+		bits |= _pin_clock_bit(pins[i]);
+
+#if defined(HAL_PIN_CLOCK_CACHE)
+	if ((_pin_clock_cache & bits) == bits)
+		return;
+
+	_pin_clock_cache |= bits;
+#endif
+	_RCC_REG(RCC_GPIOA) |= bits;
+}
+
+INLINE void pin_clock_cache_invalidate(void)
+{
+#if defined(HAL_PIN_CLOCK_CACHE)
+	_pin_clock_cache = 0;
+#endif
 }
 
 INLINE void _pin_setmode(uint32_t pin, const uint32_t mode)
 {
-	const uint32_t pinid = (_pin_pinno(pin) < 8) ? (_pin_pin(pin)*4) : ((_pin_pin(pin)-8)*4);
+	const uint32_t pinid = (_pin_pinno(pin) < 8) ? (_pin_pinno(pin)*4) : ((_pin_pinno(pin)-8)*4);
 
 	if (_pin_pinno(pin) < 8) {
-		GPIO_CRL(_pin_port(pin)) = (mode << pinid) |
-			(GPIO_CRL(_pin_port(pin)) & ~(0x0f << pinid));
+		_pin_modify(&GPIO_CRL(_pin_port(pin)), 0x0f << pinid, mode << pinid);
 	}
 	else {
-		GPIO_CRH(_pin_port(pin)) = (mode << pinid) |
-			(GPIO_CRH(_pin_port(pin)) & ~(0x0f << pinid));
+		_pin_modify(&GPIO_CRH(_pin_port(pin)), 0x0f << pinid, mode << pinid);
 	}
 }
 
+/* only the MODE bits are changed, CNF bits left untouched */
 INLINE void _pin_setspd(uint32_t pin, const uint32_t mode)
 {
 	if (_pin_pinno(pin) < 8) {
 		const uint32_t bit = _pin_pinno(pin)*4;
-		GPIO_CRL(_pin_port(pin)) = (mode << bit) |
-			(GPIO_CRL(_pin_port(pin)) & ~(0x04 << bit));
+		_pin_modify(&GPIO_CRL(_pin_port(pin)), 0x03 << bit, mode << bit);
 	}
 	else {
 		const uint32_t bit = _pin_pinno(pin)*4 - 8*4;
-		GPIO_CRH(_pin_port(pin)) = (mode << bit) |
-			(GPIO_CRH(_pin_port(pin)) & ~(0x04 << bit));
+		_pin_modify(&GPIO_CRH(_pin_port(pin)), 0x03 << bit, mode << bit);
 	}
 }
 
@@ -146,7 +255,7 @@ INLINE void pin_pull_up(const uint32_t pin)
 
 /******************************************************************************/
 
-INLINE void pin_output_pushpull(const uint32_t pin, const bool initial_state)
+INLINE void pin_output_pushpull(const uint32_t pin)
 {
 	_pin_setmode(pin, GPIO_MODE_OUTPUT_50_MHZ | (GPIO_CNF_OUTPUT_PUSHPULL << 2));
 }
@@ -208,6 +317,102 @@ INLINE void pin_af_map(const uint32_t pin, const uint32_t af)
 	(void)af;
 }
 
+/******************************************************************************/
+
+/* Set mode (CNF and MODE bits) of all pins in the mask, one store per CRx */
+INLINE void _pin_port_setmode(const uint32_t port, const uint32_t mask,
+			      const uint32_t mode)
+{
+	const uint32_t m4l = _pin_mask4(mask);
+	const uint32_t m4h = _pin_mask4(mask >> 8);
+
+	if (m4l)
+		_pin_modify(&GPIO_CRL(port), m4l, (m4l / 15) * mode);
+	if (m4h)
+		_pin_modify(&GPIO_CRH(port), m4h, (m4h / 15) * mode);
+}
+
+INLINE void _pin_port_save(const uint32_t port, struct pin_port_state *st)
+{
+	st->crl = GPIO_CRL(port);
+	st->crh = GPIO_CRH(port);
+	st->odr = GPIO_ODR(port);
+}
+
+INLINE void _pin_port_restore(const uint32_t port,
+			      const struct pin_port_state *st)
+{
+	GPIO_ODR(port) = st->odr;
+	GPIO_CRL(port) = st->crl;
+	GPIO_CRH(port) = st->crh;
+}
+
+INLINE void _pin_port_analog(const uint32_t port, const uint32_t mask)
+{
+	_pin_port_setmode(port, mask,
+			  GPIO_MODE_INPUT | (GPIO_CNF_INPUT_ANALOG << 2));
+}
+
+#define _PIN_SNAPSHOT_SAVE(name, port, index)	\
+	_pin_port_save(port, &snap->name);
+#define _PIN_SNAPSHOT_RESTORE(name, port, index)	\
+	_pin_port_restore(port, &snap->name);
+#define _PIN_PARK_KEEP(name, port, index)	\
+	if (_pin_port(keep[i]) == port) keepmask[index] |= _pin_pin(keep[i]);
+#define _PIN_PARK_ANALOG(name, port, index)	\
+	_pin_port_analog(port, ~keepmask[index] & 0xFFFF);
+
+INLINE void pin_snapshot_save(struct pin_snapshot *snap)
+{
+	_PIN_PORTS(_PIN_SNAPSHOT_SAVE)
+}
+
+INLINE void pin_snapshot_restore(const struct pin_snapshot *snap)
+{
+	_PIN_PORTS(_PIN_SNAPSHOT_RESTORE)
+}
+
+INLINE void pin_park_analog(const uint32_t *keep, uint32_t count)
+{
+	uint32_t keepmask[9] = {0};
+	uint32_t i;
+
+	for (i = 0; i < count; i++) {
+		_PIN_PORTS(_PIN_PARK_KEEP)
+	}
+
+	_PIN_PORTS(_PIN_PARK_ANALOG)
+}
+
+/******************************************************************************/
+
+/* Plain stores only, interrupts are not running yet */
+INLINE void pin_boot_apply(const struct pin_boot_port *table, uint32_t count)
+{
+	uint32_t bits = 0;
+	uint32_t i, port, m4;
+
+	for (i = 0; i < count; i++)
+		bits |= _pin_clock_bit(table[i].port);
+
+	_RCC_REG(RCC_GPIOA) |= bits;
+
+	/* the first write after the clock enable can be lost, read back */
+	(void)_RCC_REG(RCC_GPIOA);
+
+	for (i = 0; i < count; i++) {
+		port = table[i].port;
+
+		GPIO_BSRR(port) = (table[i].odr & table[i].pins) |
+				  ((~table[i].odr & table[i].pins) << 16);
+
+		m4 = _pin_mask4(table[i].pins);
+		GPIO_CRL(port) = (GPIO_CRL(port) & ~m4) | (table[i].crl & m4);
+		m4 = _pin_mask4(table[i].pins >> 8);
+		GPIO_CRH(port) = (GPIO_CRH(port) & ~m4) | (table[i].crh & m4);
+	}
+}
+
 END_DECLS
 
 
@@ -23,12 +23,55 @@
 
 #include <hal/arch/stm32/pin_common.h>
 
+/*****************************************************************************/
+/* API definitions                                                           */
+/*****************************************************************************/
+
+/** Configuration and output state of one port */
+struct pin_port_state {
+	uint32_t moder;
+	uint32_t otyper;
+	uint32_t ospeedr;
+	uint32_t pupdr;
+	uint32_t odr;
+	uint32_t afrl;
+	uint32_t afrh;
+};
+
+#define _PIN_SNAPSHOT_MEMBER(name, port, index)	struct pin_port_state name;
+
+/** Configuration and output state of all ports present on the chip */
+struct pin_snapshot {
+	_PIN_PORTS(_PIN_SNAPSHOT_MEMBER)
+};
+
+/** Early boot configuration of the pins in the mask of one port */
+struct pin_boot_port {
+	uint32_t port;		/* GPIOx */
+	uint16_t pins;		/* PIN_BOOT_BIT of the pins */
+	uint16_t odr;		/* PIN_BOOT_BIT of the pins set high */
+	uint16_t otyper;	/* PIN_BOOT_BIT of the open drain pins */
+	uint32_t moder;		/* PIN_BOOT_FIELD2(pin, GPIO_MODE_x) */
+	uint32_t ospeedr;	/* PIN_BOOT_FIELD2(pin, GPIO_OSPEED_x) */
+	uint32_t pupdr;		/* PIN_BOOT_FIELD2(pin, GPIO_PUPD_x) */
+};
+
+/** Bit of the pin in the 1-bit per pin registers */
+#define PIN_BOOT_BIT(pin)		(1U << ((pin) & 15))
+
+/** Field of the pin in the 2-bit per pin registers */
+#define PIN_BOOT_FIELD2(pin, val)	((uint32_t)(val) << (2 * ((pin) & 15)))
+
 BEGIN_DECLS
 
 /*****************************************************************************/
 
 INLINE uint32_t _pin_port(const uint32_t pin)
 {
+	/* compact pin8_t names are below any port base address */
+	if (pin < 0x100)
+		return _pin8_port(pin);
+
 	return pin & ~15;
 }
 
@@ -42,8 +85,52 @@ INLINE uint32_t _pin_pinno(const uint32_t pin)
 	return pin & 15;
 }
 
+INLINE uint32_t _pin_clock_bit(const uint32_t pin)
+{
+	switch (_pin_port(pin)) {
+#if defined(GPIO_PORT_A_BASE)
+	case GPIOA: return _RCC_BIT(RCC_GPIOA);
+#endif
+#if defined(GPIO_PORT_B_BASE)
+	case GPIOB: return _RCC_BIT(RCC_GPIOB);
+#endif
+#if defined(GPIO_PORT_C_BASE)
+	case GPIOC: return _RCC_BIT(RCC_GPIOC);
+#endif
+#if defined(GPIO_PORT_D_BASE)
+	case GPIOD: return _RCC_BIT(RCC_GPIOD);
+#endif
+#if defined(GPIO_PORT_E_BASE)
+	case GPIOE: return _RCC_BIT(RCC_GPIOE);
+#endif
+#if defined(GPIO_PORT_F_BASE)
+	case GPIOF: return _RCC_BIT(RCC_GPIOF);
+#endif
+#if defined(GPIO_PORT_G_BASE)
+	case GPIOG: return _RCC_BIT(RCC_GPIOG);
+#endif
+#if defined(GPIO_PORT_H_BASE)
+	case GPIOH: return _RCC_BIT(RCC_GPIOH);
+#endif
+#if defined(GPIO_PORT_I_BASE)
+	case GPIOI: return _RCC_BIT(RCC_GPIOI);
+#endif
+	default:
+		return 0;
+	}
+}
+
 INLINE void pin_clock_enable(const uint32_t pin)
 {
+#if defined(HAL_PIN_CLOCK_CACHE)
+	const uint32_t bit = _pin_clock_bit(pin);
+
+	if (_pin_clock_cache & bit)
+		return;
+
+	_pin_clock_cache |= bit;
+	_RCC_REG(RCC_GPIOA) |= bit;
+#else
 	switch (_pin_port(pin)) {
 #if defined(GPIO_PORT_A_BASE)
 	case GPIOA: rcc_periph_clock_enable(RCC_GPIOA); break;
@@ -75,6 +162,32 @@ INLINE void pin_clock_enable(const uint32_t pin)
 	default:
 		break;
 	}
+#endif
+}
+
+/* All port clock enable bits are located in the same RCC register */
+INLINE void pin_clock_enable_multi(const uint32_t *pins, uint32_t count)
+{
+	uint32_t bits = 0;
+	uint32_t i;
+
+	for (i = 0; i < count; i++)
+		bits |= _pin_clock_bit(pins[i]);
+
+#if defined(HAL_PIN_CLOCK_CACHE)
+	if ((_pin_clock_cache & bits) == bits)
+		return;
+
+	_pin_clock_cache |= bits;
+#endif
+	_RCC_REG(RCC_GPIOA) |= bits;
+}
+
+INLINE void pin_clock_cache_invalidate(void)
+{
+#if defined(HAL_PIN_CLOCK_CACHE)
+	_pin_clock_cache = 0;
+#endif
 }
 
 /*****************************************************************************/
@@ -99,76 +212,76 @@ INLINE void pin_toggle(const uint32_t pin)
 
 INLINE void pin_pull_disable(const uint32_t pin)
 {
-	GPIO_PUPDR(_pin_port(pin)) = (GPIO_PUPDR(_pin_port(pin)) & ~GPIO_PUPD_MASK(_pin_pinno(pin))) | GPIO_PUPD(_pin_pinno(pin), GPIO_PUPD_NONE);
+	_pin_modify(&GPIO_PUPDR(_pin_port(pin)), GPIO_PUPD_MASK(_pin_pinno(pin)), GPIO_PUPD(_pin_pinno(pin), GPIO_PUPD_NONE));
 }
 
 INLINE void pin_pull_down(const uint32_t pin)
 {
-	GPIO_PUPDR(_pin_port(pin)) = (GPIO_PUPDR(_pin_port(pin)) & ~GPIO_PUPD_MASK(_pin_pinno(pin))) | GPIO_PUPD(_pin_pinno(pin), GPIO_PUPD_PULLDOWN);
+	_pin_modify(&GPIO_PUPDR(_pin_port(pin)), GPIO_PUPD_MASK(_pin_pinno(pin)), GPIO_PUPD(_pin_pinno(pin), GPIO_PUPD_PULLDOWN));
 }
 
 INLINE void pin_pull_up(const uint32_t pin)
 {
-	GPIO_PUPDR(_pin_port(pin)) = (GPIO_PUPDR(_pin_port(pin)) & ~GPIO_PUPD_MASK(_pin_pinno(pin))) | GPIO_PUPD(_pin_pinno(pin), GPIO_PUPD_PULLUP);
+	_pin_modify(&GPIO_PUPDR(_pin_port(pin)), GPIO_PUPD_MASK(_pin_pinno(pin)), GPIO_PUPD(_pin_pinno(pin), GPIO_PUPD_PULLUP));
 }
 
 /******************************************************************************/
 
 INLINE void pin_output_pushpull(const uint32_t pin)
 {
-	GPIO_MODER(_pin_port(pin)) = (GPIO_MODER(_pin_port(pin)) & ~GPIO_MODE_MASK(_pin_pinno(pin))) | GPIO_MODE(_pin_pinno(pin), GPIO_MODE_OUTPUT);
-	GPIO_OTYPER(_pin_port(pin)) &= ~_pin_pin(pin);
+	_pin_modify(&GPIO_MODER(_pin_port(pin)), GPIO_MODE_MASK(_pin_pinno(pin)), GPIO_MODE(_pin_pinno(pin), GPIO_MODE_OUTPUT));
+	_pin_modify(&GPIO_OTYPER(_pin_port(pin)), _pin_pin(pin), 0);
 }
 
 INLINE void pin_output_opendrain(const uint32_t pin)
 {
-	GPIO_OTYPER(_pin_port(pin)) |= _pin_pin(pin);
-	GPIO_MODER(_pin_port(pin)) = (GPIO_MODER(_pin_port(pin)) & ~GPIO_MODE_MASK(_pin_pinno(pin))) | GPIO_MODE(_pin_pinno(pin), GPIO_MODE_OUTPUT);
+	_pin_modify(&GPIO_OTYPER(_pin_port(pin)), 0, _pin_pin(pin));
+	_pin_modify(&GPIO_MODER(_pin_port(pin)), GPIO_MODE_MASK(_pin_pinno(pin)), GPIO_MODE(_pin_pinno(pin), GPIO_MODE_OUTPUT));
 }
 
 INLINE void pin_af_pushpull(const uint32_t pin)
 {
-	GPIO_MODER(_pin_port(pin)) = (GPIO_MODER(_pin_port(pin)) & ~GPIO_MODE_MASK(_pin_pinno(pin))) | GPIO_MODE(_pin_pinno(pin), GPIO_MODE_AF);
-	GPIO_OTYPER(_pin_port(pin)) &= ~_pin_pin(pin);
+	_pin_modify(&GPIO_MODER(_pin_port(pin)), GPIO_MODE_MASK(_pin_pinno(pin)), GPIO_MODE(_pin_pinno(pin), GPIO_MODE_AF));
+	_pin_modify(&GPIO_OTYPER(_pin_port(pin)), _pin_pin(pin), 0);
 }
 
 INLINE void pin_af_opendrain(const uint32_t pin)
 {
-	GPIO_OTYPER(_pin_port(pin)) |= _pin_pin(pin);
-	GPIO_MODER(_pin_port(pin)) = (GPIO_MODER(_pin_port(pin)) & ~GPIO_MODE_MASK(_pin_pinno(pin))) | GPIO_MODE(_pin_pinno(pin), GPIO_MODE_AF);
+	_pin_modify(&GPIO_OTYPER(_pin_port(pin)), 0, _pin_pin(pin));
+	_pin_modify(&GPIO_MODER(_pin_port(pin)), GPIO_MODE_MASK(_pin_pinno(pin)), GPIO_MODE(_pin_pinno(pin), GPIO_MODE_AF));
 }
 
 INLINE void pin_input(const uint32_t pin)
 {
-	GPIO_MODER(_pin_port(pin)) = (GPIO_MODER(_pin_port(pin)) & ~GPIO_MODE_MASK(_pin_pinno(pin))) | GPIO_MODE(_pin_pinno(pin), GPIO_MODE_INPUT);
+	_pin_modify(&GPIO_MODER(_pin_port(pin)), GPIO_MODE_MASK(_pin_pinno(pin)), GPIO_MODE(_pin_pinno(pin), GPIO_MODE_INPUT));
 }
 
 INLINE void pin_analog(const uint32_t pin)
 {
-	GPIO_PUPDR(_pin_port(pin)) = (GPIO_PUPDR(_pin_port(pin)) & ~GPIO_PUPD_MASK(_pin_pinno(pin))) | GPIO_PUPD(_pin_pinno(pin), GPIO_PUPD_NONE);
-	GPIO_MODER(_pin_port(pin)) = (GPIO_MODER(_pin_port(pin)) & ~GPIO_MODE_MASK(_pin_pinno(pin))) | GPIO_MODE(_pin_pinno(pin), GPIO_MODE_ANALOG);
+	_pin_modify(&GPIO_PUPDR(_pin_port(pin)), GPIO_PUPD_MASK(_pin_pinno(pin)), GPIO_PUPD(_pin_pinno(pin), GPIO_PUPD_NONE));
+	_pin_modify(&GPIO_MODER(_pin_port(pin)), GPIO_MODE_MASK(_pin_pinno(pin)), GPIO_MODE(_pin_pinno(pin), GPIO_MODE_ANALOG));
 }
 
 /******************************************************************************/
 
 INLINE void pin_speed_low(const uint32_t pin)
 {
-	GPIO_OSPEEDR(_pin_port(pin)) = (GPIO_OSPEEDR(_pin_port(pin)) & ~GPIO_OSPEED_MASK(_pin_pinno(pin))) | GPIO_OSPEED(_pin_pinno(pin), 0);
+	_pin_modify(&GPIO_OSPEEDR(_pin_port(pin)), GPIO_OSPEED_MASK(_pin_pinno(pin)), GPIO_OSPEED(_pin_pinno(pin), 0));
 }
 
 INLINE void pin_speed_medium(const uint32_t pin)
 {
-	GPIO_OSPEEDR(_pin_port(pin)) = (GPIO_OSPEEDR(_pin_port(pin)) & ~GPIO_OSPEED_MASK(_pin_pinno(pin))) | GPIO_OSPEED(_pin_pinno(pin), 1);
+	_pin_modify(&GPIO_OSPEEDR(_pin_port(pin)), GPIO_OSPEED_MASK(_pin_pinno(pin)), GPIO_OSPEED(_pin_pinno(pin), 1));
 }
 
 INLINE void pin_speed_fast(const uint32_t pin)
 {
-	GPIO_OSPEEDR(_pin_port(pin)) = (GPIO_OSPEEDR(_pin_port(pin)) & ~GPIO_OSPEED_MASK(_pin_pinno(pin))) | GPIO_OSPEED(_pin_pinno(pin), 2);
+	_pin_modify(&GPIO_OSPEEDR(_pin_port(pin)), GPIO_OSPEED_MASK(_pin_pinno(pin)), GPIO_OSPEED(_pin_pinno(pin), 2));
 }
 
 INLINE void pin_speed_high(const uint32_t pin)
 {
-	GPIO_OSPEEDR(_pin_port(pin)) = (GPIO_OSPEEDR(_pin_port(pin)) & ~GPIO_OSPEED_MASK(_pin_pinno(pin))) | GPIO_OSPEED(_pin_pinno(pin), 3);
+	_pin_modify(&GPIO_OSPEEDR(_pin_port(pin)), GPIO_OSPEED_MASK(_pin_pinno(pin)), GPIO_OSPEED(_pin_pinno(pin), 3));
 }
 
 
@@ -176,16 +289,118 @@ INLINE void pin_speed_high(const uint32_t pin)
 
 INLINE void pin_af_map(const uint32_t pin, const uint32_t af)
 {
-	GPIO_MODER(_pin_port(pin)) = (GPIO_MODER(_pin_port(pin)) & ~GPIO_MODE_MASK(_pin_pinno(pin))) |
-		GPIO_MODE(_pin_pinno(pin), GPIO_MODE_AF);
-
+	_pin_modify(&GPIO_MODER(_pin_port(pin)), GPIO_MODE_MASK(_pin_pinno(pin)), GPIO_MODE(_pin_pinno(pin), GPIO_MODE_AF));
 
 	if (_pin_pinno(pin) < 8)
-		GPIO_AFRL(_pin_port(pin)) = (GPIO_AFRL(_pin_port(pin)) & ~GPIO_AFR_MASK(pin)) |
-				    GPIO_AFR(_pin_pinno(pin), af);
+		_pin_modify(&GPIO_AFRL(_pin_port(pin)), GPIO_AFR_MASK(_pin_pinno(pin)),
+			    GPIO_AFR(_pin_pinno(pin), af));
 	else
-		GPIO_AFRH(_pin_port(pin)) = (GPIO_AFRH(_pin_port(pin)) & ~GPIO_AFR_MASK(pin-8)) |
-				    GPIO_AFR(_pin_pinno(pin)-8, af);
+		_pin_modify(&GPIO_AFRH(_pin_port(pin)), GPIO_AFR_MASK(_pin_pinno(pin)-8),
+			    GPIO_AFR(_pin_pinno(pin)-8, af));
+}
+
+/******************************************************************************/
+
+/* Set mode of all pins in the mask by one store */
+INLINE void _pin_port_setmode(const uint32_t port, const uint32_t mask,
+			      const uint32_t mode)
+{
+	const uint32_t m2 = _pin_mask2(mask);
+
+	_pin_modify(&GPIO_MODER(port), m2, (m2 / 3) * mode);
+}
+
+INLINE void _pin_port_save(const uint32_t port, struct pin_port_state *st)
+{
+	st->moder = GPIO_MODER(port);
+	st->otyper = GPIO_OTYPER(port);
+	st->ospeedr = GPIO_OSPEEDR(port);
+	st->pupdr = GPIO_PUPDR(port);
+	st->odr = GPIO_ODR(port);
+	st->afrl = GPIO_AFRL(port);
+	st->afrh = GPIO_AFRH(port);
+}
+
+INLINE void _pin_port_restore(const uint32_t port,
+			      const struct pin_port_state *st)
+{
+	GPIO_ODR(port) = st->odr;
+	GPIO_OTYPER(port) = st->otyper;
+	GPIO_OSPEEDR(port) = st->ospeedr;
+	GPIO_PUPDR(port) = st->pupdr;
+	GPIO_AFRL(port) = st->afrl;
+	GPIO_AFRH(port) = st->afrh;
+	GPIO_MODER(port) = st->moder;
+}
+
+INLINE void _pin_port_analog(const uint32_t port, const uint32_t mask)
+{
+	_pin_modify(&GPIO_PUPDR(port), _pin_mask2(mask), 0);
+	_pin_modify(&GPIO_MODER(port), 0, _pin_mask2(mask));
+}
+
+#define _PIN_SNAPSHOT_SAVE(name, port, index)	\
+	_pin_port_save(port, &snap->name);
+#define _PIN_SNAPSHOT_RESTORE(name, port, index)	\
+	_pin_port_restore(port, &snap->name);
+#define _PIN_PARK_KEEP(name, port, index)	\
+	if (_pin_port(keep[i]) == port) keepmask[index] |= _pin_pin(keep[i]);
+#define _PIN_PARK_ANALOG(name, port, index)	\
+	_pin_port_analog(port, ~keepmask[index] & 0xFFFF);
+
+INLINE void pin_snapshot_save(struct pin_snapshot *snap)
+{
+	_PIN_PORTS(_PIN_SNAPSHOT_SAVE)
+}
+
+INLINE void pin_snapshot_restore(const struct pin_snapshot *snap)
+{
+	_PIN_PORTS(_PIN_SNAPSHOT_RESTORE)
+}
+
+INLINE void pin_park_analog(const uint32_t *keep, uint32_t count)
+{
+	uint32_t keepmask[9] = {0};
+	uint32_t i;
+
+	for (i = 0; i < count; i++) {
+		_PIN_PORTS(_PIN_PARK_KEEP)
+	}
+
+	_PIN_PORTS(_PIN_PARK_ANALOG)
+}
+
+/******************************************************************************/
+
+/* Plain stores only, interrupts are not running yet */
+INLINE void pin_boot_apply(const struct pin_boot_port *table, uint32_t count)
+{
+	uint32_t bits = 0;
+	uint32_t i, port, m2;
+
+	for (i = 0; i < count; i++)
+		bits |= _pin_clock_bit(table[i].port);
+
+	_RCC_REG(RCC_GPIOA) |= bits;
+
+	/* the first write after the clock enable can be lost, read back */
+	(void)_RCC_REG(RCC_GPIOA);
+
+	for (i = 0; i < count; i++) {
+		port = table[i].port;
+		m2 = _pin_mask2(table[i].pins);
+
+		GPIO_BSRR(port) = (table[i].odr & table[i].pins) |
+				  ((~table[i].odr & table[i].pins) << 16);
+		GPIO_OTYPER(port) = (GPIO_OTYPER(port) & ~table[i].pins) |
+				    (table[i].otyper & table[i].pins);
+		GPIO_OSPEEDR(port) = (GPIO_OSPEEDR(port) & ~m2) |
+				     (table[i].ospeedr & m2);
+		GPIO_PUPDR(port) = (GPIO_PUPDR(port) & ~m2) |
+				   (table[i].pupdr & m2);
+		GPIO_MODER(port) = (GPIO_MODER(port) & ~m2) |
+				   (table[i].moder & m2);
+	}
 }
 
 END_DECLS
@@ -0,0 +1,55 @@
+/*
+ * This file is part of the HAL project, inline library above libopencm3.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef HAL_TIMEBASE_STM32_DWT_H_INCLUDED
+#define HAL_TIMEBASE_STM32_DWT_H_INCLUDED
+
+#if !defined(HAL_TIMEBASE_H_INCLUDED)
+# error please do not include HAL library internals directly
+#endif
+
+BEGIN_DECLS
+
+/*****************************************************************************/
+
+INLINE void _timebase_start(void)
+{
+	cycle_counter_enable();
+}
+
+/*
+ * The handler runs at least once per counter period, so the counter wrapped
+ * since the last handler call, when it is lower than the value seen then.
+ */
+INLINE uint32_t _timebase_isr_wrapped(uint32_t low, uint32_t last)
+{
+	return low < last;
+}
+
+INLINE uint32_t _timebase_read_wrapped(uint32_t low, uint32_t last)
+{
+	return low < last;
+}
+
+/* The counter is 32-bit already */
+INLINE uint32_t timebase_now32(void)
+{
+	return cycle_counter_get();
+}
+
+END_DECLS
+
+#endif /* HAL_TIMEBASE_STM32_DWT_H_INCLUDED */
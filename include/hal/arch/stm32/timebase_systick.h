@@ -0,0 +1,70 @@
+/*
+ * This file is part of the HAL project, inline library above libopencm3.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef HAL_TIMEBASE_STM32_SYSTICK_H_INCLUDED
+#define HAL_TIMEBASE_STM32_SYSTICK_H_INCLUDED
+
+#if !defined(HAL_TIMEBASE_H_INCLUDED)
+# error please do not include HAL library internals directly
+#endif
+
+#include <libopencm3/cm3/scb.h>
+#include <libopencm3/cm3/systick.h>
+
+BEGIN_DECLS
+
+/*****************************************************************************/
+
+INLINE void _timebase_start(void)
+{
+	cycle_counter_enable();
+	SCB_ICSR = SCB_ICSR_PENDSTCLR;
+	STK_CSR |= STK_CSR_TICKINT;
+}
+
+/* The handler is called exactly once per wrap of the counter */
+INLINE uint32_t _timebase_isr_wrapped(uint32_t low, uint32_t last)
+{
+	(void)low;
+	(void)last;
+	return 1;
+}
+
+/*
+ * The wrap is not accounted yet, when the SysTick interrupt is still pending
+ * (masked, or the reader has higher priority). The counter is read before the
+ * pending bit, so the low values only belong to the new period.
+ */
+INLINE uint32_t _timebase_read_wrapped(uint32_t low, uint32_t last)
+{
+	(void)last;
+	return (SCB_ICSR & SCB_ICSR_PENDSTSET) &&
+	       low < (CYCLE_COUNTER_MASK >> 1);
+}
+
+INLINE uint32_t _timebase_read(uint32_t *low);
+
+INLINE uint32_t timebase_now32(void)
+{
+	uint32_t low;
+	const uint32_t high = _timebase_read(&low);
+
+	return (high << CYCLE_COUNTER_BITS) | low;
+}
+
+END_DECLS
+
+#endif /* HAL_TIMEBASE_STM32_SYSTICK_H_INCLUDED */
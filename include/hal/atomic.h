@@ -0,0 +1,236 @@
+/*
+ * This file is part of the HAL project, inline library above libopencm3.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/** @defgroup ATOMIC_module ATOMIC operations module
+ *
+ * @brief Interrupt-safe read-modify-write API
+ *
+ * @ingroup modules
+ *
+ * LGPL License Terms @ref lgpl_license
+ *
+ * On Cortex-M3/M4/M7 cores, the operations are exclusive load/store retry
+ * loops, never disabling the interrupts. The exception entry and return
+ * clears the local exclusive monitor, so the store fails and the loop retries
+ * whenever an interrupt handler was executed in between. The loops work on
+ * both RAM and peripheral registers.
+ *
+ * Cortex-M0/M0+ cores lack the exclusive access instructions, the operations
+ * are executed with interrupts masked by PRIMASK for a few cycles there.
+ */
+#ifndef HAL_ATOMIC_H_INCLUDED
+#define HAL_ATOMIC_H_INCLUDED
+
+#include <hal/common.h>
+#include <libopencm3/cm3/cortex.h>
+
+/**@{*/
+
+/*****************************************************************************/
+/* API definitions                                                           */
+/*****************************************************************************/
+
+#if defined(__ARM_ARCH_7M__) || defined(__ARM_ARCH_7EM__)
+# define ATOMIC_EXCLUSIVE	1
+#else
+# define ATOMIC_EXCLUSIVE	0
+#endif
+
+/*****************************************************************************/
+/* API Functions                                                             */
+/*****************************************************************************/
+
+BEGIN_DECLS
+
+/*---------------------------------------------------------------------------*/
+/** @brief Atomically clear and set bits of the word
+ *
+ * @param[inout] addr word to modify
+ * @param[in] clear bits to clear
+ * @param[in] set bits to set, applied after clear
+ * @returns new value of the word
+ */
+static uint32_t atomic_modify32(volatile uint32_t *addr, const uint32_t clear,
+				const uint32_t set);
+
+/*---------------------------------------------------------------------------*/
+/** @brief Atomically replace the word
+ *
+ * @param[inout] addr word to replace
+ * @param[in] val new value of the word
+ * @returns previous value of the word
+ */
+static uint32_t atomic_swap32(volatile uint32_t *addr, const uint32_t val);
+
+/*---------------------------------------------------------------------------*/
+/** @brief Atomically add to the word
+ *
+ * @param[inout] addr word to modify
+ * @param[in] val value to add
+ * @returns new value of the word
+ */
+static uint32_t atomic_add32(volatile uint32_t *addr, const uint32_t val);
+
+/*---------------------------------------------------------------------------*/
+/** @brief Atomically replace the word, when it has the expected value
+ *
+ * @param[inout] addr word to replace
+ * @param[in] expected value the word must have
+ * @param[in] val new value of the word
+ * @returns true when the word was replaced
+ */
+static bool atomic_cas32(volatile uint32_t *addr, const uint32_t expected,
+			 const uint32_t val);
+
+END_DECLS
+
+/**@}*/
+
+/*****************************************************************************/
+/* Architecture dependent implementations                                    */
+/*****************************************************************************/
+
+#if ATOMIC_EXCLUSIVE
+
+/* The host test (tests/atomic_host.c) supplies models of the primitives */
+#if !defined(HAL_ATOMIC_HOST_MODEL)
+
+INLINE uint32_t _atomic_ldrex(volatile uint32_t *addr)
+{
+	uint32_t val;
+
+	__asm__ __volatile__ ("ldrex %0, [%1]"
+		: "=r" (val)
+		: "r" (addr)
+		: "memory");
+	return val;
+}
+
+/* returns zero on success */
+INLINE uint32_t _atomic_strex(volatile uint32_t *addr, const uint32_t val)
+{
+	uint32_t fail;
+
+	__asm__ __volatile__ ("strex %0, %2, [%1]"
+		: "=&r" (fail)
+		: "r" (addr), "r" (val)
+		: "memory");
+	return fail;
+}
+
+INLINE void _atomic_clrex(void)
+{
+	__asm__ __volatile__ ("clrex" : : : "memory");
+}
+
+#endif
+
+INLINE uint32_t atomic_modify32(volatile uint32_t *addr, const uint32_t clear,
+				const uint32_t set)
+{
+	uint32_t val;
+
+	do {
+		val = (_atomic_ldrex(addr) & ~clear) | set;
+	} while (_atomic_strex(addr, val));
+
+	return val;
+}
+
+INLINE uint32_t atomic_swap32(volatile uint32_t *addr, const uint32_t val)
+{
+	uint32_t old;
+
+	do {
+		old = _atomic_ldrex(addr);
+	} while (_atomic_strex(addr, val));
+
+	return old;
+}
+
+INLINE uint32_t atomic_add32(volatile uint32_t *addr, const uint32_t val)
+{
+	uint32_t sum;
+
+	do {
+		sum = _atomic_ldrex(addr) + val;
+	} while (_atomic_strex(addr, sum));
+
+	return sum;
+}
+
+INLINE bool atomic_cas32(volatile uint32_t *addr, const uint32_t expected,
+			 const uint32_t val)
+{
+	do {
+		if (_atomic_ldrex(addr) != expected) {
+			_atomic_clrex();
+			return false;
+		}
+	} while (_atomic_strex(addr, val));
+
+	return true;
+}
+
+#else
+
+INLINE uint32_t atomic_modify32(volatile uint32_t *addr, const uint32_t clear,
+				const uint32_t set)
+{
+	const uint32_t mask = cm_mask_interrupts(1);
+	const uint32_t val = (*addr & ~clear) | set;
+
+	*addr = val;
+	cm_mask_interrupts(mask);
+	return val;
+}
+
+INLINE uint32_t atomic_swap32(volatile uint32_t *addr, const uint32_t val)
+{
+	const uint32_t mask = cm_mask_interrupts(1);
+	const uint32_t old = *addr;
+
+	*addr = val;
+	cm_mask_interrupts(mask);
+	return old;
+}
+
+INLINE uint32_t atomic_add32(volatile uint32_t *addr, const uint32_t val)
+{
+	const uint32_t mask = cm_mask_interrupts(1);
+	const uint32_t sum = *addr + val;
+
+	*addr = sum;
+	cm_mask_interrupts(mask);
+	return sum;
+}
+
+INLINE bool atomic_cas32(volatile uint32_t *addr, const uint32_t expected,
+			 const uint32_t val)
+{
+	const uint32_t mask = cm_mask_interrupts(1);
+	const bool ok = (*addr == expected);
+
+	if (ok)
+		*addr = val;
+
+	cm_mask_interrupts(mask);
+	return ok;
+}
+
+#endif
+
+#endif /* HAL_ATOMIC_H_INCLUDED */
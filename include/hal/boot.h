@@ -0,0 +1,120 @@
+/*
+ * This file is part of the HAL project, inline library above libopencm3.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/** @defgroup BOOT_module BOOT module
+ *
+ * @brief Reset handler with early initialization hook
+ *
+ * @ingroup modules
+ *
+ * LGPL License Terms @ref lgpl_license
+ *
+ * The libopencm3 reset handler is weak. @ref BOOT_RESET_HANDLER replaces it
+ * by the handler calling the early function first, and then doing the same
+ * C runtime initialization as the libopencm3 one: .data copy, .bss zeroing,
+ * stack alignment, FPU enable on STM32F3/F4/F7, constructors, main, and
+ * destructors.
+ *
+ * The early function runs before the C runtime is initialized. It can use
+ * the stack and the const data in flash, but no initialized or zeroed
+ * variables. @ref pin_boot_apply fulfills this.
+ *
+ * \includelineno pin/boot_safe.c
+ */
+#ifndef HAL_BOOT_H_INCLUDED
+#define HAL_BOOT_H_INCLUDED
+
+#include <hal/common.h>
+#include <libopencm3/cm3/scb.h>
+
+/**@{*/
+
+/*****************************************************************************/
+/* API definitions                                                           */
+/*****************************************************************************/
+
+/** Define the reset handler, calling the function early before C runtime */
+#define BOOT_RESET_HANDLER(early)					\
+	void reset_handler(void)					\
+	{								\
+		early();						\
+		boot_runtime_start();					\
+	}
+
+/*****************************************************************************/
+/* API Functions                                                             */
+/*****************************************************************************/
+
+BEGIN_DECLS
+
+/*---------------------------------------------------------------------------*/
+/** @brief Initialize the C runtime, and run main
+ *
+ * Called by the handler defined by @ref BOOT_RESET_HANDLER.
+ */
+static void boot_runtime_start(void);
+
+END_DECLS
+
+/**@}*/
+
+/*****************************************************************************/
+/* API implementations                                                       */
+/*****************************************************************************/
+
+/* Symbols exported by the libopencm3 linker scripts */
+extern unsigned _data_loadaddr, _data, _edata, _ebss;
+
+typedef void (*_boot_func_t)(void);
+
+extern _boot_func_t __preinit_array_start, __preinit_array_end;
+extern _boot_func_t __init_array_start, __init_array_end;
+extern _boot_func_t __fini_array_start, __fini_array_end;
+
+int main(void);
+
+/* Follows the reset_handler of libopencm3 lib/cm3/vector.c */
+INLINE void boot_runtime_start(void)
+{
+	volatile unsigned *src, *dest;
+	_boot_func_t *fp;
+
+	for (src = &_data_loadaddr, dest = &_data; dest < &_edata;
+	     src++, dest++)
+		*dest = *src;
+
+	while (dest < &_ebss)
+		*dest++ = 0;
+
+	SCB_CCR |= SCB_CCR_STKALIGN;
+
+#if defined(STM32F3) || defined(STM32F4) || defined(STM32F7)
+	SCB_CPACR |= SCB_CPACR_FULL * (SCB_CPACR_CP10 | SCB_CPACR_CP11);
+#endif
+
+	for (fp = &__preinit_array_start; fp < &__preinit_array_end; fp++)
+		(*fp)();
+
+	for (fp = &__init_array_start; fp < &__init_array_end; fp++)
+		(*fp)();
+
+	(void)main();
+
+	for (fp = &__fini_array_start; fp < &__fini_array_end; fp++)
+		(*fp)();
+}
+
+#endif /* HAL_BOOT_H_INCLUDED */
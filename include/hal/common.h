@@ -25,14 +25,143 @@
 
 #define INLINE	static inline __attribute__((always_inline))
 
+/*
+ * Placement of the hot paths
+ *
+ * HAL_FASTCODE marks the function to run from the RAM without flash wait
+ * states and prefetch misses. By default it is the SRAM on all families,
+ * through the .data section copied by every startup code, so no change of
+ * the linker script is needed. HAL_FASTDATA is plain data by default.
+ *
+ * Define HAL_FASTCODE_TCM to place the code to the CCM RAM on STM32F3 and to
+ * the ITCM on STM32F7, and the HAL_FASTDATA data to the CCM RAM on
+ * STM32F3/F4; it changes nothing on the other families. The CCM of STM32F4
+ * is not on the instruction bus, and not accessible by DMA. The option needs
+ * the output sections in the linker script, and the call of hal_fast_init
+ * before any marked function or data is used. On STM32F3 (CCM of 8K on
+ * STM32F303xC), code and data go to the ccm region:
+ *
+ * @code
+ * MEMORY {
+ *	ccm (rwx) : ORIGIN = 0x10000000, LENGTH = 8K
+ * }
+ *
+ * SECTIONS {
+ *	.hal_fastcode : {
+ *		. = ALIGN(4);
+ *		_hal_fastcode_start = .;
+ *		*(.hal_fastcode*)
+ *		. = ALIGN(4);
+ *		_hal_fastcode_end = .;
+ *	} >ccm AT >rom
+ *	_hal_fastcode_loadaddr = LOADADDR(.hal_fastcode);
+ *
+ *	.hal_fastdata : {
+ *		. = ALIGN(4);
+ *		_hal_fastdata_start = .;
+ *		*(.hal_fastdata*)
+ *		. = ALIGN(4);
+ *		_hal_fastdata_end = .;
+ *	} >ccm AT >rom
+ *	_hal_fastdata_loadaddr = LOADADDR(.hal_fastdata);
+ * }
+ * @endcode
+ *
+ * On STM32F7, the code goes to the itcm region, the data stays in .data,
+ * which is in the DTCM when the ram region starts at 0x20000000:
+ *
+ * @code
+ * MEMORY {
+ *	itcm (rwx) : ORIGIN = 0x00000000, LENGTH = 16K
+ * }
+ *
+ * SECTIONS {
+ *	.hal_fastcode : {
+ *		. = ALIGN(4);
+ *		_hal_fastcode_start = .;
+ *		*(.hal_fastcode*)
+ *		. = ALIGN(4);
+ *		_hal_fastcode_end = .;
+ *	} >itcm AT >rom
+ *	_hal_fastcode_loadaddr = LOADADDR(.hal_fastcode);
+ * }
+ * @endcode
+ *
+ * On STM32F4, only the .hal_fastdata section of the STM32F3 block is needed,
+ * with the ccm region of 64K.
+ *
+ * The marked functions are called by the long calls, as the RAM is out of
+ * the branch range of the flash. The INLINE functions are inlined to their
+ * callers, so only the calling function is to be marked. Define
+ * HAL_FASTCODE_IN_FLASH to keep all of the code in flash.
+ */
+#if defined(HAL_FASTCODE_TCM) && (defined(STM32F3) || defined(STM32F7))
+# define _HAL_FASTCODE_SECTION	".hal_fastcode"
+# define _HAL_FASTCODE_COPY	1
+#else
+# define _HAL_FASTCODE_SECTION	".data.hal_fastcode"
+#endif
+
+#if defined(HAL_FASTCODE_TCM) && (defined(STM32F3) || defined(STM32F4))
+# define HAL_FASTDATA	__attribute__((section(".hal_fastdata")))
+# define _HAL_FASTDATA_COPY	1
+#else
+# define HAL_FASTDATA
+#endif
+
+#if defined(HAL_FASTCODE_IN_FLASH)
+# define HAL_FASTCODE
+#else
+# define HAL_FASTCODE	\
+	__attribute__((section(_HAL_FASTCODE_SECTION), long_call))
+#endif
+
 /*****************************************************************************/
 /* API Functions                                                             */
 /*****************************************************************************/
 
 BEGIN_DECLS
 
+/*---------------------------------------------------------------------------*/
+/** @brief Copy the HAL_FASTCODE and HAL_FASTDATA sections to the CCM or ITCM
+ *
+ * Does nothing without HAL_FASTCODE_TCM, or on the families placing them to
+ * .data. Call at the start of main.
+ */
+static void hal_fast_init(void);
+
 END_DECLS
 
+/*****************************************************************************/
+/* API implementations                                                       */
+/*****************************************************************************/
+
+INLINE void _hal_copy(uint32_t *dst, const uint32_t *end, const uint32_t *src)
+{
+	while (dst < end)
+		*dst++ = *src++;
+}
+
+INLINE void hal_fast_init(void)
+{
+#if defined(_HAL_FASTCODE_COPY) && !defined(HAL_FASTCODE_IN_FLASH)
+	extern uint32_t _hal_fastcode_start, _hal_fastcode_end;
+	extern const uint32_t _hal_fastcode_loadaddr;
+
+	_hal_copy(&_hal_fastcode_start, &_hal_fastcode_end,
+		  &_hal_fastcode_loadaddr);
+#endif
+#if defined(_HAL_FASTDATA_COPY)
+	extern uint32_t _hal_fastdata_start, _hal_fastdata_end;
+	extern const uint32_t _hal_fastdata_loadaddr;
+
+	_hal_copy(&_hal_fastdata_start, &_hal_fastdata_end,
+		  &_hal_fastdata_loadaddr);
+#endif
+	/* the copied code must not be fetched before the stores complete */
+	__asm__ __volatile__ ("dsb\n\tisb" : : : "memory");
+}
+
 /*****************************************************************************/
 /* Architecture dependent inclusion                                          */
 /*****************************************************************************/
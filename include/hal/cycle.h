@@ -0,0 +1,111 @@
+/*
+ * This file is part of the HAL project, inline library above libopencm3.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/** @defgroup CYCLE_module CYCLE counter module
+ *
+ * @brief Free running processor cycle counter API
+ *
+ * @ingroup modules
+ *
+ * LGPL License Terms @ref lgpl_license
+ *
+ * The counter is the DWT cycle counter on cores that have one (Cortex-M3 and
+ * above), and the SysTick timer on Cortex-M0/M0+ cores. The SysTick based
+ * counter is only @ref CYCLE_COUNTER_BITS wide, so the differences of the
+ * timestamps must always be computed by @ref cycle_diff.
+ */
+#ifndef HAL_CYCLE_H_INCLUDED
+#define HAL_CYCLE_H_INCLUDED
+
+#include <hal/common.h>
+
+/**@{*/
+
+/*****************************************************************************/
+/* API definitions                                                           */
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* API Functions                                                             */
+/*****************************************************************************/
+
+BEGIN_DECLS
+
+/*---------------------------------------------------------------------------*/
+/** @brief Enable and start the free running cycle counter
+ *
+ * @note On the SysTick based counter, the SysTick is reconfigured to count
+ * the full 24bit range from the processor clock, and the SysTick interrupt is
+ * left untouched.
+ */
+static void cycle_counter_enable(void);
+
+/*---------------------------------------------------------------------------*/
+/** @brief Get the actual value of the cycle counter
+ *
+ * The counter is counting up, and wraps around after 2^CYCLE_COUNTER_BITS
+ * cycles.
+ *
+ * @returns actual counter value
+ */
+static uint32_t cycle_counter_get(void);
+
+/*---------------------------------------------------------------------------*/
+/** @brief Get number of cycles elapsed between two counter values
+ *
+ * The result is correct, when the distance of the timestamps is less than
+ * 2^CYCLE_COUNTER_BITS cycles.
+ *
+ * @param[in] from older counter value
+ * @param[in] to newer counter value
+ * @returns cycles elapsed
+ */
+static uint32_t cycle_diff(const uint32_t from, const uint32_t to);
+
+END_DECLS
+
+/**@}*/
+
+/*****************************************************************************/
+/* Architecture dependent implementations                                    */
+/*****************************************************************************/
+
+#if defined(STM32F0)
+# include <hal/arch/stm32/cycle_systick.h>
+#elif defined(STM32F1)
+# include <hal/arch/stm32/cycle_dwt.h>
+#elif defined(STM32F2)
+# include <hal/arch/stm32/cycle_dwt.h>
+#elif defined(STM32F3)
+# include <hal/arch/stm32/cycle_dwt.h>
+#elif defined(STM32F4)
+# include <hal/arch/stm32/cycle_dwt.h>
+#elif defined(STM32F7)
+# include <hal/arch/stm32/cycle_dwt.h>
+#elif defined(STM32L0)
+# include <hal/arch/stm32/cycle_systick.h>
+#elif defined(STM32L1)
+# include <hal/arch/stm32/cycle_dwt.h>
+#else
+# error "hal/cycle.h have not defined your architecture."
+#endif
+
+INLINE uint32_t cycle_diff(const uint32_t from, const uint32_t to)
+{
+	return (to - from) & CYCLE_COUNTER_MASK;
+}
+
+#endif /* HAL_CYCLE_H_INCLUDED */
@@ -26,6 +26,15 @@
 #define HAL_DELAY_H_INCLUDED
 
 #include <hal/common.h>
+#include <libopencm3/cm3/cortex.h>
+#include <libopencm3/cm3/scb.h>
+#include <libopencm3/cm3/systick.h>
+
+/* The SysTick is the cycle counter and the timebase, kept by the sleeps */
+#if defined(STM32F0) || defined(STM32L0)
+# define _DELAY_SYSTICK_TIMEBASE	1
+# include <hal/timebase.h>
+#endif
 
 /**@{*/
 
@@ -73,6 +82,84 @@ static void delay_us(uint32_t us, uint64_t cpufreq);
  */
 static void delay_ms(uint32_t ms, uint64_t cpufreq);
 
+/*---------------------------------------------------------------------------*/
+/** @brief Compute the spin-wait loop count for specified microseconds
+ *
+ * The division is done once here, so the result can be stored and passed to
+ * the @ref delay_loops in the timing critical code.
+ *
+ * @param[in] us Microseconds needed to spin wait.
+ * @param[in] cpufreq Current CPU frequency in Hz
+ * @returns loop count for @ref delay_loops
+ */
+static uint32_t delay_loops_us(uint32_t us, uint64_t cpufreq);
+
+/*---------------------------------------------------------------------------*/
+/** @brief Spin-wait delay, spinning precomputed count of loops
+ *
+ * @param[in] loops Loop count computed by @ref delay_loops_us
+ */
+static void delay_loops(uint32_t loops);
+
+/*---------------------------------------------------------------------------*/
+/** @brief Spin-wait delay, spinning specified amount of nanoseconds
+ *
+ * Both arguments must be constant expressions, the delay is resolved at
+ * compile time to the exact count of NOP instructions (up to
+ * DELAY_NS_MAX_NOPS cycles), or to the NOPs and the call of the delay loop
+ * with precomputed count. No computation is done at run time.
+ *
+ * The delay is rounded up to the whole CPU cycles. Requesting the delay
+ * shorter than one CPU cycle, or passing non-constant argument, fails to
+ * compile.
+ *
+ * @param[in] ns Nanoseconds needed to spin wait.
+ * @param[in] cpufreq CPU frequency in Hz
+ */
+#define delay_ns(ns, cpufreq)	_DELAY_NS(ns, cpufreq)
+
+/*---------------------------------------------------------------------------*/
+/** @brief Sleeping delay, sleeping specified amount of microseconds
+ *
+ * The SysTick is programmed for the deadline and the core sleeps by WFI until
+ * it expires. The delays longer than the SysTick range are chained from
+ * several reloads, so there is no upper limit of the duration. The wake-up
+ * latency is compensated by @ref DELAY_SLEEP_OVERHEAD_CYCLES, and the delays
+ * too short to sleep are spun by @ref delay_cycles.
+ *
+ * Other interrupts are served during the delay as usual, the SysTick
+ * interrupt handler is not called. On STM32F0/L0 the interrupts stay masked
+ * for the whole delay instead, see the note.
+ *
+ * @note The SysTick is borrowed for the delay, its configuration and the
+ * position in its period are restored afterwards, as if it ran through the
+ * sleep, to within the wake-up overhead. Its interrupt handler is not called
+ * for the periods slept through; on STM32F0/L0 these wraps of the
+ * @ref CYCLE_module counter are added to the @ref TIMEBASE_module directly,
+ * so @ref timebase_now stays continuous. On other families, the sleep must
+ * be shorter than 2^32 cycles while the timebase is used.
+ *
+ * @note On STM32F0/L0 the borrowed SysTick is also the @ref CYCLE_module
+ * counter, so the timestamps taken by the interrupt handlers during the
+ * sleep would be wrong. The interrupts are masked for the whole delay, and
+ * served after it; the interrupts coming during the sleep wake the core and
+ * spin the rest of the delay.
+ *
+ * @param[in] us Microseconds needed to sleep.
+ * @param[in] cpufreq Current CPU frequency in Hz
+ */
+static void delay_sleep_us(uint32_t us, uint64_t cpufreq);
+
+/*---------------------------------------------------------------------------*/
+/** @brief Sleeping delay, sleeping specified amount of milliseconds
+ *
+ * See @ref delay_sleep_us for details.
+ *
+ * @param[in] ms Milliseconds needed to sleep.
+ * @param[in] cpufreq Current CPU frequency in Hz
+ */
+static void delay_sleep_ms(uint32_t ms, uint64_t cpufreq);
+
 END_DECLS
 
 /**@}*/
@@ -81,41 +168,205 @@ END_DECLS
 /* Architecture dependent implementations                                    */
 /*****************************************************************************/
 
-static void _delay_3t(uint32_t cycles) __attribute__((naked));
+/*
+ * Delay kernel costs per core, in cycles, for code and data with zero wait
+ * states:
+ *
+ * - DELAY_LOOP_CYCLES: one loop iteration (subs + taken bne)
+ * - DELAY_OVERHEAD_CYCLES: argument load, call, return, and the last not
+ *   taken bne, minus one loop iteration
+ *
+ * Core      | subs | bne taken/not | bl+bx (RAM: ldr+blx+bx) | loop | overhead
+ * ----------|------|---------------|-------------------------|------|---------
+ * M0        | 1    | 3 / 1         | 4+3 (2+3+3)             | 4    | 6 (7)
+ * M0+       | 1    | 2 / 1         | 3+2 (2+2+2)             | 3    | 5 (6)
+ * M3/M4     | 1    | 2 / 1         | 2+2 (2+2+2)             | 3    | 5 (7)
+ * M7        | 1    | 1 / 1 (pred.) | 2+2 (2+2+2)             | 2    | 5 (7)
+ *
+ * All values are nominal, taken from the instruction timings of the ARM
+ * technical reference manuals, not measured on the parts. The Cortex-M7
+ * values depend on the surrounding code too, by dual issue and branch
+ * prediction. To measure them, read the DWT cycle counter around
+ * delay_loops(N) for two values of N, giving T(N): DELAY_LOOP_CYCLES is
+ * (T(N2) - T(N1)) / (N2 - N1), and DELAY_OVERHEAD_CYCLES is
+ * T(N1) - N1 * DELAY_LOOP_CYCLES. Define both to override the table.
+ *
+ * The kernel is placed in RAM by HAL_FASTCODE (SRAM through .data by
+ * default, CCM or ITCM with HAL_FASTCODE_TCM), so flash wait states and
+ * prefetch misses do not distort the loop. Define HAL_DELAY_IN_FLASH to keep
+ * it in flash.
+ */
+#if defined(STM32F0)
+# define _DELAY_CORE_M0		1
+#elif defined(STM32L0)
+# define _DELAY_CORE_M0PLUS	1
+#elif defined(STM32F1) || defined(STM32F2) || defined(STM32L1)
+# define _DELAY_CORE_M3		1
+#elif defined(STM32F3) || defined(STM32F4)
+# define _DELAY_CORE_M4		1
+#elif defined(STM32F7)
+# define _DELAY_CORE_M7		1
+#else
+# error "hal/delay.h have not defined your architecture."
+#endif
+
+#if defined(HAL_DELAY_IN_FLASH) || defined(HAL_FASTCODE_IN_FLASH)
+# define _DELAY_CALL_EXTRA	0
+# define _DELAY_FASTCODE
+#else
+# define _DELAY_CALL_EXTRA	1
+# define _DELAY_FASTCODE	HAL_FASTCODE
+#endif
+
+#if defined(DELAY_LOOP_CYCLES) || defined(DELAY_OVERHEAD_CYCLES)
+# if !defined(DELAY_LOOP_CYCLES) || !defined(DELAY_OVERHEAD_CYCLES)
+#  error "hal/delay.h: define both DELAY_LOOP_CYCLES and DELAY_OVERHEAD_CYCLES"
+# endif
+#elif defined(_DELAY_CORE_M0)
+# define DELAY_LOOP_CYCLES	4
+# define DELAY_OVERHEAD_CYCLES	(6 + _DELAY_CALL_EXTRA)
+#elif defined(_DELAY_CORE_M0PLUS)
+# define DELAY_LOOP_CYCLES	3
+# define DELAY_OVERHEAD_CYCLES	(5 + _DELAY_CALL_EXTRA)
+#elif defined(_DELAY_CORE_M3) || defined(_DELAY_CORE_M4)
+# define DELAY_LOOP_CYCLES	3
+# define DELAY_OVERHEAD_CYCLES	(5 + 2 * _DELAY_CALL_EXTRA)
+#elif defined(_DELAY_CORE_M7)
+# define DELAY_LOOP_CYCLES	2
+# define DELAY_OVERHEAD_CYCLES	(5 + 2 * _DELAY_CALL_EXTRA)
+#endif
+
+/* Build-time check of the family to core mapping, and the range check of
+ * the constants
+ */
+#if (defined(_DELAY_CORE_M0) || defined(_DELAY_CORE_M0PLUS)) && \
+    !defined(__ARM_ARCH_6M__)
+# error "hal/delay.h: STM32F0/L0 must be compiled for Cortex-M0/M0+"
+#endif
+#if defined(_DELAY_CORE_M3) && !defined(__ARM_ARCH_7M__)
+# error "hal/delay.h: STM32F1/F2/L1 must be compiled for Cortex-M3"
+#endif
+#if (defined(_DELAY_CORE_M4) || defined(_DELAY_CORE_M7)) && \
+    !defined(__ARM_ARCH_7EM__)
+# error "hal/delay.h: STM32F3/F4/F7 must be compiled for Cortex-M4/M7"
+#endif
+#if DELAY_LOOP_CYCLES < 2 || DELAY_LOOP_CYCLES > 4 || \
+    DELAY_OVERHEAD_CYCLES < DELAY_LOOP_CYCLES || DELAY_OVERHEAD_CYCLES > 15
+# error "hal/delay.h: delay kernel constants out of range"
+#endif
+
+static void _delay_loop(uint32_t loops)
+	__attribute__((naked, noinline)) _DELAY_FASTCODE;
 
-/* 3 Tcyc per tick, 4Tcyc call/ret, 1Tcyc hidden reg assignment */
-static void _delay_3t(uint32_t cycles)
+/* DELAY_LOOP_CYCLES Tcyc per loop, the count is passed in r0 */
+static void _delay_loop(uint32_t loops)
 {
-	asm __volatile__ (
-        ".syntax unified\n"
+	(void)loops;
+
+	__asm__ __volatile__ (
+		".syntax unified\n"
 		"1: \n"
-		"	subs %[cyc],#1 \n"	/* 1Tck */
-		"	bne 1b \n"		/* 2Tck */
+		"	subs r0, #1 \n"
+		"	bne 1b \n"
 		"	bx lr \n"
 		".syntax divided\n"
-		: /* No output */
-		: [cyc] "r" (cycles)
-		: /* No memory */
 	);
 }
 
+/* Cycles up to this count are spent by the NOPs only in delay_ns */
+#ifndef DELAY_NS_MAX_NOPS
+#define DELAY_NS_MAX_NOPS	32
+#endif
+
+#if DELAY_NS_MAX_NOPS < DELAY_OVERHEAD_CYCLES + DELAY_LOOP_CYCLES
+# error "hal/delay.h: DELAY_NS_MAX_NOPS too small"
+#endif
+
+/* Cortex-M7 issues two NOPs per cycle, used by delay_ns and delay_cycles */
+#if defined(_DELAY_CORE_M7)
+# define _DELAY_NOPS_PER_CYCLE	2
+#else
+# define _DELAY_NOPS_PER_CYCLE	1
+#endif
+
+#ifdef __cplusplus
+# define _DELAY_STATIC_ASSERT(cond, msg)	static_assert(cond, msg)
+#else
+# define _DELAY_STATIC_ASSERT(cond, msg)	_Static_assert(cond, msg)
+#endif
+
+#define _DELAY_NS_CYCLES(ns, cpufreq)					\
+	((uint32_t)(((uint64_t)(ns) * (uint64_t)(cpufreq) + 999999999ULL) / \
+		    1000000000ULL))
+
+#define _DELAY_NS_LOOPS(c)						\
+	(((c) > DELAY_NS_MAX_NOPS) ?					\
+	 ((c) - DELAY_OVERHEAD_CYCLES) / DELAY_LOOP_CYCLES : 0)
+
+#define _DELAY_NS_NOPS(c)						\
+	((((c) > DELAY_NS_MAX_NOPS) ?					\
+	  ((c) - DELAY_OVERHEAD_CYCLES) % DELAY_LOOP_CYCLES : (c)) *	\
+	 _DELAY_NOPS_PER_CYCLE)
+
+#define _DELAY_NS(ns, cpufreq)						\
+	do {								\
+		_DELAY_STATIC_ASSERT((uint64_t)(ns) * (uint64_t)(cpufreq) >= \
+				     1000000000ULL,			\
+				     "delay_ns below one CPU cycle");	\
+		__asm__ __volatile__ (".rept %c0\n\tnop\n\t.endr"	\
+			: : "i" (_DELAY_NS_NOPS(_DELAY_NS_CYCLES(ns, cpufreq)))); \
+		if (_DELAY_NS_LOOPS(_DELAY_NS_CYCLES(ns, cpufreq)) != 0) \
+			_delay_loop(_DELAY_NS_LOOPS(			\
+				_DELAY_NS_CYCLES(ns, cpufreq)));	\
+	} while (0)
+
+/* Exactly n NOPs when n is constant, 0 <= n <= 15 */
+INLINE void _delay_nops(const uint32_t n)
+{
+	switch (n) {
+	default:
+	case 15: __asm__ __volatile__ ("nop"); /* fallthrough */
+	case 14: __asm__ __volatile__ ("nop"); /* fallthrough */
+	case 13: __asm__ __volatile__ ("nop"); /* fallthrough */
+	case 12: __asm__ __volatile__ ("nop"); /* fallthrough */
+	case 11: __asm__ __volatile__ ("nop"); /* fallthrough */
+	case 10: __asm__ __volatile__ ("nop"); /* fallthrough */
+	case 9: __asm__ __volatile__ ("nop"); /* fallthrough */
+	case 8: __asm__ __volatile__ ("nop"); /* fallthrough */
+	case 7: __asm__ __volatile__ ("nop"); /* fallthrough */
+	case 6: __asm__ __volatile__ ("nop"); /* fallthrough */
+	case 5: __asm__ __volatile__ ("nop"); /* fallthrough */
+	case 4: __asm__ __volatile__ ("nop"); /* fallthrough */
+	case 3: __asm__ __volatile__ ("nop"); /* fallthrough */
+	case 2: __asm__ __volatile__ ("nop"); /* fallthrough */
+	case 1: __asm__ __volatile__ ("nop"); /* fallthrough */
+	case 0: break;
+	}
+}
+
+/* Exactly n Tcyc when n is constant, 0 <= n <= 15 */
+INLINE void _delay_nop_cycles(const uint32_t n)
+{
+	_delay_nops(n);
+#if _DELAY_NOPS_PER_CYCLE == 2
+	_delay_nops(n);
+#endif
+}
 
 INLINE void delay_cycles(const int64_t cycles)
 {
 	if (cycles <= 0)
 		return;
 
-	switch (cycles % 3) {
-	default:
-	case 0: break;
-	case 1: asm __volatile__ ("nop"); break;
-	case 2: asm __volatile__ ("nop\nnop"); break;
+	if (cycles < DELAY_OVERHEAD_CYCLES + DELAY_LOOP_CYCLES) {
+		_delay_nop_cycles((uint32_t)cycles);
+		return;
 	}
 
-	if (cycles > 3)
-		_delay_3t((uint32_t)(cycles / 3));
-	else /* same delay as the function call */
-		asm __volatile__ ("nop\nnop\nnop\nnop\nnop\nnop\n");
+	_delay_nop_cycles((uint32_t)((cycles - DELAY_OVERHEAD_CYCLES) %
+				     DELAY_LOOP_CYCLES));
+	_delay_loop((uint32_t)((cycles - DELAY_OVERHEAD_CYCLES) /
+			       DELAY_LOOP_CYCLES));
 }
 
 
@@ -126,7 +377,7 @@ INLINE void delay_us(uint32_t us, uint64_t cpufreq)
 	if (us == 0)
 		return;
 
-	delay_cycles(us * cpufreq / 1000000 - 6);
+	delay_cycles(us * cpufreq / 1000000);
 }
 
 /* max 25 sec @ 168MHz! */
@@ -136,7 +387,162 @@ INLINE void delay_ms(uint32_t ms, uint64_t cpufreq)
 	if (ms == 0)
 		return;
 
-	delay_cycles(ms * cpufreq / 1000 - 6);
+	delay_cycles(ms * cpufreq / 1000);
+}
+
+INLINE uint32_t delay_loops_us(uint32_t us, uint64_t cpufreq)
+{
+	const uint64_t cycles = us * cpufreq / 1000000;
+
+	if (cycles < DELAY_OVERHEAD_CYCLES + DELAY_LOOP_CYCLES)
+		return 0;
+
+	return (uint32_t)((cycles - DELAY_OVERHEAD_CYCLES) / DELAY_LOOP_CYCLES);
+}
+
+INLINE void delay_loops(uint32_t loops)
+{
+	if (loops != 0)
+		_delay_loop(loops);
+}
+
+/*
+ * Cycles spent by the sleeping delay outside of the sleep: SysTick setup,
+ * wake-up from WFI, and the restore of the SysTick configuration.
+ */
+#ifndef DELAY_SLEEP_OVERHEAD_CYCLES
+#define DELAY_SLEEP_OVERHEAD_CYCLES	40
+#endif
+
+/* Shorter delays are not worth to sleep */
+#define _DELAY_SLEEP_MIN_CYCLES		(4 * DELAY_SLEEP_OVERHEAD_CYCLES)
+
+/* One SysTick reload period, max 2^24 */
+#define _DELAY_SLEEP_CHUNK		(STK_RVR_RELOAD + 1ULL)
+
+#if _DELAY_SLEEP_MIN_CYCLES - DELAY_SLEEP_OVERHEAD_CYCLES < 2
+# error "hal/delay.h: DELAY_SLEEP_OVERHEAD_CYCLES too small"
+#endif
+
+/*
+ * Restore the SysTick configuration, and continue its period where it would
+ * be without the sleep. The counter loads only the reload value, so the
+ * position is loaded through the reload register. On STM32F0/L0 the wraps
+ * of the cycle counter during the sleep are added to the timebase.
+ */
+INLINE void _delay_sleep_restore(uint32_t csr, uint32_t rvr, uint32_t cvr,
+				 uint64_t slept)
+{
+	const uint64_t ticks = (csr & STK_CSR_CLKSOURCE) ? slept : slept / 8;
+	const uint64_t pos = (uint64_t)(rvr - cvr) + ticks;
+
+	cvr = rvr - (uint32_t)(pos % (rvr + 1ULL));
+
+#if defined(_DELAY_SYSTICK_TIMEBASE)
+	if ((csr & STK_CSR_ENABLE) && rvr == STK_RVR_RELOAD)
+		_timebase_add_wraps((uint32_t)(pos / (rvr + 1ULL)));
+#endif
+
+	STK_CSR = 0;
+	SCB_ICSR = SCB_ICSR_PENDSTCLR;
+	if (!(csr & STK_CSR_ENABLE) || cvr == 0) {
+		STK_RVR = rvr;
+		STK_CVR = 0;
+		STK_CSR = csr;
+		return;
+	}
+
+	STK_RVR = cvr;
+	STK_CVR = 0;
+	STK_CSR = csr;
+	while (STK_CVR == 0);
+	STK_RVR = rvr;
+}
+
+/*
+ * The sleep is done with interrupts masked by PRIMASK, so the pending SysTick
+ * wakes the core from WFI without calling its handler. When other interrupt
+ * woken the core, the SysTick interrupt is disabled, and the interrupts are
+ * unmasked for a moment to let the handler run. The COUNTFLAG still signals
+ * the expiration that happened in the meantime. When called with interrupts
+ * already masked, other interrupts just shorten the sleep into spinning.
+ *
+ * On STM32F0/L0 the handlers would read the borrowed SysTick as the cycle
+ * counter, so the interrupts are never unmasked during the sleep.
+ */
+INLINE void _delay_sleep_cycles(uint64_t cycles)
+{
+	const uint32_t csr = STK_CSR & (STK_CSR_CLKSOURCE | STK_CSR_TICKINT |
+					STK_CSR_ENABLE);
+	const uint32_t rvr = STK_RVR;
+	const uint64_t slept = cycles;
+	uint32_t mask, cvr, pend;
+	uint64_t chunk;
+
+	if (cycles < _DELAY_SLEEP_MIN_CYCLES) {
+		delay_cycles((int64_t)cycles);
+		return;
+	}
+
+	cycles -= DELAY_SLEEP_OVERHEAD_CYCLES;
+	mask = cm_mask_interrupts(1);
+	cvr = STK_CVR;
+	pend = SCB_ICSR & SCB_ICSR_PENDSTSET;
+
+	while (cycles != 0) {
+		/*
+		 * Every chunk is 2 to 2^24 cycles, so the reload is 1 to
+		 * STK_RVR_RELOAD: the reload of 0 never sets COUNTFLAG, and
+		 * the 24-bit register truncates the larger ones to it. The
+		 * rest of 1 cycle is avoided by the half period.
+		 */
+		chunk = cycles;
+		if (chunk > _DELAY_SLEEP_CHUNK) {
+			chunk = _DELAY_SLEEP_CHUNK;
+			if (cycles - chunk < 2)
+				chunk = _DELAY_SLEEP_CHUNK / 2;
+		}
+
+		STK_CSR = 0;
+		STK_RVR = (uint32_t)(chunk - 1);
+		STK_CVR = 0;
+		STK_CSR = STK_CSR_CLKSOURCE_AHB | STK_CSR_TICKINT |
+			  STK_CSR_ENABLE;
+
+		while (!(STK_CSR & STK_CSR_COUNTFLAG)) {
+			__asm__ __volatile__ ("wfi");
+
+#if !defined(_DELAY_SYSTICK_TIMEBASE)
+			if (mask == 0) {
+				STK_CSR = STK_CSR_CLKSOURCE_AHB |
+					  STK_CSR_ENABLE;
+				SCB_ICSR = SCB_ICSR_PENDSTCLR;
+				cm_mask_interrupts(0);
+				cm_mask_interrupts(1);
+				STK_CSR = STK_CSR_CLKSOURCE_AHB |
+					  STK_CSR_TICKINT | STK_CSR_ENABLE;
+			}
+#endif
+		}
+
+		SCB_ICSR = SCB_ICSR_PENDSTCLR;
+		cycles -= chunk;
+	}
+
+	_delay_sleep_restore(csr, rvr, cvr, slept);
+	if (pend)
+		SCB_ICSR = SCB_ICSR_PENDSTSET;
+	cm_mask_interrupts(mask);
+}
+
+INLINE void delay_sleep_us(uint32_t us, uint64_t cpufreq)
+{
+	_delay_sleep_cycles(us * cpufreq / 1000000);
+}
+
+INLINE void delay_sleep_ms(uint32_t ms, uint64_t cpufreq)
+{
+	_delay_sleep_cycles(ms * cpufreq / 1000);
 }
 
 #endif /* HAL_DELAY_H_INCLUDED */
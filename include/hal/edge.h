@@ -0,0 +1,317 @@
+/*
+ * This file is part of the HAL project, inline library above libopencm3.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/** @defgroup EDGE_module EDGE capture module
+ *
+ * @brief Pin edge timestamping and frequency/pulse-width measurement API
+ *
+ * @ingroup modules
+ *
+ * LGPL License Terms @ref lgpl_license
+ *
+ * The edges of the pin are timestamped by the @ref CYCLE_module counter in the
+ * EXTI interrupt handler and stored to a lock-free ring, one ring per pin. The
+ * ring is emptied by the reducer (@ref edge_capture_process) running in the
+ * background, which computes the period, the high pulse width and the moving
+ * average of the period. The results can be read from any context without
+ * disabling interrupts.
+ *
+ * The handler costs about 20 cycles per edge on Cortex-M3/M4 (plus the
+ * exception entry and exit), regardless of the ring fill level.
+ *
+ * Example of tachometer measurement:
+ *
+ * \includelineno edge/tachometer.c
+ */
+#ifndef HAL_EDGE_H_INCLUDED
+#define HAL_EDGE_H_INCLUDED
+
+#include <hal/common.h>
+#include <hal/pin.h>
+#include <hal/cycle.h>
+#include <libopencm3/stm32/exti.h>
+
+/**@{*/
+
+/*****************************************************************************/
+/* API definitions                                                           */
+/*****************************************************************************/
+
+/** Count of timestamps held in the ring, must be power of two */
+#ifndef EDGE_RING_SIZE
+#define EDGE_RING_SIZE		16
+#endif
+
+/** Moving average weight of the new period is 1/2^EDGE_AVG_SHIFT.
+ * The accumulator is 64-bit, so all periods up to 2^32 cycles are averaged.
+ */
+#ifndef EDGE_AVG_SHIFT
+#define EDGE_AVG_SHIFT		4
+#endif
+
+#if (EDGE_RING_SIZE & (EDGE_RING_SIZE - 1)) != 0
+# error "EDGE_RING_SIZE must be power of two"
+#endif
+
+/** Consistent snapshot of the measured values, all times are in cycles */
+struct edge_result {
+	uint32_t period;	/**< last rising-to-rising edge period */
+	uint32_t high;		/**< last rising-to-falling edge pulse width */
+	uint32_t avg_period;	/**< moving average of the period */
+	uint32_t edges;		/**< count of processed edges */
+	uint32_t last;		/**< timestamp of the last processed edge */
+};
+
+/** Capture state of one pin */
+struct edge_capture {
+	/* filled by the interrupt handler */
+	volatile uint32_t ring[EDGE_RING_SIZE];
+	volatile uint32_t head;
+	volatile uint32_t overruns;
+
+	/* reducer state */
+	volatile uint32_t tail;
+	uint32_t last_rise;
+	uint64_t avg_acc;
+	uint32_t valid;
+
+	/* published results, the sequence selects the valid copy */
+	volatile uint32_t seq;
+	volatile struct edge_result result[2];
+};
+
+/*****************************************************************************/
+/* API Functions                                                             */
+/*****************************************************************************/
+
+BEGIN_DECLS
+
+/*---------------------------------------------------------------------------*/
+/** @brief Initialize capture state and enable EXTI on both edges of the pin
+ *
+ * @note The pin should be configured as input, the cycle counter should be
+ * enabled by @ref cycle_counter_enable, the EXTI source selection clock
+ * (SYSCFG or AFIO) should be running, and the EXTI interrupt of the line
+ * should be enabled in NVIC by the caller.
+ *
+ * @param[out] cap capture state of the pin
+ * @param[in] pin pin name (@ref pin_name_base)
+ */
+static void edge_capture_init(struct edge_capture *cap, const uint32_t pin);
+
+/*---------------------------------------------------------------------------*/
+/** @brief Timestamp the edge of the pin
+ *
+ * Must be called from the EXTI interrupt handler of the pin. The function
+ * clears the pending request of the pin EXTI line. When the ring is full, the
+ * edge is dropped and counted as an overrun.
+ *
+ * @note The lowest bit of the timestamp holds the pin level, so the
+ * resolution of the timestamps is 2 cycles.
+ *
+ * @param[inout] cap capture state of the pin
+ * @param[in] pin pin name (@ref pin_name_base)
+ */
+static void edge_capture_isr(struct edge_capture *cap, const uint32_t pin);
+
+/*---------------------------------------------------------------------------*/
+/** @brief Process the captured edges and publish the new results
+ *
+ * Should be called periodically from one background context, at least once
+ * per EDGE_RING_SIZE edges.
+ *
+ * @param[inout] cap capture state of the pin
+ */
+static void edge_capture_process(struct edge_capture *cap);
+
+/*---------------------------------------------------------------------------*/
+/** @brief Read the actual results
+ *
+ * The function can be called from any context, including the interrupt
+ * handlers of higher priority than the reducer.
+ *
+ * @param[in] cap capture state of the pin
+ * @param[out] res consistent snapshot of the results
+ * @returns true, if at least one full period has been measured
+ */
+static bool edge_capture_get(const struct edge_capture *cap,
+			     struct edge_result *res);
+
+/*---------------------------------------------------------------------------*/
+/** @brief Compute frequency from the averaged period
+ *
+ * @param[in] res measured results
+ * @param[in] cpufreq Current CPU frequency in Hz
+ * @returns frequency in mHz, or 0 if not measured yet
+ */
+static uint32_t edge_frequency_mhz(const struct edge_result *res,
+				   uint64_t cpufreq);
+
+/*---------------------------------------------------------------------------*/
+/** @brief Compute duty cycle of the last period
+ *
+ * @param[in] res measured results
+ * @returns duty cycle in 1/1000 units, or 0 if not measured yet
+ */
+static uint32_t edge_duty_permille(const struct edge_result *res);
+
+END_DECLS
+
+/**@}*/
+
+/*****************************************************************************/
+/* Architecture dependent implementations                                    */
+/*****************************************************************************/
+
+#define _EDGE_VALID_RISE	(1 << 0)
+#define _EDGE_VALID_PERIOD	(1 << 1)
+
+INLINE void edge_capture_init(struct edge_capture *cap, const uint32_t pin)
+{
+	uint32_t i;
+
+	for (i = 0; i < EDGE_RING_SIZE; i++)
+		cap->ring[i] = 0;
+
+	cap->head = 0;
+	cap->overruns = 0;
+	cap->tail = 0;
+	cap->last_rise = 0;
+	cap->avg_acc = 0;
+	cap->valid = 0;
+	cap->seq = 0;
+
+	for (i = 0; i < 2; i++) {
+		cap->result[i].period = 0;
+		cap->result[i].high = 0;
+		cap->result[i].avg_period = 0;
+		cap->result[i].edges = 0;
+		cap->result[i].last = 0;
+	}
+
+	exti_select_source(_pin_pin(pin), _pin_port(pin));
+	exti_set_trigger(_pin_pin(pin), EXTI_TRIGGER_BOTH);
+	exti_reset_request(_pin_pin(pin));
+	exti_enable_request(_pin_pin(pin));
+}
+
+INLINE void edge_capture_isr(struct edge_capture *cap, const uint32_t pin)
+{
+	const uint32_t ts = cycle_counter_get();
+	const uint32_t head = cap->head;
+
+	EXTI_PR = _pin_pin(pin);
+
+	if (head - cap->tail >= EDGE_RING_SIZE) {
+		cap->overruns++;
+		return;
+	}
+
+	cap->ring[head & (EDGE_RING_SIZE - 1)] = (ts & ~1UL) | pin_get(pin);
+	cap->head = head + 1;
+}
+
+INLINE void edge_capture_process(struct edge_capture *cap)
+{
+	const uint32_t head = cap->head;
+	const uint32_t seq = cap->seq;
+	volatile struct edge_result *res = &cap->result[(seq + 1) & 1];
+	uint32_t tail = cap->tail;
+	uint32_t period = cap->result[seq & 1].period;
+	uint32_t high = cap->result[seq & 1].high;
+	uint32_t edges = cap->result[seq & 1].edges;
+	uint32_t last;
+
+	if (tail == head)
+		return;
+
+	while (tail != head) {
+		const uint32_t entry = cap->ring[tail & (EDGE_RING_SIZE - 1)];
+		const uint32_t ts = entry & ~1UL;
+
+		if (entry & 1) {
+			if (cap->valid & _EDGE_VALID_RISE) {
+				period = cycle_diff(cap->last_rise, ts);
+
+				if (cap->valid & _EDGE_VALID_PERIOD)
+					cap->avg_acc += period -
+						(cap->avg_acc >> EDGE_AVG_SHIFT);
+				else
+					cap->avg_acc = (uint64_t)period <<
+						       EDGE_AVG_SHIFT;
+
+				cap->valid |= _EDGE_VALID_PERIOD;
+			}
+			cap->last_rise = ts;
+			cap->valid |= _EDGE_VALID_RISE;
+		} else if (cap->valid & _EDGE_VALID_RISE) {
+			high = cycle_diff(cap->last_rise, ts);
+		}
+
+		last = ts;
+		edges++;
+		tail++;
+	}
+
+	/* release the ring slots to the interrupt handler */
+	cap->tail = tail;
+
+	/* fill the inactive copy, and then flip to it */
+	res->period = period;
+	res->high = high;
+	res->avg_period = (cap->valid & _EDGE_VALID_PERIOD) ?
+			  (uint32_t)(cap->avg_acc >> EDGE_AVG_SHIFT) : 0;
+	res->edges = edges;
+	res->last = last;
+	cap->seq = seq + 1;
+}
+
+INLINE bool edge_capture_get(const struct edge_capture *cap,
+			     struct edge_result *res)
+{
+	uint32_t seq;
+
+	/* retry only when the reducer has preempted the copy */
+	do {
+		seq = cap->seq;
+		res->period = cap->result[seq & 1].period;
+		res->high = cap->result[seq & 1].high;
+		res->avg_period = cap->result[seq & 1].avg_period;
+		res->edges = cap->result[seq & 1].edges;
+		res->last = cap->result[seq & 1].last;
+	} while (seq != cap->seq);
+
+	return res->avg_period != 0;
+}
+
+INLINE uint32_t edge_frequency_mhz(const struct edge_result *res,
+				   uint64_t cpufreq)
+{
+	if (res->avg_period == 0)
+		return 0;
+
+	return (uint32_t)(cpufreq * 1000 / res->avg_period);
+}
+
+INLINE uint32_t edge_duty_permille(const struct edge_result *res)
+{
+	if (res->period == 0)
+		return 0;
+
+	return (uint32_t)((uint64_t)res->high * 1000 / res->period);
+}
+
+#endif /* HAL_EDGE_H_INCLUDED */
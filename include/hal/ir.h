@@ -0,0 +1,514 @@
+/*
+ * This file is part of the HAL project, inline library above libopencm3.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/** @defgroup IR_module IR remote module
+ *
+ * @brief Infrared remote control receiver API
+ *
+ * @ingroup modules
+ *
+ * LGPL License Terms @ref lgpl_license
+ *
+ * Decodes NEC (with repeat codes), RC5 and Sony SIRC (12, 15 and 20 bits)
+ * frames from the output of the demodulating IR receiver. The EXTI handler of
+ * the pin calls @ref ir_rx_isr, that passes every edge to @ref ir_rx_edge,
+ * with the @ref cycle_counter_get timestamp. The duration of the previous
+ * mark or space is compared against the windows precomputed in cycles, and
+ * fed to the state machines of all protocols, so the cost per edge is
+ * constant and no division is done.
+ *
+ * The decoded frames are stored to the lock-free queue read by
+ * @ref ir_rx_get. The decoder does not touch the hardware except the cycle
+ * counter difference, so the recorded traces of (timestamp, level) can be
+ * replayed to it on the host, as by tests/ir_host.c.
+ *
+ * The end of the SIRC frame is only known from the space following it, so
+ * @ref ir_rx_idle should be called periodically (e.g. every 1 ms), from the
+ * handler of the same priority as the edge handler.
+ */
+#ifndef HAL_IR_H_INCLUDED
+#define HAL_IR_H_INCLUDED
+
+#include <hal/common.h>
+#include <hal/pin.h>
+#include <hal/cycle.h>
+#include <libopencm3/stm32/exti.h>
+
+/**@{*/
+
+/*****************************************************************************/
+/* API definitions                                                           */
+/*****************************************************************************/
+
+/** Frames of the queue, power of two */
+#ifndef IR_QUEUE_SIZE
+#define IR_QUEUE_SIZE		8
+#endif
+
+#if IR_QUEUE_SIZE & (IR_QUEUE_SIZE - 1)
+# error "hal/ir.h: IR_QUEUE_SIZE must be power of two"
+#endif
+
+enum ir_protocol {
+	IR_NEC = 1,
+	IR_RC5,
+	IR_SIRC,
+};
+
+struct ir_frame {
+	uint8_t protocol;	/* enum ir_protocol */
+	uint8_t repeat;		/* key held, repeat of the previous frame */
+	uint8_t toggle;		/* RC5 toggle bit */
+	uint8_t bits;		/* SIRC frame length */
+	uint16_t address;	/* NEC 8 or 16-bit, RC5 5-bit, SIRC 5/8/13-bit */
+	uint16_t command;	/* NEC 8-bit, RC5 7-bit, SIRC 7-bit */
+};
+
+/* Duration accepted when (dt - lo) <= span */
+struct _ir_window {
+	uint32_t lo;
+	uint32_t span;
+};
+
+struct ir_rx {
+	uint32_t last;		/* timestamp of the last edge */
+	uint8_t mark_level;	/* pin level during the IR burst */
+	uint8_t idle;		/* the line was idle before the edge */
+
+	struct _ir_window nec_lead, nec_start, nec_repeat, nec_bit, nec_one;
+	struct _ir_window rc5_half, rc5_full;
+	struct _ir_window sirc_start, sirc_zero, sirc_one;
+	uint32_t gap;		/* space ending RC5 and SIRC frames */
+	uint32_t hold;		/* max distance of the repeated frames */
+
+	uint8_t nec_state, nec_bits, nec_valid;
+	uint32_t nec_data;
+	uint32_t nec_time;	/* timestamp of the last frame or repeat */
+	struct ir_frame nec_last;
+
+	uint8_t rc5_state, rc5_mid, rc5_bits;
+	uint16_t rc5_data, rc5_last;
+
+	uint8_t sirc_state, sirc_bits;
+	uint32_t sirc_data, sirc_last, sirc_time;
+
+	volatile uint32_t head;	/* written by the decoder only */
+	volatile uint32_t tail;	/* written by the reader only */
+	uint32_t overruns;
+	struct ir_frame queue[IR_QUEUE_SIZE];
+};
+
+/*****************************************************************************/
+/* API Functions                                                             */
+/*****************************************************************************/
+
+BEGIN_DECLS
+
+/*---------------------------------------------------------------------------*/
+/** @brief Initialize the decoder
+ *
+ * The timing windows are +-25% of the nominal durations.
+ *
+ * @param[out] rx decoder
+ * @param[in] cpufreq CPU frequency in Hz
+ * @param[in] mark_level level of the pin during IR burst, false for the
+ * usual receivers with active low output
+ */
+static void ir_rx_init(struct ir_rx *rx, uint32_t cpufreq, bool mark_level);
+
+/*---------------------------------------------------------------------------*/
+/** @brief Enable EXTI on both edges of the receiver pin
+ *
+ * @note The pin should be configured as input, the cycle counter should be
+ * enabled by @ref cycle_counter_enable, the EXTI source selection clock
+ * (SYSCFG or AFIO) should be running, and the EXTI interrupt of the line
+ * should be enabled in NVIC by the caller.
+ *
+ * @param[in] pin pin name (@ref pin_name_base)
+ */
+static void ir_rx_pin_init(const uint32_t pin);
+
+/*---------------------------------------------------------------------------*/
+/** @brief Timestamp and decode the edge of the receiver pin
+ *
+ * Must be called from the EXTI interrupt handler of the pin. The function
+ * clears the pending request of the pin EXTI line.
+ *
+ * @param[inout] rx decoder
+ * @param[in] pin pin name (@ref pin_name_base)
+ */
+static void ir_rx_isr(struct ir_rx *rx, const uint32_t pin);
+
+/*---------------------------------------------------------------------------*/
+/** @brief Process the edge of the receiver output
+ *
+ * Call from the handler of the pin interrupt on both edges.
+ *
+ * @param[inout] rx decoder
+ * @param[in] timestamp @ref cycle_counter_get value at the edge
+ * @param[in] level level of the pin after the edge
+ */
+static void ir_rx_edge(struct ir_rx *rx, uint32_t timestamp, bool level);
+
+/*---------------------------------------------------------------------------*/
+/** @brief Finish the frames ended by the idle line
+ *
+ * Expires the held keys too: the NEC repeat codes coming more than 150 ms
+ * after the last frame or repeat are ignored, and the SIRC frame coming
+ * more than 150 ms after the last one is not a repeat.
+ *
+ * @param[inout] rx decoder
+ * @param[in] now actual @ref cycle_counter_get value
+ */
+static void ir_rx_idle(struct ir_rx *rx, uint32_t now);
+
+/*---------------------------------------------------------------------------*/
+/** @brief Read the decoded frame
+ *
+ * @param[inout] rx decoder
+ * @param[out] frame decoded frame
+ * @returns true when the frame was available
+ */
+static bool ir_rx_get(struct ir_rx *rx, struct ir_frame *frame);
+
+END_DECLS
+
+/**@}*/
+
+/*****************************************************************************/
+/* API implementations                                                       */
+/*****************************************************************************/
+
+enum {
+	_IR_IDLE,
+	_IR_NEC_LEAD_SPACE,
+	_IR_NEC_REPEAT_MARK,
+	_IR_NEC_BIT_MARK,
+	_IR_NEC_BIT_SPACE,
+	_IR_SIRC_BIT_SPACE,
+	_IR_SIRC_BIT_MARK,
+};
+
+INLINE void _ir_window(struct _ir_window *w, uint32_t us, uint32_t cpufreq)
+{
+	const uint32_t nominal = (uint32_t)((uint64_t)us * cpufreq / 1000000);
+
+	w->lo = nominal - nominal / 4;
+	w->span = nominal / 2;
+}
+
+INLINE bool _ir_match(const struct _ir_window *w, uint32_t dt)
+{
+	return dt - w->lo <= w->span;
+}
+
+INLINE void ir_rx_init(struct ir_rx *rx, uint32_t cpufreq, bool mark_level)
+{
+	_ir_window(&rx->nec_lead, 9000, cpufreq);
+	_ir_window(&rx->nec_start, 4500, cpufreq);
+	_ir_window(&rx->nec_repeat, 2250, cpufreq);
+	_ir_window(&rx->nec_bit, 562, cpufreq);
+	_ir_window(&rx->nec_one, 1687, cpufreq);
+	_ir_window(&rx->rc5_half, 889, cpufreq);
+	_ir_window(&rx->rc5_full, 1778, cpufreq);
+	_ir_window(&rx->sirc_start, 2400, cpufreq);
+	_ir_window(&rx->sirc_zero, 600, cpufreq);
+	_ir_window(&rx->sirc_one, 1200, cpufreq);
+	rx->gap = cpufreq / 1000 * 3;		/* 3 ms */
+	rx->hold = cpufreq / 1000 * 150;	/* 150 ms */
+
+	rx->mark_level = mark_level;
+	rx->idle = 1;
+	rx->nec_state = _IR_IDLE;
+	rx->nec_valid = 0;
+	rx->rc5_state = _IR_IDLE;
+	rx->rc5_last = 0xFFFF;
+	rx->sirc_state = _IR_IDLE;
+	rx->sirc_last = 0xFFFFFFFF;
+	rx->head = 0;
+	rx->tail = 0;
+	rx->overruns = 0;
+}
+
+INLINE void _ir_push(struct ir_rx *rx, const struct ir_frame *frame)
+{
+	const uint32_t head = rx->head;
+
+	if (head - rx->tail >= IR_QUEUE_SIZE) {
+		rx->overruns++;
+		return;
+	}
+
+	rx->queue[head & (IR_QUEUE_SIZE - 1)] = *frame;
+	__asm__ __volatile__ ("" : : : "memory");
+	rx->head = head + 1;
+}
+
+/* NEC: 9ms lead, 4.5ms space, 32 bits LSB first, or 2.25ms space repeat */
+INLINE void _ir_nec(struct ir_rx *rx, bool was_mark, uint32_t dt,
+		    uint32_t now)
+{
+	struct ir_frame *f = &rx->nec_last;
+	uint32_t d;
+
+	switch (rx->nec_state) {
+	case _IR_NEC_LEAD_SPACE:
+		if (was_mark)
+			break;
+		if (_ir_match(&rx->nec_start, dt)) {
+			rx->nec_state = _IR_NEC_BIT_MARK;
+			rx->nec_bits = 0;
+			rx->nec_data = 0;
+			return;
+		}
+		if (_ir_match(&rx->nec_repeat, dt)) {
+			rx->nec_state = _IR_NEC_REPEAT_MARK;
+			return;
+		}
+		break;
+
+	case _IR_NEC_REPEAT_MARK:
+		if (!was_mark || !_ir_match(&rx->nec_bit, dt) ||
+		    !rx->nec_valid)
+			break;
+
+		/* the repeats of the key released long ago are not valid */
+		if (cycle_diff(rx->nec_time, now) < rx->hold) {
+			rx->nec_time = now;
+			f->repeat = 1;
+			_ir_push(rx, f);
+		} else {
+			rx->nec_valid = 0;
+		}
+		break;
+
+	case _IR_NEC_BIT_MARK:
+		if (was_mark && _ir_match(&rx->nec_bit, dt)) {
+			rx->nec_state = _IR_NEC_BIT_SPACE;
+			return;
+		}
+		break;
+
+	case _IR_NEC_BIT_SPACE:
+		if (was_mark)
+			break;
+		if (_ir_match(&rx->nec_one, dt))
+			rx->nec_data |= 1UL << rx->nec_bits;
+		else if (!_ir_match(&rx->nec_bit, dt))
+			break;
+
+		if (++rx->nec_bits < 32) {
+			rx->nec_state = _IR_NEC_BIT_MARK;
+			return;
+		}
+
+		d = rx->nec_data;
+		rx->nec_valid = 0;
+		if ((((d >> 16) ^ (d >> 24)) & 0xFF) != 0xFF)
+			break;
+
+		f->protocol = IR_NEC;
+		f->repeat = 0;
+		f->toggle = 0;
+		f->bits = 32;
+		f->command = (d >> 16) & 0xFF;
+		f->address = ((d ^ (d >> 8)) & 0xFF) == 0xFF ? (d & 0xFF) :
+							       (d & 0xFFFF);
+		rx->nec_valid = 1;
+		rx->nec_time = now;
+		_ir_push(rx, f);
+		break;
+
+	default:
+		break;
+	}
+
+	rx->nec_state = (was_mark && _ir_match(&rx->nec_lead, dt)) ?
+			_IR_NEC_LEAD_SPACE : _IR_IDLE;
+}
+
+/* RC5: 14 bi-phase bits of 1.778ms, 1 is space then mark, MSB first */
+INLINE void _ir_rc5(struct ir_rx *rx, bool now_mark, uint32_t dt)
+{
+	struct ir_frame f;
+	uint32_t bit, d;
+
+	if (rx->rc5_state != _IR_IDLE) {
+		if (_ir_match(&rx->rc5_half, dt)) {
+			if (rx->rc5_mid) {
+				rx->rc5_mid = 0;
+				return;
+			}
+		} else if (!_ir_match(&rx->rc5_full, dt) || !rx->rc5_mid) {
+			rx->rc5_state = _IR_IDLE;
+		}
+	}
+
+	if (rx->rc5_state == _IR_IDLE) {
+		/* the first start bit, mark in its middle after idle line */
+		if (now_mark && (rx->idle || dt >= rx->gap)) {
+			rx->rc5_state = !_IR_IDLE;
+			rx->rc5_mid = 1;
+			rx->rc5_bits = 1;
+			rx->rc5_data = 1;
+		}
+		return;
+	}
+
+	bit = now_mark;
+	rx->rc5_mid = 1;
+	rx->rc5_data = (uint16_t)((rx->rc5_data << 1) | bit);
+	if (++rx->rc5_bits < 14)
+		return;
+
+	rx->rc5_state = _IR_IDLE;
+	d = rx->rc5_data;
+
+	f.protocol = IR_RC5;
+	f.toggle = (d >> 11) & 1;
+	f.bits = 14;
+	f.address = (d >> 6) & 0x1F;
+	f.command = (d & 0x3F) | ((~d >> 6) & 0x40);
+	f.repeat = (d == rx->rc5_last);
+	rx->rc5_last = (uint16_t)d;
+	_ir_push(rx, &f);
+}
+
+INLINE void _ir_sirc_end(struct ir_rx *rx, uint32_t now)
+{
+	struct ir_frame f;
+	const uint32_t bits = rx->sirc_bits;
+	const uint32_t code = rx->sirc_data | (bits << 24);
+
+	rx->sirc_state = _IR_IDLE;
+	if (bits != 12 && bits != 15 && bits != 20)
+		return;
+
+	f.protocol = IR_SIRC;
+	f.toggle = 0;
+	f.bits = (uint8_t)bits;
+	f.command = rx->sirc_data & 0x7F;
+	f.address = (uint16_t)(rx->sirc_data >> 7);
+	f.repeat = (code == rx->sirc_last) &&
+		   (cycle_diff(rx->sirc_time, now) < rx->hold);
+	rx->sirc_last = code;
+	rx->sirc_time = now;
+	_ir_push(rx, &f);
+}
+
+/* SIRC: 2.4ms start, 0.6ms spaces, 0.6/1.2ms marks for 0/1, LSB first */
+INLINE void _ir_sirc(struct ir_rx *rx, bool was_mark, uint32_t dt,
+		     uint32_t now)
+{
+	switch (rx->sirc_state) {
+	case _IR_SIRC_BIT_SPACE:
+		if (was_mark)
+			break;
+		if (_ir_match(&rx->sirc_zero, dt) && rx->sirc_bits < 20) {
+			rx->sirc_state = _IR_SIRC_BIT_MARK;
+			return;
+		}
+		if (dt >= rx->gap)
+			_ir_sirc_end(rx, now);
+		break;
+
+	case _IR_SIRC_BIT_MARK:
+		if (!was_mark)
+			break;
+		if (_ir_match(&rx->sirc_one, dt))
+			rx->sirc_data |= 1UL << rx->sirc_bits;
+		else if (!_ir_match(&rx->sirc_zero, dt))
+			break;
+
+		rx->sirc_bits++;
+		rx->sirc_state = _IR_SIRC_BIT_SPACE;
+		return;
+
+	default:
+		break;
+	}
+
+	if (was_mark && _ir_match(&rx->sirc_start, dt)) {
+		rx->sirc_state = _IR_SIRC_BIT_SPACE;
+		rx->sirc_bits = 0;
+		rx->sirc_data = 0;
+	} else {
+		rx->sirc_state = _IR_IDLE;
+	}
+}
+
+INLINE void ir_rx_edge(struct ir_rx *rx, uint32_t timestamp, bool level)
+{
+	const uint32_t dt = cycle_diff(rx->last, timestamp);
+	const bool now_mark = (level == rx->mark_level);
+
+	rx->last = timestamp;
+
+	_ir_nec(rx, !now_mark, dt, timestamp);
+	_ir_rc5(rx, now_mark, dt);
+	_ir_sirc(rx, !now_mark, dt, timestamp);
+
+	rx->idle = 0;
+}
+
+INLINE void ir_rx_pin_init(const uint32_t pin)
+{
+	exti_select_source(_pin_pin(pin), _pin_port(pin));
+	exti_set_trigger(_pin_pin(pin), EXTI_TRIGGER_BOTH);
+	exti_reset_request(_pin_pin(pin));
+	exti_enable_request(_pin_pin(pin));
+}
+
+INLINE void ir_rx_isr(struct ir_rx *rx, const uint32_t pin)
+{
+	const uint32_t ts = cycle_counter_get();
+
+	EXTI_PR = _pin_pin(pin);
+	ir_rx_edge(rx, ts, pin_get(pin));
+}
+
+INLINE void ir_rx_idle(struct ir_rx *rx, uint32_t now)
+{
+	/* expire before the 24-bit counter wraps and aliases the distance */
+	if (rx->nec_valid && cycle_diff(rx->nec_time, now) >= rx->hold)
+		rx->nec_valid = 0;
+	if (rx->sirc_last != 0xFFFFFFFF &&
+	    cycle_diff(rx->sirc_time, now) >= rx->hold)
+		rx->sirc_last = 0xFFFFFFFF;
+
+	if (cycle_diff(rx->last, now) < rx->gap)
+		return;
+
+	if (rx->sirc_state == _IR_SIRC_BIT_SPACE)
+		_ir_sirc_end(rx, now);
+
+	rx->idle = 1;
+}
+
+INLINE bool ir_rx_get(struct ir_rx *rx, struct ir_frame *frame)
+{
+	const uint32_t tail = rx->tail;
+
+	if (tail == rx->head)
+		return false;
+
+	*frame = rx->queue[tail & (IR_QUEUE_SIZE - 1)];
+	__asm__ __volatile__ ("" : : : "memory");
+	rx->tail = tail + 1;
+	return true;
+}
+
+#endif /* HAL_IR_H_INCLUDED */
@@ -0,0 +1,338 @@
+/*
+ * This file is part of the HAL project, inline library above libopencm3.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/** @defgroup KEYPAD_module KEYPAD module
+ *
+ * @brief Key matrix scanner API
+ *
+ * @ingroup modules
+ *
+ * LGPL License Terms @ref lgpl_license
+ *
+ * Scans the matrix of up to 8 columns and 8 rows, the rows on at most two
+ * ports. Every column is driven low by one BSRR store, and all rows are read
+ * by one IDR load per row port, with the pull-ups of the rows reading the
+ * pressed keys low. The columns not scanned drive high (push-pull), or are
+ * released to their pull-ups (open-drain). With push-pull columns, two keys
+ * pressed in one row short the scanned column driving low to the other one
+ * driving high, and the row reads the level of the fight; use open-drain
+ * columns, or the series resistors or diodes on the columns, when more keys
+ * of one row may be pressed at once.
+ *
+ * The keys are debounced in the port bit layout by two-bit vertical
+ * counters, the key changes after 4 equal scans. The matrix without diodes
+ * shows the fourth corner of three pressed keys in a rectangle as pressed;
+ * when any two columns share two or more pressed rows, new presses are
+ * blocked until the ambiguity resolves, releases are still reported. The
+ * presses and releases are queued as events.
+ *
+ * The scan of the column takes about 20 cycles and the settle time, needed
+ * by the row pull-ups to recover from the previous column. It is about 1us
+ * with the internal pull-ups, the external 4k7 pull-ups allow 0.
+ */
+#ifndef HAL_KEYPAD_H_INCLUDED
+#define HAL_KEYPAD_H_INCLUDED
+
+#include <hal/common.h>
+#include <hal/pin.h>
+#include <hal/delay.h>
+
+/**@{*/
+
+/*****************************************************************************/
+/* API definitions                                                           */
+/*****************************************************************************/
+
+/** Events of the queue, power of two */
+#ifndef KEYPAD_QUEUE_SIZE
+#define KEYPAD_QUEUE_SIZE	16
+#endif
+
+#if KEYPAD_QUEUE_SIZE & (KEYPAD_QUEUE_SIZE - 1)
+# error "hal/keypad.h: KEYPAD_QUEUE_SIZE must be power of two"
+#endif
+
+/* Flags of keypad_init */
+#define KEYPAD_OPENDRAIN	0x01	/* columns open-drain with pull-ups */
+
+/** Event of the pressed key, released otherwise */
+#define KEYPAD_PRESS		0x80
+
+/** Key number of the event, column * 8 + row */
+#define KEYPAD_KEY(event)	((event) & 0x3F)
+
+struct _keypad_col {
+	uint32_t port;
+	uint32_t mask;
+};
+
+struct keypad {
+	struct _keypad_col col[8];
+	uint32_t row_port[2];
+	uint32_t row_mask[2];	/* bits 0..15 of the port */
+	uint8_t row_of[32];	/* row of the state bit, rows of port 1 at 16 */
+	uint8_t cols;
+	uint8_t ports;
+	uint8_t ghost;		/* presses blocked */
+	uint32_t settle;	/* delay_loops of the column settle */
+
+	/* per column, bits of the row ports, port 1 in the upper half */
+	uint32_t state[8];	/* debounced */
+	uint32_t cnt0[8];	/* vertical counters */
+	uint32_t cnt1[8];
+	uint32_t report[8];	/* reported by the events */
+
+	volatile uint32_t head;	/* written by the scanner only */
+	volatile uint32_t tail;	/* written by the reader only */
+	uint32_t overruns;
+	uint8_t queue[KEYPAD_QUEUE_SIZE];
+};
+
+/*****************************************************************************/
+/* API Functions                                                             */
+/*****************************************************************************/
+
+BEGIN_DECLS
+
+/*---------------------------------------------------------------------------*/
+/** @brief Configure the pins of the matrix
+ *
+ * The rows are inputs with pull-ups, the columns outputs driven high.
+ *
+ * @param[out] kp keypad
+ * @param[in] cols pin names of the columns (@ref pin_name_base)
+ * @param[in] ncols count of columns, at most 8
+ * @param[in] rows pin names of the rows
+ * @param[in] nrows count of rows, at most 8
+ * @param[in] flags KEYPAD_OPENDRAIN, or 0 for push-pull columns
+ * @param[in] settle_us settle time of the column in microseconds
+ * @param[in] cpufreq CPU frequency in Hz
+ * @returns false when there are more than 8 columns or rows, or when the rows
+ * are on more than two ports
+ */
+static bool keypad_init(struct keypad *kp, const uint32_t *cols,
+			uint32_t ncols, const uint32_t *rows, uint32_t nrows,
+			uint32_t flags, uint32_t settle_us, uint64_t cpufreq);
+
+/*---------------------------------------------------------------------------*/
+/** @brief Scan the matrix, and queue the events of the debounced changes
+ *
+ * Call periodically, e.g. every 1 to 5 ms.
+ *
+ * @param[inout] kp keypad
+ * @returns true when ghosting blocks new presses
+ */
+static bool keypad_scan(struct keypad *kp);
+
+/*---------------------------------------------------------------------------*/
+/** @brief Read the event
+ *
+ * @param[inout] kp keypad
+ * @param[out] event KEYPAD_PRESS or 0, with the key number
+ * @returns true when the event was available
+ */
+static bool keypad_get(struct keypad *kp, uint8_t *event);
+
+/*---------------------------------------------------------------------------*/
+/** @brief Check if the key is pressed, as reported by the events
+ *
+ * @param[in] kp keypad
+ * @param[in] col column
+ * @param[in] row row
+ * @returns true when pressed
+ */
+static bool keypad_pressed(const struct keypad *kp, uint32_t col,
+			   uint32_t row);
+
+END_DECLS
+
+/**@}*/
+
+/*****************************************************************************/
+/* API implementations                                                       */
+/*****************************************************************************/
+
+INLINE bool keypad_init(struct keypad *kp, const uint32_t *cols,
+			uint32_t ncols, const uint32_t *rows, uint32_t nrows,
+			uint32_t flags, uint32_t settle_us, uint64_t cpufreq)
+{
+	uint32_t i, j, port;
+
+	if (ncols > 8 || nrows > 8)
+		return false;
+
+	kp->cols = (uint8_t)ncols;
+	kp->ports = 0;
+	kp->ghost = 0;
+	kp->settle = delay_loops_us(settle_us, cpufreq);
+	kp->row_mask[0] = 0;
+	kp->row_mask[1] = 0;
+	kp->head = 0;
+	kp->tail = 0;
+	kp->overruns = 0;
+
+	for (i = 0; i < 32; i++)
+		kp->row_of[i] = 0xFF;
+
+	for (i = 0; i < nrows; i++) {
+		port = _pin_port(rows[i]);
+		for (j = 0; j < kp->ports; j++)
+			if (kp->row_port[j] == port)
+				break;
+
+		if (j == kp->ports) {
+			if (j == 2)
+				return false;
+			kp->row_port[j] = port;
+			kp->ports++;
+		}
+
+		kp->row_mask[j] |= _pin_pin(rows[i]);
+		kp->row_of[j * 16 + _pin_pinno(rows[i])] = (uint8_t)i;
+
+		pin_clock_enable(rows[i]);
+		pin_input(rows[i]);
+		pin_pull_up(rows[i]);
+	}
+
+	for (i = 0; i < ncols; i++) {
+		kp->col[i].port = _pin_port(cols[i]);
+		kp->col[i].mask = _pin_pin(cols[i]);
+		kp->state[i] = 0;
+		kp->cnt0[i] = 0;
+		kp->cnt1[i] = 0;
+		kp->report[i] = 0;
+
+		pin_clock_enable(cols[i]);
+		pin_set(cols[i], true);
+		if (flags & KEYPAD_OPENDRAIN) {
+			pin_pull_up(cols[i]);
+			pin_output_opendrain(cols[i]);
+		} else {
+			pin_output_pushpull(cols[i]);
+		}
+	}
+
+	return true;
+}
+
+INLINE void _keypad_push(struct keypad *kp, uint8_t event)
+{
+	const uint32_t head = kp->head;
+
+	if (head - kp->tail >= KEYPAD_QUEUE_SIZE) {
+		kp->overruns++;
+		return;
+	}
+
+	kp->queue[head & (KEYPAD_QUEUE_SIZE - 1)] = event;
+	__asm__ __volatile__ ("" : : : "memory");
+	kp->head = head + 1;
+}
+
+/* Pressed rows of the column, in the state bit layout */
+INLINE uint32_t _keypad_read(const struct keypad *kp, uint32_t c)
+{
+	uint32_t raw;
+
+	GPIO_BSRR(kp->col[c].port) = kp->col[c].mask << 16;
+	delay_loops(kp->settle);
+
+	raw = ~GPIO_IDR(kp->row_port[0]) & kp->row_mask[0];
+	if (kp->ports > 1)
+		raw |= (~GPIO_IDR(kp->row_port[1]) & kp->row_mask[1]) << 16;
+
+	GPIO_BSRR(kp->col[c].port) = kp->col[c].mask;
+	return raw;
+}
+
+/* Any two columns sharing two pressed rows hide a ghost key */
+INLINE bool _keypad_ghost(const struct keypad *kp)
+{
+	uint32_t i, j, x;
+
+	for (i = 0; i < kp->cols; i++) {
+		if ((kp->state[i] & (kp->state[i] - 1)) == 0)
+			continue;
+
+		for (j = i + 1; j < kp->cols; j++) {
+			x = kp->state[i] & kp->state[j];
+			if (x & (x - 1))
+				return true;
+		}
+	}
+
+	return false;
+}
+
+INLINE bool keypad_scan(struct keypad *kp)
+{
+	uint32_t c, raw, delta, next, changes, bit;
+
+	/* two-bit vertical counter per key, the state flips at 4 */
+	for (c = 0; c < kp->cols; c++) {
+		raw = _keypad_read(kp, c);
+		delta = raw ^ kp->state[c];
+		kp->cnt1[c] = (kp->cnt1[c] ^ kp->cnt0[c]) & delta;
+		kp->cnt0[c] = ~kp->cnt0[c] & delta;
+		kp->state[c] ^= delta & ~(kp->cnt0[c] | kp->cnt1[c]);
+	}
+
+	kp->ghost = _keypad_ghost(kp);
+
+	for (c = 0; c < kp->cols; c++) {
+		next = kp->ghost ? (kp->report[c] & kp->state[c]) :
+				   kp->state[c];
+		changes = next ^ kp->report[c];
+		kp->report[c] = next;
+
+		while (changes != 0) {
+			bit = __builtin_ctz(changes);
+			changes &= changes - 1;
+			_keypad_push(kp, (uint8_t)((c * 8 + kp->row_of[bit]) |
+				     (((next >> bit) & 1) ? KEYPAD_PRESS : 0)));
+		}
+	}
+
+	return kp->ghost;
+}
+
+INLINE bool keypad_get(struct keypad *kp, uint8_t *event)
+{
+	const uint32_t tail = kp->tail;
+
+	if (tail == kp->head)
+		return false;
+
+	*event = kp->queue[tail & (KEYPAD_QUEUE_SIZE - 1)];
+	__asm__ __volatile__ ("" : : : "memory");
+	kp->tail = tail + 1;
+	return true;
+}
+
+INLINE bool keypad_pressed(const struct keypad *kp, uint32_t col,
+			   uint32_t row)
+{
+	uint32_t bit;
+
+	for (bit = 0; bit < 32; bit++)
+		if (kp->row_of[bit] == row)
+			return (kp->report[col] >> bit) & 1;
+
+	return false;
+}
+
+#endif /* HAL_KEYPAD_H_INCLUDED */
@@ -0,0 +1,334 @@
+/*
+ * This file is part of the HAL project, inline library above libopencm3.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/** @defgroup LEDMATRIX_module LEDMATRIX module
+ *
+ * @brief Multiplexed LED matrix and charlieplexed LED array API
+ *
+ * @ingroup modules
+ *
+ * LGPL License Terms @ref lgpl_license
+ *
+ * The row and column pins must be on one port. The brightness levels drawn
+ * by @ref ledmatrix_draw are compiled to the register images of the slots,
+ * one slot for every row and bit of the level (binary code modulation). The
+ * slot image is the mode register (MODER, or CRL and CRH on STM32F1) value
+ * of the pins, and the BSRR value, so the timer handler applies the slot by
+ * one BSRR store and one read-modify-write per mode register, in
+ * @ref ledmatrix_isr.
+ *
+ * The handler returns the duration of the applied slot in timer ticks, the
+ * unit doubled for every bit, to be loaded to the auto-reload register of
+ * the timer:
+ *
+ * @code
+ * void tim2_isr(void)
+ * {
+ *	TIM_SR(TIM2) = ~TIM_SR_UIF;
+ *	TIM_ARR(TIM2) = ledmatrix_isr(&matrix) - 1;
+ * }
+ * @endcode
+ *
+ * With ARR preloading disabled, the new value applies to the running
+ * period. The refresh rate is timer clock / (unit * rows * (2^bits - 1)),
+ * e.g. 16 rows with 4 bits and 2us unit refresh at 2.08kHz, with
+ * 16 * 4 * 2.08k = 133k interrupts per second of about 30 cycles each.
+ *
+ * The drawn frame goes to the back buffer, and replaces the displayed one at
+ * the start of the next refresh, so no frame is shown torn.
+ *
+ * In the matrix, the active row pin drives the row level (high by default)
+ * and the other rows the opposite one, and the columns of the lit LEDs
+ * drive the opposite level. In the charlieplexed array, the pin of the row
+ * drives high, the pins of the lit LEDs drive low, and the other pins are
+ * inputs; the LED (r, c) has anode on pin r and cathode on pin c.
+ */
+#ifndef HAL_LEDMATRIX_H_INCLUDED
+#define HAL_LEDMATRIX_H_INCLUDED
+
+#include <hal/common.h>
+#include <hal/pin.h>
+
+/**@{*/
+
+/*****************************************************************************/
+/* API definitions                                                           */
+/*****************************************************************************/
+
+/** Max count of rows */
+#ifndef LEDMATRIX_MAX_ROWS
+#define LEDMATRIX_MAX_ROWS	16
+#endif
+
+/** Bits of the brightness level, levels are 0 to 2^LEDMATRIX_BITS - 1 */
+#ifndef LEDMATRIX_BITS
+#define LEDMATRIX_BITS		4
+#endif
+
+#define LEDMATRIX_MAX_LEVEL	((1U << LEDMATRIX_BITS) - 1)
+
+/* Flags of ledmatrix_init */
+#define LEDMATRIX_CHARLIEPLEX	0x01	/* rows are also the columns */
+#define LEDMATRIX_INVERT	0x02	/* active rows low, lit columns high */
+
+#if defined(HAL_PIN_STM32_V0_H_INCLUDED)
+# define _LEDMATRIX_MODE_REGS	2
+#else
+# define _LEDMATRIX_MODE_REGS	1
+#endif
+
+#define _LEDMATRIX_SLOTS	(LEDMATRIX_MAX_ROWS * LEDMATRIX_BITS)
+
+struct _ledmatrix_slot {
+	uint32_t mode[_LEDMATRIX_MODE_REGS];
+	uint32_t bsrr;
+	uint32_t ticks;
+};
+
+struct ledmatrix {
+	uint32_t port;
+	uint32_t mask;		/* all pins */
+	uint32_t row_mask;
+	uint32_t col_mask;
+	uint32_t keep[_LEDMATRIX_MODE_REGS];	/* mode bits of other pins */
+	uint16_t row[LEDMATRIX_MAX_ROWS];	/* pin masks */
+	uint16_t col[16];
+	uint8_t rows;
+	uint8_t cols;
+	uint8_t flags;
+	volatile uint8_t front;	/* displayed buffer */
+	volatile uint8_t pending;	/* back buffer drawn */
+	uint32_t slot;		/* next slot to apply */
+	uint32_t slots;
+	struct _ledmatrix_slot image[2][_LEDMATRIX_SLOTS];
+};
+
+/*****************************************************************************/
+/* API Functions                                                             */
+/*****************************************************************************/
+
+BEGIN_DECLS
+
+/*---------------------------------------------------------------------------*/
+/** @brief Configure the pins, and clear the display
+ *
+ * The clock of the port must be enabled.
+ *
+ * @param[out] m matrix
+ * @param[in] rows pin names of the rows (@ref pin_name_base)
+ * @param[in] nrows count of rows, at most LEDMATRIX_MAX_ROWS
+ * @param[in] cols pin names of the columns, ignored for charlieplexing
+ * @param[in] ncols count of columns, ignored for charlieplexing
+ * @param[in] flags LEDMATRIX_CHARLIEPLEX, LEDMATRIX_INVERT
+ * @param[in] unit ticks of the timer of the slot of bit 0
+ * @returns false when the pins are not on one port, or there are more than
+ * LEDMATRIX_MAX_ROWS rows or 16 columns
+ */
+static bool ledmatrix_init(struct ledmatrix *m, const uint32_t *rows,
+			   uint32_t nrows, const uint32_t *cols,
+			   uint32_t ncols, uint32_t flags, uint32_t unit);
+
+/*---------------------------------------------------------------------------*/
+/** @brief Draw the frame to the back buffer
+ *
+ * The levels of the charlieplexed array have the rows as columns, the
+ * levels on the diagonal are ignored.
+ *
+ * @param[inout] m matrix
+ * @param[in] levels brightness levels of the rows, columns one after another,
+ * 0 to LEDMATRIX_MAX_LEVEL
+ * @returns false when the previous frame was not displayed yet
+ */
+static bool ledmatrix_draw(struct ledmatrix *m, const uint8_t *levels);
+
+/*---------------------------------------------------------------------------*/
+/** @brief Apply the next slot
+ *
+ * Call from the timer update interrupt handler.
+ *
+ * @param[inout] m matrix
+ * @returns ticks until the next call
+ */
+static uint32_t ledmatrix_isr(struct ledmatrix *m);
+
+END_DECLS
+
+/**@}*/
+
+/*****************************************************************************/
+/* API implementations                                                       */
+/*****************************************************************************/
+
+/* Mode register images of the output and input pins */
+INLINE void _ledmatrix_mode(uint32_t *mode, uint32_t out, uint32_t in)
+{
+#if defined(HAL_PIN_STM32_V0_H_INCLUDED)
+	const uint32_t om = GPIO_MODE_OUTPUT_50_MHZ |
+			    (GPIO_CNF_OUTPUT_PUSHPULL << 2);
+	const uint32_t im = GPIO_MODE_INPUT | (GPIO_CNF_INPUT_FLOAT << 2);
+
+	mode[0] = (_pin_mask4(out) / 15) * om | (_pin_mask4(in) / 15) * im;
+	mode[1] = (_pin_mask4(out >> 8) / 15) * om |
+		  (_pin_mask4(in >> 8) / 15) * im;
+#else
+	mode[0] = (_pin_mask2(out) / 3) * GPIO_MODE_OUTPUT |
+		  (_pin_mask2(in) / 3) * GPIO_MODE_INPUT;
+#endif
+}
+
+INLINE void _ledmatrix_apply(const struct ledmatrix *m,
+			     const struct _ledmatrix_slot *s)
+{
+	GPIO_BSRR(m->port) = s->bsrr;
+#if defined(HAL_PIN_STM32_V0_H_INCLUDED)
+	GPIO_CRL(m->port) = (GPIO_CRL(m->port) & m->keep[0]) | s->mode[0];
+	GPIO_CRH(m->port) = (GPIO_CRH(m->port) & m->keep[1]) | s->mode[1];
+#else
+	GPIO_MODER(m->port) = (GPIO_MODER(m->port) & m->keep[0]) | s->mode[0];
+#endif
+}
+
+/* Image of the row r with the pins in the mask on lit */
+INLINE void _ledmatrix_compile(const struct ledmatrix *m, uint32_t r,
+			       uint32_t on, struct _ledmatrix_slot *s)
+{
+	const bool invert = (m->flags & LEDMATRIX_INVERT) != 0;
+	const uint32_t row = m->row[r];
+	uint32_t out, high;
+
+	if (m->flags & LEDMATRIX_CHARLIEPLEX) {
+		on &= ~row;
+		out = row | on;
+		high = invert ? on : row;
+	} else {
+		out = m->mask;
+		high = invert ? ((m->row_mask & ~row) | on) :
+				(row | (m->col_mask & ~on));
+	}
+
+	_ledmatrix_mode(s->mode, out, m->mask & ~out);
+	s->bsrr = high | ((m->mask & ~high) << 16);
+}
+
+INLINE bool ledmatrix_init(struct ledmatrix *m, const uint32_t *rows,
+			   uint32_t nrows, const uint32_t *cols,
+			   uint32_t ncols, uint32_t flags, uint32_t unit)
+{
+	uint32_t i;
+
+	if (flags & LEDMATRIX_CHARLIEPLEX) {
+		cols = rows;
+		ncols = nrows;
+	}
+
+	if (nrows == 0 || nrows > LEDMATRIX_MAX_ROWS || ncols > 16)
+		return false;
+
+	m->port = _pin_port(rows[0]);
+	m->row_mask = 0;
+	m->col_mask = 0;
+	m->rows = (uint8_t)nrows;
+	m->cols = (uint8_t)ncols;
+	m->flags = (uint8_t)flags;
+
+	for (i = 0; i < nrows; i++) {
+		if (_pin_port(rows[i]) != m->port)
+			return false;
+		m->row[i] = (uint16_t)_pin_pin(rows[i]);
+		m->row_mask |= m->row[i];
+	}
+
+	for (i = 0; i < ncols; i++) {
+		if (_pin_port(cols[i]) != m->port)
+			return false;
+		m->col[i] = (uint16_t)_pin_pin(cols[i]);
+		m->col_mask |= m->col[i];
+	}
+
+	m->mask = m->row_mask | m->col_mask;
+#if defined(HAL_PIN_STM32_V0_H_INCLUDED)
+	m->keep[0] = ~_pin_mask4(m->mask);
+	m->keep[1] = ~_pin_mask4(m->mask >> 8);
+#else
+	m->keep[0] = ~_pin_mask2(m->mask);
+#endif
+
+	/* all slots dark in both buffers */
+	m->slots = nrows * LEDMATRIX_BITS;
+	for (i = 0; i < m->slots; i++) {
+		_ledmatrix_compile(m, i / LEDMATRIX_BITS, 0, &m->image[0][i]);
+		m->image[0][i].ticks = unit << (i % LEDMATRIX_BITS);
+		m->image[1][i] = m->image[0][i];
+	}
+
+	m->front = 0;
+	m->pending = 0;
+	m->slot = 0;
+
+#if !defined(HAL_PIN_STM32_V0_H_INCLUDED)
+	_pin_modify(&GPIO_OTYPER(m->port), m->mask, 0);
+#endif
+	_ledmatrix_apply(m, &m->image[0][0]);
+	return true;
+}
+
+INLINE bool ledmatrix_draw(struct ledmatrix *m, const uint8_t *levels)
+{
+	struct _ledmatrix_slot *img;
+	uint32_t r, c, b, on;
+
+	if (m->pending)
+		return false;
+
+	/* the handler swaps front before clearing pending, read it after */
+	__asm__ __volatile__ ("" : : : "memory");
+	img = m->image[m->front ^ 1];
+
+	for (r = 0; r < m->rows; r++) {
+		for (b = 0; b < LEDMATRIX_BITS; b++) {
+			on = 0;
+			for (c = 0; c < m->cols; c++)
+				if (levels[r * m->cols + c] & (1U << b))
+					on |= m->col[c];
+
+			_ledmatrix_compile(m, r, on,
+					   &img[r * LEDMATRIX_BITS + b]);
+		}
+	}
+
+	__asm__ __volatile__ ("" : : : "memory");
+	m->pending = 1;
+	return true;
+}
+
+INLINE uint32_t ledmatrix_isr(struct ledmatrix *m)
+{
+	uint32_t slot = m->slot;
+	const struct _ledmatrix_slot *s;
+
+	if (slot == 0 && m->pending) {
+		m->front ^= 1;
+		m->pending = 0;
+	}
+
+	s = &m->image[m->front][slot];
+	_ledmatrix_apply(m, s);
+
+	m->slot = (slot + 1 < m->slots) ? slot + 1 : 0;
+	return s->ticks;
+}
+
+#endif /* HAL_LEDMATRIX_H_INCLUDED */
@@ -0,0 +1,378 @@
+/*
+ * This file is part of the HAL project, inline library above libopencm3.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/** @defgroup MANCHESTER_module MANCHESTER line code module
+ *
+ * @brief Manchester (bi-phase) encoder and decoder API
+ *
+ * @ingroup modules
+ *
+ * LGPL License Terms @ref lgpl_license
+ *
+ * The code follows IEEE 802.3: the bit 1 is sent as low then high half-bit,
+ * the bit 0 as high then low half-bit, MSB first. The inverted (G.E. Thomas)
+ * code is obtained by swapping the output levels, or by inverting the levels
+ * passed to the decoder.
+ *
+ * The encoder expands every byte by @ref manchester_lut to 16 half-bits, and
+ * those to the BSRR words driving the output pin and optionally its
+ * complement. The words can be written to GPIO_BSRR by timer triggered DMA
+ * from the buffer filled by @ref manchester_encode, or by the cycle timed
+ * loop @ref manchester_send.
+ *
+ * The decoder gets the timestamp and the new level of every edge of the
+ * line, typically from the EXTI handler, recovers the bit clock from the
+ * intervals between the edges, and stores the bytes to the lock-free FIFO
+ * read by the main loop. The frame starts with the first edge after the line
+ * was idle for more than 1.5 bit period; that edge must be in the middle of
+ * the first bit, so the first bit must start with the idle level.
+ *
+ * Every edge costs the interrupt entry and exit and the decoder, about 70
+ * cycles (estimate, not measured), and the line has up to two edges per bit.
+ * 1Mbit/s, i.e. 2M edges per second, would take about 140MHz of the CPU, out
+ * of reach of the EXTI decoding on all families. Keep the bitrate of the EXTI
+ * decoding below about 1/1000 of the CPU frequency (72kbit/s at 72MHz),
+ * higher rates need the timestamps captured by the timer input capture
+ * with DMA, fed to @ref manchester_rx_edge from the buffer in the main loop.
+ *
+ * \includelineno manchester/receiver.c
+ */
+#ifndef HAL_MANCHESTER_H_INCLUDED
+#define HAL_MANCHESTER_H_INCLUDED
+
+#include <hal/common.h>
+#include <hal/cycle.h>
+#include <hal/pin.h>
+
+/**@{*/
+
+/*****************************************************************************/
+/* API definitions                                                           */
+/*****************************************************************************/
+
+/** Unused complementary pin */
+#define MANCHESTER_NO_PIN	0xFFFFFFFFUL
+
+/** Bytes of the receive FIFO, power of two */
+#ifndef MANCHESTER_FIFO_SIZE
+#define MANCHESTER_FIFO_SIZE	64
+#endif
+
+#if MANCHESTER_FIFO_SIZE & (MANCHESTER_FIFO_SIZE - 1)
+# error "hal/manchester.h: MANCHESTER_FIFO_SIZE must be power of two"
+#endif
+
+struct manchester_tx {
+	uint32_t port;
+	uint32_t bsrr[2];	/* words for the low and high half-bit */
+	uint32_t half;		/* cycles per half-bit */
+};
+
+struct manchester_rx {
+	uint32_t half_min;	/* interval limits in cycles */
+	uint32_t half_max;
+	uint32_t full_min;
+	uint32_t full_max;
+	uint32_t last;		/* timestamp of the last edge */
+	uint8_t synced;		/* inside of the frame */
+	uint8_t mid;		/* the last edge was in the middle of the bit */
+	uint8_t skip;		/* leading bits of the frame to drop */
+	uint8_t bits;		/* bits in shift */
+	uint8_t shift;
+	uint8_t start_bits;
+	uint32_t errors;	/* intervals outside of the windows */
+	volatile uint32_t head;	/* written by the decoder only */
+	volatile uint32_t tail;	/* written by the reader only */
+	uint8_t fifo[MANCHESTER_FIFO_SIZE];
+};
+
+/* 2-bit code of the bit i of b, the first half-bit in the upper bit */
+#define _MANCHESTER_BIT(b, i)	((((b) >> (i)) & 1 ? 1U : 2U) << (2 * (i)))
+#define _MANCHESTER_BYTE(b)						\
+	(_MANCHESTER_BIT(b, 0) | _MANCHESTER_BIT(b, 1) |		\
+	 _MANCHESTER_BIT(b, 2) | _MANCHESTER_BIT(b, 3) |		\
+	 _MANCHESTER_BIT(b, 4) | _MANCHESTER_BIT(b, 5) |		\
+	 _MANCHESTER_BIT(b, 6) | _MANCHESTER_BIT(b, 7))
+#define _MANCHESTER_4(b)						\
+	_MANCHESTER_BYTE(b), _MANCHESTER_BYTE((b) + 1),			\
+	_MANCHESTER_BYTE((b) + 2), _MANCHESTER_BYTE((b) + 3)
+#define _MANCHESTER_16(b)						\
+	_MANCHESTER_4(b), _MANCHESTER_4((b) + 4),			\
+	_MANCHESTER_4((b) + 8), _MANCHESTER_4((b) + 12)
+#define _MANCHESTER_64(b)						\
+	_MANCHESTER_16(b), _MANCHESTER_16((b) + 16),			\
+	_MANCHESTER_16((b) + 32), _MANCHESTER_16((b) + 48)
+
+/** Half-bits of every byte, the first one in bit 15, shared by all units */
+__attribute__((weak)) const uint16_t manchester_lut[256] = {
+	_MANCHESTER_64(0), _MANCHESTER_64(64),
+	_MANCHESTER_64(128), _MANCHESTER_64(192)
+};
+
+/*****************************************************************************/
+/* API Functions                                                             */
+/*****************************************************************************/
+
+BEGIN_DECLS
+
+/*---------------------------------------------------------------------------*/
+/** @brief Initialize the encoder
+ *
+ * The pins are configured as push-pull outputs at the low level of the line,
+ * the clock of the port must be enabled.
+ *
+ * @param[out] tx encoder
+ * @param[in] pin pin name of the output (@ref pin_name_base)
+ * @param[in] pin_n pin name of the complementary output on the same port, or
+ * MANCHESTER_NO_PIN
+ * @param[in] bitrate bits per second
+ * @param[in] cpufreq CPU frequency in Hz
+ */
+static void manchester_tx_init(struct manchester_tx *tx, uint32_t pin,
+			       uint32_t pin_n, uint32_t bitrate,
+			       uint32_t cpufreq);
+
+/*---------------------------------------------------------------------------*/
+/** @brief Expand the bytes to the BSRR words
+ *
+ * The buffer is meant to be written to GPIO_BSRR by DMA, triggered at twice
+ * the bitrate.
+ *
+ * @param[in] tx encoder
+ * @param[in] data bytes to encode
+ * @param[in] len count of bytes
+ * @param[out] bsrr 16 * @p len words
+ */
+static void manchester_encode(const struct manchester_tx *tx,
+			      const uint8_t *data, uint32_t len,
+			      uint32_t *bsrr);
+
+/*---------------------------------------------------------------------------*/
+/** @brief Send the bytes by the cycle timed loop
+ *
+ * The half-bits are timed by the @ref CYCLE_module counter, which must be
+ * running. The interrupts should be masked by the caller. The line is left at
+ * the level of the last half-bit.
+ *
+ * @param[in] tx encoder
+ * @param[in] data bytes to send
+ * @param[in] len count of bytes
+ */
+static void manchester_send(const struct manchester_tx *tx,
+			    const uint8_t *data, uint32_t len);
+
+/*---------------------------------------------------------------------------*/
+/** @brief Initialize the decoder
+ *
+ * @param[out] rx decoder
+ * @param[in] bitrate bits per second
+ * @param[in] cpufreq CPU frequency in Hz
+ * @param[in] tolerance accepted deviation of the intervals, in percent of
+ * the half-bit, max 49
+ * @param[in] start_bits leading bits of every frame to drop
+ *
+ * The @ref CYCLE_module counter must be running, it gives the time of the
+ * idle line before the first edge.
+ */
+static void manchester_rx_init(struct manchester_rx *rx, uint32_t bitrate,
+			       uint32_t cpufreq, uint32_t tolerance,
+			       uint32_t start_bits);
+
+/*---------------------------------------------------------------------------*/
+/** @brief Process the edge of the line
+ *
+ * Call from the handler of the pin interrupt on both edges.
+ *
+ * @param[inout] rx decoder
+ * @param[in] timestamp @ref cycle_counter_get value at the edge
+ * @param[in] level level of the line after the edge
+ */
+static void manchester_rx_edge(struct manchester_rx *rx, uint32_t timestamp,
+			       bool level);
+
+/*---------------------------------------------------------------------------*/
+/** @brief Read the decoded byte
+ *
+ * @param[inout] rx decoder
+ * @param[out] byte decoded byte
+ * @returns true when the byte was available
+ */
+static bool manchester_rx_get(struct manchester_rx *rx, uint8_t *byte);
+
+END_DECLS
+
+/**@}*/
+
+/*****************************************************************************/
+/* API implementations                                                       */
+/*****************************************************************************/
+
+INLINE void manchester_tx_init(struct manchester_tx *tx, uint32_t pin,
+			       uint32_t pin_n, uint32_t bitrate,
+			       uint32_t cpufreq)
+{
+	const uint32_t bit = _pin_pin(pin);
+	const uint32_t bit_n = (pin_n != MANCHESTER_NO_PIN) ? _pin_pin(pin_n) : 0;
+
+	tx->port = _pin_port(pin);
+	tx->bsrr[0] = (bit << 16) | bit_n;
+	tx->bsrr[1] = bit | (bit_n << 16);
+	tx->half = cpufreq / bitrate / 2;
+
+	GPIO_BSRR(tx->port) = tx->bsrr[0];
+	pin_output_pushpull(pin);
+	if (pin_n != MANCHESTER_NO_PIN)
+		pin_output_pushpull(pin_n);
+}
+
+INLINE void manchester_encode(const struct manchester_tx *tx,
+			      const uint8_t *data, uint32_t len,
+			      uint32_t *bsrr)
+{
+	uint32_t code, i;
+
+	while (len--) {
+		code = manchester_lut[*data++];
+		for (i = 0; i < 16; i++) {
+			*bsrr++ = tx->bsrr[(code >> 15) & 1];
+			code <<= 1;
+		}
+	}
+}
+
+/* The deadlines are rebased every byte, to fit the 24-bit counters */
+INLINE void manchester_send(const struct manchester_tx *tx,
+			    const uint8_t *data, uint32_t len)
+{
+	volatile uint32_t *bsrr = &GPIO_BSRR(tx->port);
+	uint32_t start = cycle_counter_get();
+	uint32_t code, deadline, i;
+
+	while (len--) {
+		code = manchester_lut[*data++];
+		deadline = 0;
+
+		for (i = 0; i < 16; i++) {
+			while (cycle_diff(start, cycle_counter_get()) < deadline);
+			*bsrr = tx->bsrr[(code >> 15) & 1];
+			code <<= 1;
+			deadline += tx->half;
+		}
+
+		start = (start + deadline) & CYCLE_COUNTER_MASK;
+	}
+
+	while (cycle_diff(start, cycle_counter_get()) < tx->half);
+}
+
+INLINE void manchester_rx_init(struct manchester_rx *rx, uint32_t bitrate,
+			       uint32_t cpufreq, uint32_t tolerance,
+			       uint32_t start_bits)
+{
+	const uint32_t half = cpufreq / bitrate / 2;
+	const uint32_t tol = half * tolerance / 100;
+
+	rx->half_min = half - tol;
+	rx->half_max = half + tol;
+	rx->full_min = 2 * half - tol;
+	rx->full_max = 2 * half + tol;
+	rx->last = cycle_counter_get();
+	rx->start_bits = start_bits;
+	rx->synced = 0;
+	rx->mid = 0;
+	rx->skip = 0;
+	rx->bits = 0;
+	rx->shift = 0;
+	rx->errors = 0;
+	rx->head = 0;
+	rx->tail = 0;
+}
+
+/* The edge in the middle of the bit carries the bit value */
+INLINE void _manchester_rx_bit(struct manchester_rx *rx, bool level)
+{
+	uint32_t head;
+
+	rx->mid = 1;
+
+	if (rx->skip != 0) {
+		rx->skip--;
+		return;
+	}
+
+	rx->shift = (uint8_t)((rx->shift << 1) | level);
+	if (++rx->bits < 8)
+		return;
+
+	rx->bits = 0;
+	head = rx->head;
+	if (head - rx->tail < MANCHESTER_FIFO_SIZE) {
+		rx->fifo[head & (MANCHESTER_FIFO_SIZE - 1)] = rx->shift;
+		__asm__ __volatile__ ("" : : : "memory");
+		rx->head = head + 1;
+	}
+}
+
+INLINE void manchester_rx_edge(struct manchester_rx *rx, uint32_t timestamp,
+			       bool level)
+{
+	const uint32_t dt = cycle_diff(rx->last, timestamp);
+
+	rx->last = timestamp;
+
+	if (rx->synced) {
+		if (dt >= rx->half_min && dt <= rx->half_max) {
+			if (rx->mid)
+				rx->mid = 0;
+			else
+				_manchester_rx_bit(rx, level);
+			return;
+		}
+
+		if (dt >= rx->full_min && dt <= rx->full_max && rx->mid) {
+			_manchester_rx_bit(rx, level);
+			return;
+		}
+
+		/* shorter is noise, longer than full bit ends the frame */
+		if (dt < rx->full_max + rx->half_min)
+			rx->errors++;
+		rx->synced = 0;
+	}
+
+	/* the idle line, the edge is in the middle of the first bit */
+	if (dt >= rx->full_max + rx->half_min) {
+		rx->synced = 1;
+		rx->skip = rx->start_bits;
+		rx->bits = 0;
+		_manchester_rx_bit(rx, level);
+	}
+}
+
+INLINE bool manchester_rx_get(struct manchester_rx *rx, uint8_t *byte)
+{
+	const uint32_t tail = rx->tail;
+
+	if (tail == rx->head)
+		return false;
+
+	*byte = rx->fifo[tail & (MANCHESTER_FIFO_SIZE - 1)];
+	__asm__ __volatile__ ("" : : : "memory");
+	rx->tail = tail + 1;
+	return true;
+}
+
+#endif /* HAL_MANCHESTER_H_INCLUDED */
@@ -0,0 +1,519 @@
+/*
+ * This file is part of the HAL project, inline library above libopencm3.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/** @defgroup ONEWIRE_module ONEWIRE bus master module
+ *
+ * @brief 1-Wire bus master API
+ *
+ * @ingroup modules
+ *
+ * LGPL License Terms @ref lgpl_license
+ *
+ * The bus master drives the open-drain pins with external pull-up resistors.
+ * All slot timings are converted to spin-wait loop counts in the
+ * @ref onewire_init, so no division is done during the transfers.
+ *
+ * One master can drive several independent buses on the pins of the same
+ * port in parallel. All buses share the reset and the time slots, only the
+ * written bit values differ per bus (see @ref onewire_write_multi and
+ * @ref onewire_read_multi). The functions transferring single bits, bytes and
+ * blocks apply the same data to all buses, and read the logical AND of the
+ * buses (wired-AND of the bus itself).
+ *
+ * Example of parallel temperature conversion on several buses:
+ *
+ * \includelineno onewire/ds18b20_multi.c
+ */
+#ifndef HAL_ONEWIRE_H_INCLUDED
+#define HAL_ONEWIRE_H_INCLUDED
+
+#include <hal/common.h>
+#include <hal/pin.h>
+#include <hal/delay.h>
+#include <libopencm3/cm3/cortex.h>
+
+/**@{*/
+
+/*****************************************************************************/
+/* API definitions                                                           */
+/*****************************************************************************/
+
+/** @defgroup onewire_cmd ROM commands
+ *@{*/
+#define ONEWIRE_CMD_SEARCH_ROM		0xF0
+#define ONEWIRE_CMD_READ_ROM		0x33
+#define ONEWIRE_CMD_MATCH_ROM		0x55
+#define ONEWIRE_CMD_SKIP_ROM		0xCC
+#define ONEWIRE_CMD_ALARM_SEARCH	0xEC
+/**@}*/
+
+/** Bus master state, all timings are precomputed loop counts */
+struct onewire {
+	uint32_t port;
+	uint32_t mask;
+
+	uint32_t t_reset;	/* reset pulse low time */
+	uint32_t t_presence;	/* release to presence sample */
+	uint32_t t_reset_end;	/* presence sample to end of reset */
+	uint32_t t_start;	/* slot start low time */
+	uint32_t t_sample;	/* release to sample of read slot */
+	uint32_t t_slot_end;	/* sample to end of slot low time */
+	uint32_t t_recovery;	/* recovery time between slots */
+};
+
+/** State of the ROM search */
+struct onewire_search {
+	uint8_t rom[8];
+	uint8_t last_discrepancy;
+	bool last_device;
+};
+
+/*****************************************************************************/
+/* API Functions                                                             */
+/*****************************************************************************/
+
+BEGIN_DECLS
+
+/*---------------------------------------------------------------------------*/
+/** @brief Initialize the bus master on a single pin
+ *
+ * The pin is released (set high) and switched to the open-drain output mode.
+ *
+ * @param[out] ow bus master state
+ * @param[in] pin pin name (@ref pin_name_base)
+ * @param[in] cpufreq Current CPU frequency in Hz
+ */
+static void onewire_init(struct onewire *ow, const uint32_t pin,
+			 uint64_t cpufreq);
+
+/*---------------------------------------------------------------------------*/
+/** @brief Initialize the bus master on several pins of one port
+ *
+ * Every pin drives one independent bus. All pins must belong to the same port.
+ *
+ * @param[out] ow bus master state
+ * @param[in] pins pin names (@ref pin_name_base)
+ * @param[in] count count of pins
+ * @param[in] cpufreq Current CPU frequency in Hz
+ */
+static void onewire_init_multi(struct onewire *ow, const uint32_t *pins,
+			       uint32_t count, uint64_t cpufreq);
+
+/*---------------------------------------------------------------------------*/
+/** @brief Issue the reset pulse and detect presence of the devices
+ *
+ * @param[in] ow bus master state
+ * @returns port mask of the buses, where the presence pulse was detected
+ */
+static uint32_t onewire_reset(const struct onewire *ow);
+
+/*---------------------------------------------------------------------------*/
+/** @brief Generate one time slot on all buses
+ *
+ * The buses with bit set in @p ones are released early (write 1 or read
+ * slot), the others are held low for the whole slot (write 0 slot).
+ *
+ * @param[in] ow bus master state
+ * @param[in] ones port mask of the buses writing 1
+ * @returns port mask of the buses sampled high
+ */
+static uint32_t onewire_slot(const struct onewire *ow, uint32_t ones);
+
+/*---------------------------------------------------------------------------*/
+/** @brief Write one bit to all buses
+ *
+ * @param[in] ow bus master state
+ * @param[in] bit value to write
+ */
+static void onewire_write_bit(const struct onewire *ow, bool bit);
+
+/*---------------------------------------------------------------------------*/
+/** @brief Read one bit from all buses
+ *
+ * @param[in] ow bus master state
+ * @returns true, if all buses has been read as 1
+ */
+static bool onewire_read_bit(const struct onewire *ow);
+
+/*---------------------------------------------------------------------------*/
+/** @brief Write one byte to all buses, LSB first
+ *
+ * @param[in] ow bus master state
+ * @param[in] data value to write
+ */
+static void onewire_write_byte(const struct onewire *ow, uint8_t data);
+
+/*---------------------------------------------------------------------------*/
+/** @brief Read one byte from all buses, LSB first
+ *
+ * @param[in] ow bus master state
+ * @returns byte read
+ */
+static uint8_t onewire_read_byte(const struct onewire *ow);
+
+/*---------------------------------------------------------------------------*/
+/** @brief Write block of bytes to all buses
+ *
+ * @param[in] ow bus master state
+ * @param[in] data bytes to write
+ * @param[in] len count of bytes
+ */
+static void onewire_write_block(const struct onewire *ow, const uint8_t *data,
+				uint32_t len);
+
+/*---------------------------------------------------------------------------*/
+/** @brief Read block of bytes from all buses
+ *
+ * @param[in] ow bus master state
+ * @param[out] data read bytes
+ * @param[in] len count of bytes
+ */
+static void onewire_read_block(const struct onewire *ow, uint8_t *data,
+			       uint32_t len);
+
+/*---------------------------------------------------------------------------*/
+/** @brief Write different byte to every bus in parallel
+ *
+ * @param[in] ow bus master state
+ * @param[in] data bytes to write, indexed by the pin number of the bus
+ */
+static void onewire_write_multi(const struct onewire *ow,
+				const uint8_t data[16]);
+
+/*---------------------------------------------------------------------------*/
+/** @brief Read one byte from every bus in parallel
+ *
+ * @param[in] ow bus master state
+ * @param[out] data bytes read, indexed by the pin number of the bus. Entries
+ * of the pins not belonging to the master are left untouched.
+ */
+static void onewire_read_multi(const struct onewire *ow, uint8_t data[16]);
+
+/*---------------------------------------------------------------------------*/
+/** @brief Compute the Dallas/Maxim CRC8 of the data
+ *
+ * @param[in] data data to check
+ * @param[in] len count of bytes
+ * @returns CRC8, zero when the data includes the correct CRC byte at the end
+ */
+static uint8_t onewire_crc8(const uint8_t *data, uint32_t len);
+
+/*---------------------------------------------------------------------------*/
+/** @brief Start the ROM search, and find the first device
+ *
+ * @note the search is done on a master with single bus only
+ *
+ * @param[in] ow bus master state
+ * @param[out] search search state, holding the ROM of device found
+ * @returns true, if the device with the valid ROM has been found
+ */
+static bool onewire_search_first(const struct onewire *ow,
+				 struct onewire_search *search);
+
+/*---------------------------------------------------------------------------*/
+/** @brief Continue the ROM search, and find the next device
+ *
+ * @param[in] ow bus master state
+ * @param[inout] search search state, holding the ROM of device found
+ * @returns true, if the next device with the valid ROM has been found
+ */
+static bool onewire_search_next(const struct onewire *ow,
+				struct onewire_search *search);
+
+/*---------------------------------------------------------------------------*/
+/** @brief Reset the bus and select one device by its ROM
+ *
+ * @param[in] ow bus master state
+ * @param[in] rom 8 bytes of the device ROM
+ * @returns true, if any device responded with presence pulse
+ */
+static bool onewire_match_rom(const struct onewire *ow, const uint8_t rom[8]);
+
+/*---------------------------------------------------------------------------*/
+/** @brief Reset the bus and select all devices
+ *
+ * @param[in] ow bus master state
+ * @returns port mask of the buses, where the presence pulse was detected
+ */
+static uint32_t onewire_skip_rom(const struct onewire *ow);
+
+END_DECLS
+
+/**@}*/
+
+/*****************************************************************************/
+/* Architecture dependent implementations                                    */
+/*****************************************************************************/
+
+INLINE void onewire_init_multi(struct onewire *ow, const uint32_t *pins,
+			       uint32_t count, uint64_t cpufreq)
+{
+	uint32_t i;
+
+	ow->port = _pin_port(pins[0]);
+	ow->mask = 0;
+
+	for (i = 0; i < count; i++) {
+		ow->mask |= _pin_pin(pins[i]);
+		pin_set(pins[i], true);
+		pin_output_opendrain(pins[i]);
+	}
+
+	/* standard speed timings */
+	ow->t_reset = delay_loops_us(480, cpufreq);
+	ow->t_presence = delay_loops_us(70, cpufreq);
+	ow->t_reset_end = delay_loops_us(410, cpufreq);
+	ow->t_start = delay_loops_us(6, cpufreq);
+	ow->t_sample = delay_loops_us(9, cpufreq);
+	ow->t_slot_end = delay_loops_us(45, cpufreq);
+	ow->t_recovery = delay_loops_us(10, cpufreq);
+}
+
+INLINE void onewire_init(struct onewire *ow, const uint32_t pin,
+			 uint64_t cpufreq)
+{
+	onewire_init_multi(ow, &pin, 1, cpufreq);
+}
+
+INLINE uint32_t onewire_reset(const struct onewire *ow)
+{
+	uint32_t mask;
+	uint32_t present;
+
+	GPIO_BSRR(ow->port) = ow->mask << 16;
+	delay_loops(ow->t_reset);
+
+	/* the presence pulse window is short, cannot be interrupted */
+	mask = cm_mask_interrupts(1);
+	GPIO_BSRR(ow->port) = ow->mask;
+	delay_loops(ow->t_presence);
+	present = ~GPIO_IDR(ow->port) & ow->mask;
+	cm_mask_interrupts(mask);
+
+	delay_loops(ow->t_reset_end);
+	return present;
+}
+
+INLINE uint32_t onewire_slot(const struct onewire *ow, uint32_t ones)
+{
+	uint32_t mask;
+	uint32_t sample;
+
+	mask = cm_mask_interrupts(1);
+	GPIO_BSRR(ow->port) = ow->mask << 16;
+	delay_loops(ow->t_start);
+	GPIO_BSRR(ow->port) = ones & ow->mask;
+	delay_loops(ow->t_sample);
+	sample = GPIO_IDR(ow->port) & ow->mask;
+	delay_loops(ow->t_slot_end);
+	GPIO_BSRR(ow->port) = ow->mask;
+	cm_mask_interrupts(mask);
+
+	delay_loops(ow->t_recovery);
+	return sample;
+}
+
+INLINE void onewire_write_bit(const struct onewire *ow, bool bit)
+{
+	onewire_slot(ow, bit ? ow->mask : 0);
+}
+
+INLINE bool onewire_read_bit(const struct onewire *ow)
+{
+	return onewire_slot(ow, ow->mask) == ow->mask;
+}
+
+INLINE void onewire_write_byte(const struct onewire *ow, uint8_t data)
+{
+	uint32_t i;
+
+	for (i = 0; i < 8; i++) {
+		onewire_write_bit(ow, data & 1);
+		data >>= 1;
+	}
+}
+
+INLINE uint8_t onewire_read_byte(const struct onewire *ow)
+{
+	uint8_t data = 0;
+	uint32_t i;
+
+	for (i = 0; i < 8; i++) {
+		data >>= 1;
+		if (onewire_read_bit(ow))
+			data |= 0x80;
+	}
+
+	return data;
+}
+
+INLINE void onewire_write_block(const struct onewire *ow, const uint8_t *data,
+				uint32_t len)
+{
+	while (len--)
+		onewire_write_byte(ow, *data++);
+}
+
+INLINE void onewire_read_block(const struct onewire *ow, uint8_t *data,
+			       uint32_t len)
+{
+	while (len--)
+		*data++ = onewire_read_byte(ow);
+}
+
+INLINE void onewire_write_multi(const struct onewire *ow,
+				const uint8_t data[16])
+{
+	uint32_t ones[8] = {0};
+	uint32_t bit;
+	uint32_t n;
+
+	/* transpose before the transfer, to keep the slots tight */
+	for (n = 0; n < 16; n++) {
+		if (!(ow->mask & (1 << n)))
+			continue;
+
+		for (bit = 0; bit < 8; bit++) {
+			if (data[n] & (1 << bit))
+				ones[bit] |= 1 << n;
+		}
+	}
+
+	for (bit = 0; bit < 8; bit++)
+		onewire_slot(ow, ones[bit]);
+}
+
+INLINE void onewire_read_multi(const struct onewire *ow, uint8_t data[16])
+{
+	uint32_t sample[8];
+	uint32_t bit;
+	uint32_t n;
+
+	for (bit = 0; bit < 8; bit++)
+		sample[bit] = onewire_slot(ow, ow->mask);
+
+	for (n = 0; n < 16; n++) {
+		if (!(ow->mask & (1 << n)))
+			continue;
+
+		data[n] = 0;
+		for (bit = 0; bit < 8; bit++) {
+			if (sample[bit] & (1 << n))
+				data[n] |= 1 << bit;
+		}
+	}
+}
+
+INLINE uint8_t onewire_crc8(const uint8_t *data, uint32_t len)
+{
+	uint8_t crc = 0;
+	uint32_t i;
+
+	while (len--) {
+		crc ^= *data++;
+		for (i = 0; i < 8; i++)
+			crc = (crc & 1) ? ((crc >> 1) ^ 0x8C) : (crc >> 1);
+	}
+
+	return crc;
+}
+
+INLINE bool onewire_search_next(const struct onewire *ow,
+				struct onewire_search *search)
+{
+	uint8_t last_zero = 0;
+	uint8_t bitno;
+
+	if (search->last_device)
+		return false;
+
+	if (!onewire_reset(ow)) {
+		search->last_discrepancy = 0;
+		return false;
+	}
+
+	onewire_write_byte(ow, ONEWIRE_CMD_SEARCH_ROM);
+
+	for (bitno = 1; bitno <= 64; bitno++) {
+		uint8_t *byte = &search->rom[(bitno - 1) / 8];
+		const uint8_t mask = 1 << ((bitno - 1) % 8);
+		const bool id = onewire_read_bit(ow);
+		const bool cmp = onewire_read_bit(ow);
+		bool dir;
+
+		if (id && cmp) {
+			/* no device participates in the search */
+			search->last_discrepancy = 0;
+			return false;
+		}
+
+		if (id != cmp) {
+			dir = id;
+		} else {
+			/* discrepancy, both bit values present */
+			if (bitno < search->last_discrepancy)
+				dir = (*byte & mask) != 0;
+			else
+				dir = (bitno == search->last_discrepancy);
+
+			if (!dir)
+				last_zero = bitno;
+		}
+
+		if (dir)
+			*byte |= mask;
+		else
+			*byte &= ~mask;
+
+		onewire_write_bit(ow, dir);
+	}
+
+	search->last_discrepancy = last_zero;
+	search->last_device = (last_zero == 0);
+
+	return onewire_crc8(search->rom, 8) == 0;
+}
+
+INLINE bool onewire_search_first(const struct onewire *ow,
+				 struct onewire_search *search)
+{
+	search->last_discrepancy = 0;
+	search->last_device = false;
+
+	return onewire_search_next(ow, search);
+}
+
+INLINE bool onewire_match_rom(const struct onewire *ow, const uint8_t rom[8])
+{
+	if (!onewire_reset(ow))
+		return false;
+
+	onewire_write_byte(ow, ONEWIRE_CMD_MATCH_ROM);
+	onewire_write_block(ow, rom, 8);
+	return true;
+}
+
+INLINE uint32_t onewire_skip_rom(const struct onewire *ow)
+{
+	const uint32_t present = onewire_reset(ow);
+
+	if (present)
+		onewire_write_byte(ow, ONEWIRE_CMD_SKIP_ROM);
+
+	return present;
+}
+
+#endif /* HAL_ONEWIRE_H_INCLUDED */
@@ -0,0 +1,368 @@
+/*
+ * This file is part of the HAL project, inline library above libopencm3.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/** @defgroup PARALLEL_module PARALLEL capture module
+ *
+ * @brief Externally clocked parallel data capture API
+ *
+ * @ingroup modules
+ *
+ * LGPL License Terms @ref lgpl_license
+ *
+ * Captures up to 16 data bits from consecutive pins of one port, sampled on
+ * the active edge of the pixel clock (PCLK) pin, with optional VSYNC and
+ * HSYNC framing, as produced by camera sensors or parallel ADCs. The edges
+ * are found by polling the IDR register in unrolled loops, the samples are
+ * masked and shifted down to bit 0 and stored directly to the buffer.
+ *
+ * The edge is seen by the poll of the IDR looping in about 7 cycles on
+ * Cortex-M3/M4/M7 and 10 cycles on Cortex-M0/M0+, more with the wait states
+ * of the GPIO bus. Each level of PCLK must last longer than the poll and the
+ * store of the sample, and 2 cycles more for the data read when the PCLK is
+ * not on the data port. The pixel clock must not exceed:
+ *
+ * Family   | SYSCLK  | PCLK max
+ * ---------|---------|---------
+ * STM32F0  | 48MHz   | 1MHz
+ * STM32F1  | 72MHz   | 2MHz
+ * STM32F3  | 72MHz   | 2.5MHz
+ * STM32F4  | 168MHz  | 6MHz
+ * STM32F7  | 216MHz  | 6MHz
+ *
+ * The limits are replayed by tests/parallel_host.c on the register model of
+ * the IDR, timed by the instruction cycles of the loop and the GPIO bus of
+ * the family, and rounded down with a margin; they are not measured on the
+ * hardware. They assume code with zero wait states, and interrupts masked
+ * during the capture of the line; any interrupt served in the middle of the
+ * line loses samples. Check the actual rate by the cycle counter over a line
+ * of known length.
+ *
+ * The polling loops do not time out, only the waits for the frame and line
+ * start do, after @ref parallel_port::timeout polls.
+ */
+#ifndef HAL_PARALLEL_H_INCLUDED
+#define HAL_PARALLEL_H_INCLUDED
+
+#include <hal/common.h>
+#include <hal/pin.h>
+
+/**@{*/
+
+/*****************************************************************************/
+/* API definitions                                                           */
+/*****************************************************************************/
+
+/** Unused VSYNC or HSYNC pin */
+#define PARALLEL_NO_PIN		0xFFFFFFFFUL
+
+/**
+ * Called after every captured line, returns the buffer for the next line,
+ * or NULL to stop the capture. Runs between the lines, the next line is not
+ * captured until it returns, so it must finish within the line blanking.
+ */
+typedef void *(*parallel_line_cb_t)(void *ctx, uint32_t line, void *data);
+
+struct parallel_port {
+	uint32_t data_port;
+	uint32_t data_mask;
+	uint32_t data_shift;
+	uint32_t pclk_port;
+	uint32_t pclk_mask;
+	uint32_t pclk_active;	/* pclk_mask or 0, level after active edge */
+	uint32_t vsync_port;
+	uint32_t vsync_mask;	/* 0 when unused */
+	uint32_t vsync_active;
+	uint32_t hsync_port;
+	uint32_t hsync_mask;	/* 0 when unused */
+	uint32_t hsync_active;
+	uint32_t timeout;	/* polls of the sync waits, 0 for infinite */
+};
+
+/*****************************************************************************/
+/* API Functions                                                             */
+/*****************************************************************************/
+
+BEGIN_DECLS
+
+/*---------------------------------------------------------------------------*/
+/** @brief Configure the data and pixel clock pins
+ *
+ * The pins are configured as inputs, the clocks of the ports must be
+ * enabled.
+ *
+ * @param[out] p capture port
+ * @param[in] data0 pin name of the data bit 0 (@ref pin_name_base)
+ * @param[in] bits count of the data bits on pins following @p data0, 1..16
+ * @param[in] pclk pin name of the pixel clock
+ * @param[in] rising sample on the rising edge of the pixel clock, or falling
+ */
+static void parallel_init(struct parallel_port *p, uint32_t data0,
+			  uint32_t bits, uint32_t pclk, bool rising);
+
+/*---------------------------------------------------------------------------*/
+/** @brief Configure the framing pins
+ *
+ * @param[inout] p capture port
+ * @param[in] vsync pin name of the frame sync, or PARALLEL_NO_PIN
+ * @param[in] vsync_level level of VSYNC starting the frame
+ * @param[in] hsync pin name of the line valid, or PARALLEL_NO_PIN
+ * @param[in] hsync_level level of HSYNC during the line data
+ * @param[in] timeout polls of the sync waits, 0 for infinite
+ */
+static void parallel_sync(struct parallel_port *p, uint32_t vsync,
+			  bool vsync_level, uint32_t hsync, bool hsync_level,
+			  uint32_t timeout);
+
+/*---------------------------------------------------------------------------*/
+/** @brief Capture 8-bit samples
+ *
+ * @param[in] p capture port
+ * @param[out] buf samples
+ * @param[in] count count of samples
+ */
+static void parallel_read8(const struct parallel_port *p, uint8_t *buf,
+			   uint32_t count);
+
+/*---------------------------------------------------------------------------*/
+/** @brief Capture 16-bit samples
+ *
+ * @param[in] p capture port
+ * @param[out] buf samples
+ * @param[in] count count of samples
+ */
+static void parallel_read16(const struct parallel_port *p, uint16_t *buf,
+			    uint32_t count);
+
+/*---------------------------------------------------------------------------*/
+/** @brief Capture the frame of 8-bit samples
+ *
+ * Waits for VSYNC to change to the start level (when used), then captures
+ * the lines. The line starts when HSYNC changes to the line level (when
+ * used), and has @p width samples.
+ *
+ * Without the callback, the lines are stored one after another to @p buf.
+ * With the callback, it gets every line, and returns the buffer for the next
+ * one.
+ *
+ * @param[in] p capture port
+ * @param[out] buf buffer of the first line
+ * @param[in] width samples per line
+ * @param[in] height lines of the frame
+ * @param[in] cb line callback, or NULL
+ * @param[in] ctx context passed to @p cb
+ * @returns count of the lines captured
+ */
+static uint32_t parallel_frame8(const struct parallel_port *p, uint8_t *buf,
+				uint32_t width, uint32_t height,
+				parallel_line_cb_t cb, void *ctx);
+
+/*---------------------------------------------------------------------------*/
+/** @brief Capture the frame of 16-bit samples
+ *
+ * See @ref parallel_frame8.
+ *
+ * @param[in] p capture port
+ * @param[out] buf buffer of the first line
+ * @param[in] width samples per line
+ * @param[in] height lines of the frame
+ * @param[in] cb line callback, or NULL
+ * @param[in] ctx context passed to @p cb
+ * @returns count of the lines captured
+ */
+static uint32_t parallel_frame16(const struct parallel_port *p, uint16_t *buf,
+				 uint32_t width, uint32_t height,
+				 parallel_line_cb_t cb, void *ctx);
+
+END_DECLS
+
+/**@}*/
+
+/*****************************************************************************/
+/* API implementations                                                       */
+/*****************************************************************************/
+
+INLINE void parallel_init(struct parallel_port *p, uint32_t data0,
+			  uint32_t bits, uint32_t pclk, bool rising)
+{
+	uint32_t i;
+
+	p->data_port = _pin_port(data0);
+	p->data_shift = _pin_pinno(data0);
+	p->data_mask = ((1UL << bits) - 1) << p->data_shift;
+	p->pclk_port = _pin_port(pclk);
+	p->pclk_mask = _pin_pin(pclk);
+	p->pclk_active = rising ? p->pclk_mask : 0;
+	p->vsync_mask = 0;
+	p->hsync_mask = 0;
+	p->timeout = 0;
+
+	for (i = 0; i < bits; i++)
+		pin_input(data0 + i);
+
+	pin_input(pclk);
+}
+
+INLINE void parallel_sync(struct parallel_port *p, uint32_t vsync,
+			  bool vsync_level, uint32_t hsync, bool hsync_level,
+			  uint32_t timeout)
+{
+	p->vsync_mask = 0;
+	p->hsync_mask = 0;
+	p->timeout = timeout;
+
+	if (vsync != PARALLEL_NO_PIN) {
+		p->vsync_port = _pin_port(vsync);
+		p->vsync_mask = _pin_pin(vsync);
+		p->vsync_active = vsync_level ? p->vsync_mask : 0;
+		pin_input(vsync);
+	}
+
+	if (hsync != PARALLEL_NO_PIN) {
+		p->hsync_port = _pin_port(hsync);
+		p->hsync_mask = _pin_pin(hsync);
+		p->hsync_active = hsync_level ? p->hsync_mask : 0;
+		pin_input(hsync);
+	}
+}
+
+/* Waits for the active edge of PCLK, returns the IDR value seeing it */
+#define _PARALLEL_EDGE(idr, mask, active, v)				\
+	do {								\
+		while (((v = *(idr)) & (mask)) == (active));		\
+		while (((v = *(idr)) & (mask)) != (active));		\
+	} while (0)
+
+/* Sample from the IDR value that saw the edge, PCLK on the data port */
+#define _PARALLEL_SAMPLE_SAME(dst, v)					\
+	do {								\
+		_PARALLEL_EDGE(pclk, mask, active, v);			\
+		(dst) = ((v) & dmask) >> shift;				\
+	} while (0)
+
+/* Separate read of the data port after the edge */
+#define _PARALLEL_SAMPLE_OTHER(dst, v)					\
+	do {								\
+		_PARALLEL_EDGE(pclk, mask, active, v);			\
+		(dst) = (*data & dmask) >> shift;			\
+	} while (0)
+
+#define _PARALLEL_READ()						\
+	do {								\
+		volatile uint32_t *pclk = &GPIO_IDR(p->pclk_port);	\
+		volatile uint32_t *data = &GPIO_IDR(p->data_port);	\
+		const uint32_t mask = p->pclk_mask;			\
+		const uint32_t active = p->pclk_active;			\
+		const uint32_t dmask = p->data_mask;			\
+		const uint32_t shift = p->data_shift;			\
+		uint32_t v;						\
+									\
+		if (pclk == data) {					\
+			for (; count >= 4; count -= 4, buf += 4) {	\
+				_PARALLEL_SAMPLE_SAME(buf[0], v);	\
+				_PARALLEL_SAMPLE_SAME(buf[1], v);	\
+				_PARALLEL_SAMPLE_SAME(buf[2], v);	\
+				_PARALLEL_SAMPLE_SAME(buf[3], v);	\
+			}						\
+			for (; count != 0; count--, buf++)		\
+				_PARALLEL_SAMPLE_SAME(buf[0], v);	\
+		} else {						\
+			for (; count >= 4; count -= 4, buf += 4) {	\
+				_PARALLEL_SAMPLE_OTHER(buf[0], v);	\
+				_PARALLEL_SAMPLE_OTHER(buf[1], v);	\
+				_PARALLEL_SAMPLE_OTHER(buf[2], v);	\
+				_PARALLEL_SAMPLE_OTHER(buf[3], v);	\
+			}						\
+			for (; count != 0; count--, buf++)		\
+				_PARALLEL_SAMPLE_OTHER(buf[0], v);	\
+		}							\
+	} while (0)
+
+INLINE void parallel_read8(const struct parallel_port *p, uint8_t *buf,
+			   uint32_t count)
+{
+	_PARALLEL_READ();
+}
+
+INLINE void parallel_read16(const struct parallel_port *p, uint16_t *buf,
+			    uint32_t count)
+{
+	_PARALLEL_READ();
+}
+
+/* Waits for the pin to change to the active level, false on timeout */
+INLINE bool _parallel_wait_start(const struct parallel_port *p, uint32_t port,
+				 uint32_t mask, uint32_t active)
+{
+	uint32_t n = p->timeout;
+
+	while ((GPIO_IDR(port) & mask) == active)
+		if (n != 0 && --n == 0)
+			return false;
+
+	n = p->timeout;
+	while ((GPIO_IDR(port) & mask) != active)
+		if (n != 0 && --n == 0)
+			return false;
+
+	return true;
+}
+
+INLINE uint32_t _parallel_frame(const struct parallel_port *p, void *buf,
+				uint32_t width, uint32_t height, uint32_t size,
+				parallel_line_cb_t cb, void *ctx)
+{
+	uint32_t line;
+
+	if (p->vsync_mask != 0 &&
+	    !_parallel_wait_start(p, p->vsync_port, p->vsync_mask,
+				  p->vsync_active))
+		return 0;
+
+	for (line = 0; line < height && buf != NULL; line++) {
+		if (p->hsync_mask != 0 &&
+		    !_parallel_wait_start(p, p->hsync_port, p->hsync_mask,
+					  p->hsync_active))
+			break;
+
+		if (size == 1)
+			parallel_read8(p, (uint8_t *)buf, width);
+		else
+			parallel_read16(p, (uint16_t *)buf, width);
+
+		if (cb != NULL)
+			buf = cb(ctx, line, buf);
+		else
+			buf = (uint8_t *)buf + width * size;
+	}
+
+	return line;
+}
+
+INLINE uint32_t parallel_frame8(const struct parallel_port *p, uint8_t *buf,
+				uint32_t width, uint32_t height,
+				parallel_line_cb_t cb, void *ctx)
+{
+	return _parallel_frame(p, buf, width, height, 1, cb, ctx);
+}
+
+INLINE uint32_t parallel_frame16(const struct parallel_port *p, uint16_t *buf,
+				 uint32_t width, uint32_t height,
+				 parallel_line_cb_t cb, void *ctx)
+{
+	return _parallel_frame(p, buf, width, height, 2, cb, ctx);
+}
+
+#endif /* HAL_PARALLEL_H_INCLUDED */
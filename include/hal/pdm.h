@@ -0,0 +1,293 @@
+/*
+ * This file is part of the HAL project, inline library above libopencm3.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/** @defgroup PDM_module PDM module
+ *
+ * @brief Sigma-delta (PDM) output on the GPIO pin
+ *
+ * @ingroup modules
+ *
+ * LGPL License Terms @ref lgpl_license
+ *
+ * The first or second order sigma-delta modulator converts the signed 16-bit
+ * samples (or the setpoint) to the bitstream, filtered by the RC low-pass
+ * on the pin to the analog value, on the parts without DAC.
+ *
+ * The kernel @ref pdm_modulate runs 32 modulator steps per call and packs
+ * them to one word. Every sample is held for the oversampling ratio of bits,
+ * a multiple of 32. @ref pdm_refill expands the bits to the BSRR values of
+ * the pin, one word per bit, to the half of the circular buffer written to
+ * GPIO_BSRR by the DMA on the timer update. The refill is called from the
+ * half transfer and transfer complete interrupts of the DMA channel:
+ *
+ * @code
+ * void dma1_channel2_3_isr(void)
+ * {
+ *	if (DMA_ISR(DMA1) & DMA_ISR_HTIF(DMA_CHANNEL3)) {
+ *		DMA_IFCR(DMA1) = DMA_IFCR_CHTIF(DMA_CHANNEL3);
+ *		pdm_refill(&pdm, 0);
+ *	}
+ *	if (DMA_ISR(DMA1) & DMA_ISR_TCIF(DMA_CHANNEL3)) {
+ *		DMA_IFCR(DMA1) = DMA_IFCR_CTCIF(DMA_CHANNEL3);
+ *		pdm_refill(&pdm, 1);
+ *	}
+ * }
+ * @endcode
+ *
+ * The samples are queued by @ref pdm_write; when the queue runs empty, the
+ * setpoint of @ref pdm_set is modulated, so it alone gives the analog
+ * level, and the stream returns to it after its last sample.
+ *
+ * The refill costs about 15 (first order) to 20 (second order) cycles per
+ * bit on Cortex-M0, i.e. 500kHz bit rate takes 15 to 20% of the 48MHz
+ * STM32F0. The packed words of @ref pdm_modulate can be sent by the SPI
+ * instead, with 1/32 of the memory and DMA traffic. The DMA must reach the
+ * GPIO port: any channel on STM32F0/F1/L0, DMA2 only on STM32F2/F4/F7.
+ *
+ * The second order modulator shapes more of the noise out of the audio
+ * band. Its integrators are limited, so it stays stable up to full scale,
+ * with the error of the mean up to 0.5% above 90% of full scale.
+ */
+#ifndef HAL_PDM_H_INCLUDED
+#define HAL_PDM_H_INCLUDED
+
+#include <hal/common.h>
+#include <hal/pin.h>
+
+/**@{*/
+
+/*****************************************************************************/
+/* API definitions                                                           */
+/*****************************************************************************/
+
+/** Samples of the queue, power of two */
+#ifndef PDM_QUEUE_SIZE
+#define PDM_QUEUE_SIZE		64
+#endif
+
+#if PDM_QUEUE_SIZE & (PDM_QUEUE_SIZE - 1)
+# error "hal/pdm.h: PDM_QUEUE_SIZE must be power of two"
+#endif
+
+/* Feedback of the modulator, the full scale of the samples */
+#define _PDM_FULL		32768
+
+/* Limits of the second order integrators */
+#define _PDM_I1_MAX		(2 * _PDM_FULL)
+#define _PDM_I2_MAX		(8 * _PDM_FULL)
+
+struct pdm {
+	uint32_t mask;		/* pin mask, BSRR value of the high level */
+	uint32_t *buf;		/* BSRR values, two halves */
+	uint32_t half;		/* words of the half, multiple of 32 */
+	uint32_t osr;		/* words of 32 bits per sample */
+	uint32_t left;		/* words left of the held sample */
+	uint8_t order;
+	int32_t i1;		/* integrators */
+	int32_t i2;
+	int32_t hold;		/* sample being modulated */
+	volatile int32_t setpoint;	/* sample when the queue is empty */
+
+	volatile uint32_t head;	/* written by the writer only */
+	volatile uint32_t tail;	/* written by the refill only */
+	int16_t queue[PDM_QUEUE_SIZE];
+};
+
+/*****************************************************************************/
+/* API Functions                                                             */
+/*****************************************************************************/
+
+BEGIN_DECLS
+
+/*---------------------------------------------------------------------------*/
+/** @brief Configure the pin, and fill the buffer with the zero level
+ *
+ * The clock of the port must be enabled.
+ *
+ * @param[out] p modulator
+ * @param[in] pin pin name (@ref pin_name_base)
+ * @param[in] order 1 or 2
+ * @param[in] osr bits per sample, multiple of 32
+ * @param[out] buf BSRR values streamed by the DMA
+ * @param[in] words words of the buffer, multiple of 64
+ */
+static void pdm_init(struct pdm *p, uint32_t pin, uint32_t order,
+		     uint32_t osr, uint32_t *buf, uint32_t words);
+
+/*---------------------------------------------------------------------------*/
+/** @brief Modulate 32 bits of the sample
+ *
+ * @param[inout] p modulator
+ * @param[in] x sample, -32768 to 32767
+ * @returns bits, the first in bit 0
+ */
+static uint32_t pdm_modulate(struct pdm *p, int32_t x);
+
+/*---------------------------------------------------------------------------*/
+/** @brief Refill the half of the buffer already streamed
+ *
+ * Call from the DMA half transfer (half 0) and transfer complete (half 1)
+ * interrupts.
+ *
+ * @param[inout] p modulator
+ * @param[in] half 0 or 1
+ */
+static void pdm_refill(struct pdm *p, uint32_t half);
+
+/*---------------------------------------------------------------------------*/
+/** @brief Queue the samples
+ *
+ * @param[inout] p modulator
+ * @param[in] samples samples
+ * @param[in] count count of samples
+ * @returns count of samples queued, less when the queue is full
+ */
+static uint32_t pdm_write(struct pdm *p, const int16_t *samples,
+			  uint32_t count);
+
+/*---------------------------------------------------------------------------*/
+/** @brief Set the sample modulated when the queue is empty
+ *
+ * The queued samples go first, the setpoint follows them, and is zero after
+ * @ref pdm_init.
+ *
+ * @param[inout] p modulator
+ * @param[in] x sample, -32768 to 32767
+ */
+static void pdm_set(struct pdm *p, int16_t x);
+
+END_DECLS
+
+/**@}*/
+
+/*****************************************************************************/
+/* API implementations                                                       */
+/*****************************************************************************/
+
+INLINE void pdm_init(struct pdm *p, uint32_t pin, uint32_t order,
+		     uint32_t osr, uint32_t *buf, uint32_t words)
+{
+	uint32_t i;
+
+	p->mask = _pin_pin(pin);
+	p->buf = buf;
+	p->half = words / 2;
+	p->osr = osr / 32;
+	p->left = 0;
+	p->order = (uint8_t)order;
+	p->i1 = 0;
+	p->i2 = 0;
+	p->hold = 0;
+	p->setpoint = 0;
+	p->head = 0;
+	p->tail = 0;
+
+	/* 50% duty, the zero level */
+	for (i = 0; i < words; i++)
+		buf[i] = (i & 1) ? p->mask : (p->mask << 16);
+
+	pin_set(pin, false);
+	pin_output_pushpull(pin);
+	pin_speed_fast(pin);
+}
+
+INLINE uint32_t pdm_modulate(struct pdm *p, int32_t x)
+{
+	int32_t i1 = p->i1, i2 = p->i2, fb;
+	uint32_t i, bits = 0;
+
+	if (p->order == 1) {
+		for (i = 0; i < 32; i++) {
+			fb = (i1 >= 0) ? _PDM_FULL : -_PDM_FULL;
+			bits |= (uint32_t)(i1 >= 0) << i;
+			i1 += x - fb;
+		}
+	} else {
+		for (i = 0; i < 32; i++) {
+			fb = (i2 >= 0) ? _PDM_FULL : -_PDM_FULL;
+			bits |= (uint32_t)(i2 >= 0) << i;
+			i1 += x - fb;
+			i2 += i1 - fb;
+
+			/* the limits keep the loop stable up to full scale */
+			if (i1 > _PDM_I1_MAX)
+				i1 = _PDM_I1_MAX;
+			else if (i1 < -_PDM_I1_MAX)
+				i1 = -_PDM_I1_MAX;
+			if (i2 > _PDM_I2_MAX)
+				i2 = _PDM_I2_MAX;
+			else if (i2 < -_PDM_I2_MAX)
+				i2 = -_PDM_I2_MAX;
+		}
+	}
+
+	p->i1 = i1;
+	p->i2 = i2;
+	return bits;
+}
+
+INLINE void pdm_refill(struct pdm *p, uint32_t half)
+{
+	uint32_t *dst = &p->buf[half * p->half];
+	uint32_t *end = dst + p->half;
+	const uint32_t reset = p->mask << 16;
+	uint32_t bits, i, tail;
+
+	while (dst < end) {
+		if (p->left == 0) {
+			tail = p->tail;
+			if (tail != p->head) {
+				p->hold = p->queue[tail & (PDM_QUEUE_SIZE - 1)];
+				__asm__ __volatile__ ("" : : : "memory");
+				p->tail = tail + 1;
+			} else {
+				p->hold = p->setpoint;
+			}
+			p->left = p->osr;
+		}
+		p->left--;
+
+		bits = pdm_modulate(p, p->hold);
+		for (i = 0; i < 32; i++) {
+			*dst++ = reset >> ((bits & 1) << 4);
+			bits >>= 1;
+		}
+	}
+}
+
+INLINE uint32_t pdm_write(struct pdm *p, const int16_t *samples,
+			  uint32_t count)
+{
+	uint32_t head = p->head, n;
+
+	for (n = 0; n < count; n++) {
+		if (head - p->tail >= PDM_QUEUE_SIZE)
+			break;
+		p->queue[head & (PDM_QUEUE_SIZE - 1)] = samples[n];
+		head++;
+	}
+
+	__asm__ __volatile__ ("" : : : "memory");
+	p->head = head;
+	return n;
+}
+
+INLINE void pdm_set(struct pdm *p, int16_t x)
+{
+	p->setpoint = x;
+}
+
+#endif /* HAL_PDM_H_INCLUDED */
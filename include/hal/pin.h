@@ -22,6 +22,11 @@
  *
  * LGPL License Terms @ref lgpl_license
  *
+ * The configuration functions do read-modify-write of the registers shared
+ * by all pins of the port. When the pins of the same port are reconfigured
+ * from the interrupt handlers, define HAL_PIN_ATOMIC to make these updates
+ * atomic (see @ref ATOMIC_module).
+ *
  * Basic example of usage:
  *
  * \includelineno pin/blink_basic.c
@@ -45,6 +50,12 @@
 /* API definitions                                                           */
 /*****************************************************************************/
 
+/** Snapshot of all ports, defined by the architecture */
+struct pin_snapshot;
+
+/** Early boot configuration of one port, defined by the architecture */
+struct pin_boot_port;
+
 /*****************************************************************************/
 /* API Functions                                                             */
 /*****************************************************************************/
@@ -70,6 +81,27 @@ BEGIN_DECLS
  * @param[in] pin pin name (@ref pin_name_base)
  */
 static void pin_clock_enable(const uint32_t pin);
+
+/*---------------------------------------------------------------------------*/
+/** @brief Enable peripheral clocks for ports occupying specified pins
+ *
+ * The clock enable bits of all ports are merged, and written to the RCC
+ * by one read-modify-write.
+ *
+ * @param[in] pins pin names (@ref pin_name_base), or port base addresses
+ * @param[in] count count of pins
+ */
+static void pin_clock_enable_multi(const uint32_t *pins, uint32_t count);
+
+/*---------------------------------------------------------------------------*/
+/** @brief Forget the cached state of the port clocks
+ *
+ * When HAL_PIN_CLOCK_CACHE is defined, the clock enable functions remember
+ * the enabled ports in RAM, and skip the RCC access for the ports already
+ * enabled. This function must be called, when the port clocks are disabled
+ * or reset outside of this API.
+ */
+static void pin_clock_cache_invalidate(void);
 /**@}*/
 
 /*---------------------------------------------------------------------------*/
@@ -296,6 +328,89 @@ static void pin_speed_high(const uint32_t pin);
 static void pin_af_map(const uint32_t pin, const uint32_t af);
 /**@}*/
 
+/*---------------------------------------------------------------------------*/
+/*---------------------------------------------------------------------------*/
+/**
+ * @defgroup PIN_api_port PIN Port snapshot API
+ * @ingroup PIN_module
+ *
+ * @brief Whole port configuration manipulation
+ *
+ * The snapshot (struct pin_snapshot) holds the configuration and the output
+ * state of all ports present on the chip.
+ *
+ *@{*/
+
+/*---------------------------------------------------------------------------*/
+/** @brief Save configuration and output state of all ports
+ *
+ * @note clocks of all ports should be enabled.
+ *
+ * @param[out] snap snapshot of all ports
+ */
+static void pin_snapshot_save(struct pin_snapshot *snap);
+
+/*---------------------------------------------------------------------------*/
+/** @brief Restore configuration and output state of all ports
+ *
+ * Every register is written by one store. The output levels are restored
+ * before the pin modes, so the outputs start with the saved levels.
+ *
+ * @note clocks of all ports should be enabled.
+ *
+ * @param[in] snap snapshot of all ports
+ */
+static void pin_snapshot_restore(const struct pin_snapshot *snap);
+
+/*---------------------------------------------------------------------------*/
+/** @brief Switch all pins to analog mode, except the specified ones
+ *
+ * The pullups and pulldowns of the parked pins are disabled, to reach lowest
+ * leakage in low power modes. Every port is reconfigured in one pass.
+ *
+ * @warning the debug pins (SWD/JTAG) should be included in the @p keep list,
+ * when the debugger connection needs to survive.
+ *
+ * @note clocks of all ports should be enabled.
+ *
+ * @param[in] keep pin names (@ref pin_name_base) to be left untouched
+ * @param[in] count count of pins in @p keep
+ */
+static void pin_park_analog(const uint32_t *keep, uint32_t count);
+/**@}*/
+
+/*---------------------------------------------------------------------------*/
+/*---------------------------------------------------------------------------*/
+/**
+ * @defgroup PIN_api_boot PIN Early boot API
+ * @ingroup PIN_module
+ *
+ * @brief Port configuration applied before the C runtime startup
+ *
+ * The const table of struct pin_boot_port is placed in flash, and applied
+ * from the reset handler (see @ref BOOT_module) before .data and .bss are
+ * initialized, so the outputs reach the safe state within microseconds after
+ * reset.
+ *
+ * Every entry holds the mask of the pins to configure, and the register
+ * images of them, built by the PIN_BOOT_* macros of the architecture. The
+ * other pins of the port are left untouched.
+ *
+ *@{*/
+
+/*---------------------------------------------------------------------------*/
+/** @brief Apply the early boot table
+ *
+ * Enables the clocks of all ports in the table by one store, then writes the
+ * output levels before the pin modes of every port. Uses no RAM except the
+ * stack, and no interrupts.
+ *
+ * @param[in] table port configurations
+ * @param[in] count count of entries in @p table
+ */
+static void pin_boot_apply(const struct pin_boot_port *table, uint32_t count);
+/**@}*/
+
 END_DECLS
 
 /*****************************************************************************/
@@ -0,0 +1,412 @@
+/*
+ * This file is part of the HAL project, inline library above libopencm3.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/** @defgroup PIN_cpp_module PIN C++ template module
+ *
+ * @brief PIN manipulation API for C++17
+ *
+ * @ingroup modules
+ *
+ * LGPL License Terms @ref lgpl_license
+ *
+ * The pins are carried in the types, so port addresses and masks are
+ * compile-time constants even when the objects are passed through the
+ * structures, function pointers, or compiled with -O0. The pins of the
+ * @ref hal::PinGroup are merged per port at compile time, so every operation
+ * accesses each port only once.
+ *
+ * Example of usage:
+ *
+ * \includelineno pin/blink_cpp.cpp
+ */
+#ifndef HAL_PIN_HPP_INCLUDED
+#define HAL_PIN_HPP_INCLUDED
+
+#include <hal/pin.h>
+#include <utility>
+
+/**@{*/
+
+namespace hal {
+
+/** Pin configuration modes */
+enum class Mode {
+	Input,			/**< GPIO input, see @ref pin_input */
+	Output,			/**< GPIO push-pull output */
+	OutputOpenDrain,	/**< GPIO open-drain output */
+	Af,			/**< AuxFn push-pull output */
+	AfOpenDrain,		/**< AuxFn open-drain output */
+	Analog,			/**< Analog mode */
+};
+
+/** Pin pull resistor modes */
+enum class Pull {
+	None,
+	Up,
+	Down,
+};
+
+/*****************************************************************************/
+/* Compile-time helpers                                                      */
+/*****************************************************************************/
+
+namespace detail {
+
+#define _HAL_PIN8_CASE(name, port, index)	case index: return port;
+
+constexpr uint32_t port_of(uint32_t pin)
+{
+	if (pin >= 0x100)
+		return pin & ~15u;
+
+	switch (pin >> 4) {
+	_PIN_PORTS(_HAL_PIN8_CASE)
+	default: return 0;
+	}
+}
+
+#undef _HAL_PIN8_CASE
+
+constexpr uint32_t pinno_of(uint32_t pin)
+{
+	return pin & 15u;
+}
+
+constexpr uint32_t mask_of(uint32_t pin)
+{
+	return 1u << (pin & 15u);
+}
+
+template <uint32_t... Pins>
+struct list {
+	static constexpr uint32_t pins[] = { Pins... };
+	static constexpr size_t count = sizeof...(Pins);
+
+	/* the pin is the first of its port in the list */
+	static constexpr bool first(size_t i)
+	{
+		for (size_t j = 0; j < i; j++) {
+			if (port_of(pins[j]) == port_of(pins[i]))
+				return false;
+		}
+		return true;
+	}
+
+	/* merged mask of all pins of the port */
+	static constexpr uint32_t port_mask(uint32_t port)
+	{
+		uint32_t mask = 0;
+
+		for (size_t j = 0; j < count; j++) {
+			if (port_of(pins[j]) == port)
+				mask |= mask_of(pins[j]);
+		}
+		return mask;
+	}
+
+	static constexpr bool unique()
+	{
+		for (size_t i = 0; i < count; i++) {
+			for (size_t j = i + 1; j < count; j++) {
+				if (port_of(pins[i]) == port_of(pins[j]) &&
+				    pinno_of(pins[i]) == pinno_of(pins[j]))
+					return false;
+			}
+		}
+		return true;
+	}
+
+	static constexpr bool valid()
+	{
+		for (size_t i = 0; i < count; i++) {
+			if (port_of(pins[i]) == 0)
+				return false;
+		}
+		return true;
+	}
+};
+
+/* Architecture dependent register images of whole port */
+template <uint32_t Port, uint32_t Mask>
+struct port {
+	static void set()
+	{
+		GPIO_BSRR(Port) = Mask;
+	}
+
+	static void clear()
+	{
+		GPIO_BSRR(Port) = Mask << 16;
+	}
+
+	static void write(const uint32_t bits)
+	{
+		GPIO_BSRR(Port) = (bits & Mask) | ((~bits & Mask) << 16);
+	}
+
+#if defined(HAL_PIN_STM32_V0_H_INCLUDED)
+	template <Mode M>
+	static void configure()
+	{
+		constexpr uint32_t mode =
+			(M == Mode::Input) ? (GPIO_MODE_INPUT | (GPIO_CNF_INPUT_FLOAT << 2)) :
+			(M == Mode::Output) ? (GPIO_MODE_OUTPUT_50_MHZ | (GPIO_CNF_OUTPUT_PUSHPULL << 2)) :
+			(M == Mode::OutputOpenDrain) ? (GPIO_MODE_OUTPUT_50_MHZ | (GPIO_CNF_OUTPUT_OPENDRAIN << 2)) :
+			(M == Mode::Af) ? (GPIO_MODE_OUTPUT_50_MHZ | (GPIO_CNF_OUTPUT_ALTFN_PUSHPULL << 2)) :
+			(M == Mode::AfOpenDrain) ? (GPIO_MODE_OUTPUT_50_MHZ | (GPIO_CNF_OUTPUT_ALTFN_OPENDRAIN << 2)) :
+			(GPIO_MODE_INPUT | (GPIO_CNF_INPUT_ANALOG << 2));
+
+		_pin_port_setmode(Port, Mask, mode);
+	}
+
+	/* valid only when pin is input, as in the C API */
+	template <Pull P>
+	static void pull()
+	{
+		if constexpr (P == Pull::None) {
+			_pin_port_setmode(Port, Mask, GPIO_MODE_INPUT | (GPIO_CNF_INPUT_FLOAT << 2));
+		} else {
+			GPIO_BSRR(Port) = (P == Pull::Up) ? Mask : (Mask << 16);
+			_pin_port_setmode(Port, Mask, GPIO_MODE_INPUT | (GPIO_CNF_INPUT_PULL_UPDOWN << 2));
+		}
+	}
+#else
+	template <Mode M>
+	static void configure()
+	{
+		constexpr uint32_t mode =
+			(M == Mode::Input) ? GPIO_MODE_INPUT :
+			(M == Mode::Output || M == Mode::OutputOpenDrain) ? GPIO_MODE_OUTPUT :
+			(M == Mode::Af || M == Mode::AfOpenDrain) ? GPIO_MODE_AF :
+			GPIO_MODE_ANALOG;
+
+		if constexpr (M == Mode::Output || M == Mode::Af)
+			_pin_modify(&GPIO_OTYPER(Port), Mask, 0);
+		else if constexpr (M == Mode::OutputOpenDrain || M == Mode::AfOpenDrain)
+			_pin_modify(&GPIO_OTYPER(Port), 0, Mask);
+		else if constexpr (M == Mode::Analog)
+			_pin_modify(&GPIO_PUPDR(Port), _pin_mask2(Mask), 0);
+
+		_pin_port_setmode(Port, Mask, mode);
+	}
+
+	template <Pull P>
+	static void pull()
+	{
+		constexpr uint32_t pupd =
+			(P == Pull::Up) ? GPIO_PUPD_PULLUP :
+			(P == Pull::Down) ? GPIO_PUPD_PULLDOWN :
+			GPIO_PUPD_NONE;
+
+		_pin_modify(&GPIO_PUPDR(Port), _pin_mask2(Mask), (_pin_mask2(Mask) / 3) * pupd);
+	}
+#endif
+};
+
+} /* namespace detail */
+
+/*****************************************************************************/
+/* Single pin                                                                */
+/*****************************************************************************/
+
+/** Pin with the port and the mask carried in the type
+ *
+ * @tparam P pin name (@ref pin_name_base) or compact pin (@ref PIN8)
+ */
+template <uint32_t P>
+struct Pin {
+	static_assert(detail::port_of(P) != 0, "pin is not present on this chip");
+
+	static constexpr uint32_t port = detail::port_of(P);
+	static constexpr uint32_t mask = detail::mask_of(P);
+	static constexpr uint32_t number = detail::pinno_of(P);
+
+	/** @brief Set the pin high */
+	static void set()
+	{
+		detail::port<port, mask>::set();
+	}
+
+	/** @brief Set the pin low */
+	static void clear()
+	{
+		detail::port<port, mask>::clear();
+	}
+
+	/** @brief Set the pin state, see @ref pin_set */
+	static void write(const bool val)
+	{
+		GPIO_BSRR(port) = val ? mask : (mask << 16);
+	}
+
+	/** @brief Get the pin state, see @ref pin_get */
+	static bool read()
+	{
+		return (GPIO_IDR(port) & mask) != 0;
+	}
+
+	/** @brief Toggle the pin level state, see @ref pin_toggle */
+	static void toggle()
+	{
+		const uint32_t val = GPIO_ODR(port);
+
+		GPIO_BSRR(port) = ((val & mask) << 16) | (~val & mask);
+	}
+
+	/** @brief Configure the pin mode */
+	template <Mode M>
+	static void configure()
+	{
+		detail::port<port, mask>::template configure<M>();
+	}
+
+	/** @brief Configure the pull resistor of the input */
+	template <Pull U>
+	static void pull()
+	{
+		detail::port<port, mask>::template pull<U>();
+	}
+
+	/** @brief Map the alternate function to the pin, see @ref pin_af_map */
+	template <uint32_t AF>
+	static void af()
+	{
+		static_assert(AF < 16, "invalid alternate function number");
+		pin_af_map(port | number, AF);
+	}
+};
+
+/*****************************************************************************/
+/* Group of pins                                                             */
+/*****************************************************************************/
+
+/** Group of pins, accessing every port by single store
+ *
+ * @tparam Pins pin names (@ref pin_name_base) or compact pins (@ref PIN8)
+ */
+template <uint32_t... Pins>
+class PinGroup {
+	using pins = detail::list<Pins...>;
+	using indices = std::make_index_sequence<sizeof...(Pins)>;
+
+	static_assert(sizeof...(Pins) > 0, "empty pin group");
+	static_assert(sizeof...(Pins) <= 32, "too many pins in group");
+	static_assert(pins::valid(), "pin is not present on this chip");
+	static_assert(pins::unique(), "duplicate pin in group");
+
+	template <size_t I>
+	static constexpr uint32_t port_at = detail::port_of(pins::pins[I]);
+
+	template <size_t I>
+	static constexpr uint32_t pinno_at = detail::pinno_of(pins::pins[I]);
+
+	template <size_t I>
+	static constexpr bool first_at = pins::first(I);
+
+	template <size_t I>
+	using port_ops = detail::port<port_at<I>, pins::port_mask(port_at<I>)>;
+
+	template <size_t... I>
+	static void set_all(std::index_sequence<I...>)
+	{
+		((first_at<I> ? port_ops<I>::set() : void()), ...);
+	}
+
+	template <size_t... I>
+	static void clear_all(std::index_sequence<I...>)
+	{
+		((first_at<I> ? port_ops<I>::clear() : void()), ...);
+	}
+
+	/* pick the bits of the value belonging to the port */
+	template <uint32_t Port, size_t... I>
+	static uint32_t gather(const uint32_t value, std::index_sequence<I...>)
+	{
+		return ((port_at<I> == Port ?
+			 (((value >> I) & 1u) << pinno_at<I>) :
+			 0u) | ... | 0u);
+	}
+
+	template <size_t... I>
+	static void write_all(const uint32_t value, std::index_sequence<I...>)
+	{
+		((first_at<I> ?
+		  port_ops<I>::write(gather<port_at<I>>(value, indices{})) :
+		  void()), ...);
+	}
+
+	template <Mode M, size_t... I>
+	static void configure_all(std::index_sequence<I...>)
+	{
+		((first_at<I> ? port_ops<I>::template configure<M>() : void()), ...);
+	}
+
+	template <Pull U, size_t... I>
+	static void pull_all(std::index_sequence<I...>)
+	{
+		((first_at<I> ? port_ops<I>::template pull<U>() : void()), ...);
+	}
+
+public:
+	/** @brief Set all pins high */
+	static void set()
+	{
+		set_all(indices{});
+	}
+
+	/** @brief Set all pins low */
+	static void clear()
+	{
+		clear_all(indices{});
+	}
+
+	/** @brief Set the state of all pins
+	 *
+	 * @param[in] value bit i is the new state of the i-th pin of the group
+	 */
+	static void write(const uint32_t value)
+	{
+		write_all(value, indices{});
+	}
+
+	/** @brief Configure mode of all pins */
+	template <Mode M>
+	static void configure()
+	{
+		configure_all<M>(indices{});
+	}
+
+	/** @brief Configure the pull resistors of all input pins */
+	template <Pull U>
+	static void pull()
+	{
+		pull_all<U>(indices{});
+	}
+
+	/** @brief Map the same alternate function to all pins */
+	template <uint32_t AF>
+	static void af()
+	{
+		static_assert(AF < 16, "invalid alternate function number");
+		(Pin<Pins>::template af<AF>(), ...);
+	}
+};
+
+} /* namespace hal */
+
+/**@}*/
+
+#endif /* HAL_PIN_HPP_INCLUDED */
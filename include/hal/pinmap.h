@@ -0,0 +1,227 @@
+/*
+ * This file is part of the HAL project, inline library above libopencm3.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/** @defgroup PINMAP_module PINMAP module
+ *
+ * @brief Board variant pin maps selected at runtime
+ *
+ * @ingroup modules
+ *
+ * LGPL License Terms @ref lgpl_license
+ *
+ * One firmware image can serve several board revisions. The pins of every
+ * revision are listed in the const table in flash, one row per variant and
+ * one column per signal. The variant is detected at boot, from the strap
+ * pins by @ref pinmap_detect, or read from OTP or any other source, and its
+ * row is resolved to the RAM table of struct pin_handle by
+ * @ref pinmap_select.
+ *
+ * The handle holds the port base address and the pin mask, loaded together
+ * by one LDRD on Cortex-M3 and above, so @ref pinmap_set is one load and one
+ * store, as fast as @ref pin_set with the pin name known at compile time.
+ * The signals missing on the variant (PINMAP_NONE) resolve to a dummy port
+ * in RAM, so the accesses need no checks and do nothing.
+ *
+ * The handle keeps the pin name too, for the configuration by the pin API.
+ * The pin API does not know PINMAP_NONE, so the configuration of the signals
+ * that can be missing must be skipped when @ref pinmap_present returns false.
+ *
+ * \includelineno pin/blink_variants.c
+ */
+#ifndef HAL_PINMAP_H_INCLUDED
+#define HAL_PINMAP_H_INCLUDED
+
+#include <hal/common.h>
+#include <hal/pin.h>
+#include <hal/delay.h>
+
+/**@{*/
+
+/*****************************************************************************/
+/* API definitions                                                           */
+/*****************************************************************************/
+
+/** Signal not present on the board variant */
+#define PINMAP_NONE		0xFFFFFFFFUL
+
+/** Cycles of the strap pin pull-up settling */
+#ifndef PINMAP_STRAP_SETTLE_CYCLES
+#define PINMAP_STRAP_SETTLE_CYCLES	1000
+#endif
+
+struct pin_handle {
+	uint32_t port;		/* port base address */
+	uint32_t mask;		/* pin mask */
+	uint32_t pin;		/* pin name, or PINMAP_NONE */
+} __attribute__((aligned(8)));
+
+/*****************************************************************************/
+/* API Functions                                                             */
+/*****************************************************************************/
+
+BEGIN_DECLS
+
+/*---------------------------------------------------------------------------*/
+/** @brief Read the board variant from the strap pins
+ *
+ * The pins are read with pull-ups, and left in analog mode afterwards.
+ *
+ * @param[in] straps pin names (@ref pin_name_base) of the straps
+ * @param[in] count count of straps, at most 32
+ * @returns variant, bit i is the level of straps[i]
+ */
+static uint32_t pinmap_detect(const uint32_t *straps, uint32_t count);
+
+/*---------------------------------------------------------------------------*/
+/** @brief Resolve the pin names to the handles
+ *
+ * @param[out] map handles
+ * @param[in] pins pin names (@ref pin_name_base), or PINMAP_NONE
+ * @param[in] count count of pins
+ */
+static void pinmap_resolve(struct pin_handle *map, const uint32_t *pins,
+			   uint32_t count);
+
+/*---------------------------------------------------------------------------*/
+/** @brief Resolve the row of the variant table to the handles
+ *
+ * @param[out] map handles, one per signal
+ * @param[in] table pin names, signals of the variants one after another
+ * @param[in] signals count of signals
+ * @param[in] variants count of variants
+ * @param[in] variant variant to select
+ * @returns false when the variant is not in the table, the map is unchanged
+ */
+static bool pinmap_select(struct pin_handle *map, const uint32_t *table,
+			  uint32_t signals, uint32_t variants,
+			  uint32_t variant);
+
+/*---------------------------------------------------------------------------*/
+/** @brief Check if the signal is present on the variant
+ *
+ * The pin name of the missing signal must not be passed to the pin API.
+ *
+ * @param[in] h pin handle
+ * @returns true when present
+ */
+static bool pinmap_present(const struct pin_handle *h);
+
+/*---------------------------------------------------------------------------*/
+/** @brief Get the actual pin state
+ *
+ * @param[in] h pin handle
+ * @returns true, if pin is held high, false otherwise
+ */
+static bool pinmap_get(const struct pin_handle *h);
+
+/*---------------------------------------------------------------------------*/
+/** @brief Set the pin state
+ *
+ * @param[in] h pin handle
+ * @param[in] val value to set
+ */
+static void pinmap_set(const struct pin_handle *h, bool val);
+
+/*---------------------------------------------------------------------------*/
+/** @brief Toggle the pin level state
+ *
+ * @param[in] h pin handle
+ */
+static void pinmap_toggle(const struct pin_handle *h);
+
+END_DECLS
+
+/**@}*/
+
+/*****************************************************************************/
+/* API implementations                                                       */
+/*****************************************************************************/
+
+/* Registers of the missing pins, the GPIO register offsets fit in */
+__attribute__((weak)) volatile uint32_t _pinmap_dummy[16];
+
+INLINE uint32_t pinmap_detect(const uint32_t *straps, uint32_t count)
+{
+	uint32_t i, variant = 0;
+
+	for (i = 0; i < count; i++) {
+		pin_clock_enable(straps[i]);
+		pin_input(straps[i]);
+		pin_pull_up(straps[i]);
+	}
+
+	delay_cycles(PINMAP_STRAP_SETTLE_CYCLES);
+
+	for (i = 0; i < count; i++) {
+		if (pin_get(straps[i]))
+			variant |= 1UL << i;
+		pin_analog(straps[i]);
+	}
+
+	return variant;
+}
+
+INLINE void pinmap_resolve(struct pin_handle *map, const uint32_t *pins,
+			   uint32_t count)
+{
+	uint32_t i;
+
+	for (i = 0; i < count; i++) {
+		map[i].pin = pins[i];
+		if (pins[i] == PINMAP_NONE) {
+			map[i].port = (uint32_t)(uintptr_t)_pinmap_dummy;
+			map[i].mask = 0;
+		} else {
+			map[i].port = _pin_port(pins[i]);
+			map[i].mask = _pin_pin(pins[i]);
+		}
+	}
+}
+
+INLINE bool pinmap_select(struct pin_handle *map, const uint32_t *table,
+			  uint32_t signals, uint32_t variants,
+			  uint32_t variant)
+{
+	if (variant >= variants)
+		return false;
+
+	pinmap_resolve(map, &table[variant * signals], signals);
+	return true;
+}
+
+INLINE bool pinmap_present(const struct pin_handle *h)
+{
+	return h->pin != PINMAP_NONE;
+}
+
+INLINE bool pinmap_get(const struct pin_handle *h)
+{
+	return (GPIO_IDR(h->port) & h->mask) != 0;
+}
+
+INLINE void pinmap_set(const struct pin_handle *h, bool val)
+{
+	GPIO_BSRR(h->port) = val ? h->mask : (h->mask << 16);
+}
+
+INLINE void pinmap_toggle(const struct pin_handle *h)
+{
+	const uint32_t val = GPIO_ODR(h->port);
+
+	GPIO_BSRR(h->port) = ((val & h->mask) << 16) | (~val & h->mask);
+}
+
+#endif /* HAL_PINMAP_H_INCLUDED */
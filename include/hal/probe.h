@@ -0,0 +1,770 @@
+/*
+ * This file is part of the HAL project, inline library above libopencm3.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/** @defgroup PROBE_module PROBE module
+ *
+ * @brief Bit-banged SWD and JTAG debug probe API
+ *
+ * @ingroup modules
+ *
+ * LGPL License Terms @ref lgpl_license
+ *
+ * Drives the SWD or JTAG port of the target by GPIO. The pins are held in
+ * struct swd_pins or struct jtag_pins, which should be static const, so the
+ * ports and masks fold to constants in the inlined shift loops. Every bit
+ * is one BSRR store driving the data and the falling clock edge (when the
+ * pins share the port), and one store of the rising clock edge; the loops
+ * are unrolled by 8 bits.
+ *
+ * The bit takes about 8 cycles on Cortex-M3/M4 with PROBE_DELAY_NOPS 0,
+ * which gives TCK above 8MHz at 72MHz already; raise PROBE_DELAY_NOPS to
+ * the clock the target and the wiring can handle. The pins are set to the
+ * highest speed by the init functions.
+ *
+ * The SWD transactions can be collected to struct swd_queue and run by
+ * @ref swd_queue_run at once, which retries the WAIT responses, and collects
+ * the posted AP read results without the extra RDBUFF reads between
+ * consecutive AP reads.
+ */
+#ifndef HAL_PROBE_H_INCLUDED
+#define HAL_PROBE_H_INCLUDED
+
+#include <hal/common.h>
+#include <hal/pin.h>
+
+/**@{*/
+
+/*****************************************************************************/
+/* API definitions                                                           */
+/*****************************************************************************/
+
+/** NOPs in every half of the clock period */
+#ifndef PROBE_DELAY_NOPS
+#define PROBE_DELAY_NOPS	0
+#endif
+
+/** Retries of the SWD transfer answered by WAIT */
+#ifndef SWD_WAIT_RETRIES
+#define SWD_WAIT_RETRIES	100
+#endif
+
+/** Transfers of the SWD queue */
+#ifndef SWD_QUEUE_SIZE
+#define SWD_QUEUE_SIZE		32
+#endif
+
+/* SWD acknowledge, other values are protocol errors */
+#define SWD_ACK_OK		1
+#define SWD_ACK_WAIT		2
+#define SWD_ACK_FAULT		4
+#define SWD_ACK_PARITY		8	/* read data parity mismatch */
+
+/* SWD access port select */
+#define SWD_DP			0
+#define SWD_AP			1
+
+/* SWD debug port registers */
+#define SWD_DP_IDCODE		0x0	/* read */
+#define SWD_DP_ABORT		0x0	/* write */
+#define SWD_DP_CTRL_STAT	0x4
+#define SWD_DP_SELECT		0x8
+#define SWD_DP_RDBUFF		0xC
+
+struct swd_pins {
+	uint32_t swclk;
+	uint32_t swdio;
+};
+
+struct jtag_pins {
+	uint32_t tck;
+	uint32_t tms;
+	uint32_t tdi;
+	uint32_t tdo;
+};
+
+struct swd_op {
+	uint32_t request;	/* request byte */
+	uint32_t data;		/* write data */
+	uint32_t *dst;		/* read data destination */
+};
+
+struct swd_queue {
+	uint32_t count;
+	struct swd_op op[SWD_QUEUE_SIZE];
+};
+
+/*****************************************************************************/
+/* API Functions                                                             */
+/*****************************************************************************/
+
+BEGIN_DECLS
+
+/*---------------------------------------------------------------------------*/
+/** @addtogroup PROBE_api_swd SWD
+ * @{*/
+
+/*---------------------------------------------------------------------------*/
+/** @brief Configure the SWD pins, both driven high
+ *
+ * @param[in] p SWD pins
+ */
+static void swd_init(const struct swd_pins *p);
+
+/*---------------------------------------------------------------------------*/
+/** @brief Clock the bits out on SWDIO
+ *
+ * @param[in] p SWD pins
+ * @param[in] bits bits sent LSB first
+ * @param[in] count count of bits, 1..32
+ */
+static void swd_sequence(const struct swd_pins *p, uint32_t bits,
+			 uint32_t count);
+
+/*---------------------------------------------------------------------------*/
+/** @brief Switch the target from JTAG to SWD, and reset the line
+ *
+ * Read @ref SWD_DP_IDCODE afterwards, to leave the reset state.
+ *
+ * @param[in] p SWD pins
+ */
+static void swd_connect(const struct swd_pins *p);
+
+/*---------------------------------------------------------------------------*/
+/** @brief Do one SWD transfer
+ *
+ * @param[in] p SWD pins
+ * @param[in] ap SWD_AP or SWD_DP
+ * @param[in] read read, or write
+ * @param[in] addr register address, 0x0, 0x4, 0x8 or 0xC
+ * @param[inout] data data read or to be written
+ * @returns acknowledge of the target (SWD_ACK_OK when successful)
+ */
+static uint32_t swd_transfer(const struct swd_pins *p, bool ap, bool read,
+			     uint32_t addr, uint32_t *data);
+
+/*---------------------------------------------------------------------------*/
+/** @brief Read the register, retrying WAIT
+ *
+ * The result of the AP read is posted, the function reads it from
+ * @ref SWD_DP_RDBUFF.
+ *
+ * @param[in] p SWD pins
+ * @param[in] ap SWD_AP or SWD_DP
+ * @param[in] addr register address
+ * @param[out] data data read
+ * @returns acknowledge of the target (SWD_ACK_OK when successful)
+ */
+static uint32_t swd_read(const struct swd_pins *p, bool ap, uint32_t addr,
+			 uint32_t *data);
+
+/*---------------------------------------------------------------------------*/
+/** @brief Write the register, retrying WAIT
+ *
+ * @param[in] p SWD pins
+ * @param[in] ap SWD_AP or SWD_DP
+ * @param[in] addr register address
+ * @param[in] data data to write
+ * @returns acknowledge of the target (SWD_ACK_OK when successful)
+ */
+static uint32_t swd_write(const struct swd_pins *p, bool ap, uint32_t addr,
+			  uint32_t data);
+
+/*---------------------------------------------------------------------------*/
+/** @brief Empty the queue
+ *
+ * @param[out] q queue
+ */
+static void swd_queue_init(struct swd_queue *q);
+
+/*---------------------------------------------------------------------------*/
+/** @brief Queue the register read
+ *
+ * @param[inout] q queue
+ * @param[in] ap SWD_AP or SWD_DP
+ * @param[in] addr register address
+ * @param[out] dst destination of the data, written by @ref swd_queue_run
+ * @returns false when the queue is full
+ */
+static bool swd_queue_read(struct swd_queue *q, bool ap, uint32_t addr,
+			   uint32_t *dst);
+
+/*---------------------------------------------------------------------------*/
+/** @brief Queue the register write
+ *
+ * @param[inout] q queue
+ * @param[in] ap SWD_AP or SWD_DP
+ * @param[in] addr register address
+ * @param[in] data data to write
+ * @returns false when the queue is full
+ */
+static bool swd_queue_write(struct swd_queue *q, bool ap, uint32_t addr,
+			    uint32_t data);
+
+/*---------------------------------------------------------------------------*/
+/** @brief Run the queued transfers, and empty the queue
+ *
+ * Stops at the first transfer not acknowledged by OK after the retries, the
+ * destinations of the following reads are not written.
+ *
+ * @param[in] p SWD pins
+ * @param[inout] q queue
+ * @returns SWD_ACK_OK, or acknowledge of the failed transfer
+ */
+static uint32_t swd_queue_run(const struct swd_pins *p, struct swd_queue *q);
+
+/**@}*/
+
+/*---------------------------------------------------------------------------*/
+/** @addtogroup PROBE_api_jtag JTAG
+ * @{*/
+
+/*---------------------------------------------------------------------------*/
+/** @brief Configure the JTAG pins, TDO as input with pull-up
+ *
+ * @param[in] p JTAG pins
+ */
+static void jtag_init(const struct jtag_pins *p);
+
+/*---------------------------------------------------------------------------*/
+/** @brief Clock the TMS sequence with TDI high
+ *
+ * @param[in] p JTAG pins
+ * @param[in] bits TMS bits, LSB first
+ * @param[in] count count of bits, 1..32
+ */
+static void jtag_tms(const struct jtag_pins *p, uint32_t bits,
+		     uint32_t count);
+
+/*---------------------------------------------------------------------------*/
+/** @brief Shift up to 32 bits through the selected register
+ *
+ * The TAP must be in Shift-IR or Shift-DR state.
+ *
+ * @param[in] p JTAG pins
+ * @param[in] tdi bits to shift in, LSB first
+ * @param[in] count count of bits, 1..32
+ * @param[in] exit TMS high on the last bit, going to Exit1
+ * @returns bits shifted out of TDO, LSB first
+ */
+static uint32_t jtag_shift32(const struct jtag_pins *p, uint32_t tdi,
+			     uint32_t count, bool exit);
+
+/*---------------------------------------------------------------------------*/
+/** @brief Shift the bit buffers through the selected register
+ *
+ * @param[in] p JTAG pins
+ * @param[in] tdi bits to shift in, LSB of the first byte first, or NULL
+ * to shift ones
+ * @param[out] tdo bits shifted out, or NULL
+ * @param[in] count count of bits, > 0
+ * @param[in] exit TMS high on the last bit, going to Exit1
+ */
+static void jtag_shift(const struct jtag_pins *p, const uint8_t *tdi,
+		       uint8_t *tdo, uint32_t count, bool exit);
+
+/*---------------------------------------------------------------------------*/
+/** @brief Reset the TAP by TMS, and go to Run-Test/Idle
+ *
+ * @param[in] p JTAG pins
+ */
+static void jtag_reset(const struct jtag_pins *p);
+
+/*---------------------------------------------------------------------------*/
+/** @brief Scan the instruction register from Run-Test/Idle, back to it
+ *
+ * @param[in] p JTAG pins
+ * @param[in] ir instruction
+ * @param[in] count length of the instruction register, 1..32
+ * @returns captured value of the instruction register
+ */
+static uint32_t jtag_ir(const struct jtag_pins *p, uint32_t ir,
+			uint32_t count);
+
+/*---------------------------------------------------------------------------*/
+/** @brief Scan the data register from Run-Test/Idle, back to it
+ *
+ * @param[in] p JTAG pins
+ * @param[in] dr data
+ * @param[in] count length of the data register, 1..32
+ * @returns captured value of the data register
+ */
+static uint32_t jtag_dr(const struct jtag_pins *p, uint32_t dr,
+			uint32_t count);
+
+/**@}*/
+
+END_DECLS
+
+/**@}*/
+
+/*****************************************************************************/
+/* API implementations                                                       */
+/*****************************************************************************/
+
+#if defined(HAL_PIN_STM32_V0_H_INCLUDED)
+# define _SWD_MODE_IN	(GPIO_MODE_INPUT | (GPIO_CNF_INPUT_PULL_UPDOWN << 2))
+# define _SWD_MODE_OUT	(GPIO_MODE_OUTPUT_50_MHZ | \
+			 (GPIO_CNF_OUTPUT_PUSHPULL << 2))
+#else
+# define _SWD_MODE_IN	GPIO_MODE_INPUT
+# define _SWD_MODE_OUT	GPIO_MODE_OUTPUT
+#endif
+
+#define _PROBE_REPEAT8(x)	x x x x x x x x
+
+#define _SWD_REQ_AP		0x02
+#define _SWD_REQ_READ		0x04
+
+INLINE void _probe_delay(void)
+{
+#if PROBE_DELAY_NOPS > 0
+	__asm__ __volatile__ (".rept %c0\n\tnop\n\t.endr" : :
+			      "i" (PROBE_DELAY_NOPS));
+#endif
+}
+
+/* BSRR value setting the pin to the bit 0 of val */
+INLINE uint32_t _probe_bsrr(const uint32_t pin, uint32_t val)
+{
+	const uint32_t m = _pin_pin(pin);
+
+	return (m << 16) ^ (-(val & 1) & (m | (m << 16)));
+}
+
+/* The bit of the pin moved to bit 31 */
+INLINE uint32_t _probe_in31(const uint32_t pin)
+{
+	return (GPIO_IDR(_pin_port(pin)) << (31 - _pin_pinno(pin))) &
+	       0x80000000UL;
+}
+
+INLINE void _probe_clk_low(const uint32_t clk)
+{
+	GPIO_BSRR(_pin_port(clk)) = _pin_pin(clk) << 16;
+}
+
+INLINE void _probe_clk_high(const uint32_t clk)
+{
+	GPIO_BSRR(_pin_port(clk)) = _pin_pin(clk);
+}
+
+/*---------------------------------------------------------------------------*/
+
+/* Drive the data with the falling clock edge, rise the clock */
+INLINE void _swd_wbit(const struct swd_pins *p, uint32_t bit)
+{
+	if (_pin_port(p->swclk) == _pin_port(p->swdio)) {
+		GPIO_BSRR(_pin_port(p->swclk)) = _probe_bsrr(p->swdio, bit) |
+						 (_pin_pin(p->swclk) << 16);
+	} else {
+		GPIO_BSRR(_pin_port(p->swdio)) = _probe_bsrr(p->swdio, bit);
+		_probe_clk_low(p->swclk);
+	}
+	_probe_delay();
+	_probe_clk_high(p->swclk);
+	_probe_delay();
+}
+
+/* Sample the data before the rising clock edge, returned in bit 31 */
+INLINE uint32_t _swd_rbit(const struct swd_pins *p)
+{
+	uint32_t bit;
+
+	_probe_clk_low(p->swclk);
+	_probe_delay();
+	bit = _probe_in31(p->swdio);
+	_probe_clk_high(p->swclk);
+	_probe_delay();
+	return bit;
+}
+
+INLINE void _swd_write_bits(const struct swd_pins *p, uint32_t data,
+			    uint32_t count)
+{
+	while (count >= 8) {
+		_PROBE_REPEAT8(_swd_wbit(p, data); data >>= 1;)
+		count -= 8;
+	}
+	while (count--) {
+		_swd_wbit(p, data);
+		data >>= 1;
+	}
+}
+
+INLINE uint32_t _swd_read_bits(const struct swd_pins *p, uint32_t count)
+{
+	const uint32_t shift = 32 - count;
+	uint32_t data = 0;
+
+	while (count >= 8) {
+		_PROBE_REPEAT8(data = (data >> 1) | _swd_rbit(p);)
+		count -= 8;
+	}
+	while (count--)
+		data = (data >> 1) | _swd_rbit(p);
+
+	return data >> shift;
+}
+
+/* Turnaround cycle, not driving the line */
+INLINE void _swd_turn_in(const struct swd_pins *p)
+{
+	GPIO_BSRR(_pin_port(p->swdio)) = _pin_pin(p->swdio);
+	_pin_port_setmode(_pin_port(p->swdio), _pin_pin(p->swdio),
+			  _SWD_MODE_IN);
+	_probe_clk_low(p->swclk);
+	_probe_delay();
+	_probe_clk_high(p->swclk);
+	_probe_delay();
+}
+
+INLINE void _swd_turn_out(const struct swd_pins *p)
+{
+	_probe_clk_low(p->swclk);
+	_probe_delay();
+	_probe_clk_high(p->swclk);
+	_pin_port_setmode(_pin_port(p->swdio), _pin_pin(p->swdio),
+			  _SWD_MODE_OUT);
+	_probe_delay();
+}
+
+INLINE uint32_t _swd_parity(uint32_t x)
+{
+	x ^= x >> 16;
+	x ^= x >> 8;
+	x ^= x >> 4;
+	return (0x6996 >> (x & 0xF)) & 1;
+}
+
+/* Start, APnDP, RnW, A[3:2], parity, stop, park */
+INLINE uint32_t _swd_request(bool ap, bool read, uint32_t addr)
+{
+	const uint32_t bits = (ap ? _SWD_REQ_AP : 0) |
+			      (read ? _SWD_REQ_READ : 0) | ((addr & 0xC) << 1);
+
+	return 0x81 | bits | (_swd_parity(bits) << 5);
+}
+
+INLINE uint32_t _swd_transfer(const struct swd_pins *p, uint32_t request,
+			      uint32_t *data)
+{
+	uint32_t ack, val;
+
+	_swd_write_bits(p, request, 8);
+	_swd_turn_in(p);
+	ack = _swd_read_bits(p, 3);
+
+	if (ack != SWD_ACK_OK) {
+		_swd_turn_out(p);
+		return ack;
+	}
+
+	if (request & _SWD_REQ_READ) {
+		val = _swd_read_bits(p, 32);
+		if (_swd_read_bits(p, 1) != _swd_parity(val))
+			ack = SWD_ACK_PARITY;
+		_swd_turn_out(p);
+		*data = val;
+	} else {
+		_swd_turn_out(p);
+		val = *data;
+		_swd_write_bits(p, val, 32);
+		_swd_write_bits(p, _swd_parity(val), 1);
+	}
+
+	return ack;
+}
+
+INLINE uint32_t _swd_retry(const struct swd_pins *p, uint32_t request,
+			   uint32_t *data)
+{
+	uint32_t ack, retry = SWD_WAIT_RETRIES;
+
+	do {
+		ack = _swd_transfer(p, request, data);
+	} while (ack == SWD_ACK_WAIT && retry-- != 0);
+
+	return ack;
+}
+
+INLINE void swd_init(const struct swd_pins *p)
+{
+	pin_clock_enable(p->swclk);
+	pin_clock_enable(p->swdio);
+
+	pin_set(p->swclk, true);
+	pin_set(p->swdio, true);
+
+	pin_output_pushpull(p->swclk);
+	pin_output_pushpull(p->swdio);
+	pin_speed_high(p->swclk);
+	pin_speed_high(p->swdio);
+#if !defined(HAL_PIN_STM32_V0_H_INCLUDED)
+	pin_pull_up(p->swdio);
+#endif
+}
+
+INLINE void swd_sequence(const struct swd_pins *p, uint32_t bits,
+			 uint32_t count)
+{
+	_swd_write_bits(p, bits, count);
+}
+
+INLINE void swd_connect(const struct swd_pins *p)
+{
+	/* line reset, JTAG-to-SWD, line reset, idle */
+	_swd_write_bits(p, 0xFFFFFFFF, 32);
+	_swd_write_bits(p, 0xFFFFFFFF, 24);
+	_swd_write_bits(p, 0xE79E, 16);
+	_swd_write_bits(p, 0xFFFFFFFF, 32);
+	_swd_write_bits(p, 0xFFFFFFFF, 24);
+	_swd_write_bits(p, 0, 8);
+}
+
+INLINE uint32_t swd_transfer(const struct swd_pins *p, bool ap, bool read,
+			     uint32_t addr, uint32_t *data)
+{
+	return _swd_transfer(p, _swd_request(ap, read, addr), data);
+}
+
+INLINE uint32_t swd_read(const struct swd_pins *p, bool ap, uint32_t addr,
+			 uint32_t *data)
+{
+	uint32_t ack;
+
+	ack = _swd_retry(p, _swd_request(ap, true, addr), data);
+	if (ack == SWD_ACK_OK && ap)
+		ack = _swd_retry(p, _swd_request(SWD_DP, true, SWD_DP_RDBUFF),
+				 data);
+
+	return ack;
+}
+
+INLINE uint32_t swd_write(const struct swd_pins *p, bool ap, uint32_t addr,
+			  uint32_t data)
+{
+	uint32_t ack;
+
+	ack = _swd_retry(p, _swd_request(ap, false, addr), &data);
+	_swd_write_bits(p, 0, 8);
+	return ack;
+}
+
+INLINE void swd_queue_init(struct swd_queue *q)
+{
+	q->count = 0;
+}
+
+INLINE bool swd_queue_read(struct swd_queue *q, bool ap, uint32_t addr,
+			   uint32_t *dst)
+{
+	struct swd_op *op;
+
+	if (q->count >= SWD_QUEUE_SIZE)
+		return false;
+
+	op = &q->op[q->count];
+	op->request = _swd_request(ap, true, addr);
+	op->dst = dst;
+	q->count++;
+	return true;
+}
+
+INLINE bool swd_queue_write(struct swd_queue *q, bool ap, uint32_t addr,
+			    uint32_t data)
+{
+	struct swd_op *op;
+
+	if (q->count >= SWD_QUEUE_SIZE)
+		return false;
+
+	op = &q->op[q->count];
+	op->request = _swd_request(ap, false, addr);
+	op->data = data;
+	q->count++;
+	return true;
+}
+
+INLINE uint32_t swd_queue_run(const struct swd_pins *p, struct swd_queue *q)
+{
+	const uint32_t ap_read = _SWD_REQ_AP | _SWD_REQ_READ;
+	const uint32_t rdbuff = _swd_request(SWD_DP, true, SWD_DP_RDBUFF);
+	uint32_t *pending = NULL;
+	uint32_t i, val, ack = SWD_ACK_OK;
+	struct swd_op *op;
+
+	for (i = 0; i < q->count; i++) {
+		op = &q->op[i];
+
+		/* the posted AP read result is returned by the next AP read */
+		if (pending != NULL && (op->request & ap_read) != ap_read) {
+			ack = _swd_retry(p, rdbuff, pending);
+			if (ack != SWD_ACK_OK)
+				break;
+			pending = NULL;
+		}
+
+		if (!(op->request & _SWD_REQ_READ)) {
+			ack = _swd_retry(p, op->request, &op->data);
+		} else {
+			ack = _swd_retry(p, op->request, &val);
+			if (!(op->request & _SWD_REQ_AP))
+				*op->dst = val;
+			else if (pending != NULL)
+				*pending = val;
+			if (op->request & _SWD_REQ_AP)
+				pending = op->dst;
+		}
+
+		if (ack != SWD_ACK_OK)
+			break;
+	}
+
+	if (ack == SWD_ACK_OK && pending != NULL)
+		ack = _swd_retry(p, rdbuff, pending);
+
+	_swd_write_bits(p, 0, 8);
+	q->count = 0;
+	return ack;
+}
+
+/*---------------------------------------------------------------------------*/
+
+/*
+ * Drive TMS and TDI with the falling TCK, sample TDO at the end of the high
+ * TCK. The target changes TDO on the falling edge only, so the sample gets
+ * both halves of the period to settle, just before the next falling edge.
+ */
+INLINE uint32_t _jtag_bit(const struct jtag_pins *p, uint32_t tms,
+			  uint32_t tdi)
+{
+	const uint32_t port = _pin_port(p->tck);
+
+	if (_pin_port(p->tms) == port && _pin_port(p->tdi) == port) {
+		GPIO_BSRR(port) = _probe_bsrr(p->tms, tms) |
+				  _probe_bsrr(p->tdi, tdi) |
+				  (_pin_pin(p->tck) << 16);
+	} else {
+		GPIO_BSRR(_pin_port(p->tms)) = _probe_bsrr(p->tms, tms);
+		GPIO_BSRR(_pin_port(p->tdi)) = _probe_bsrr(p->tdi, tdi);
+		_probe_clk_low(p->tck);
+	}
+	_probe_delay();
+	_probe_clk_high(p->tck);
+	_probe_delay();
+	return _probe_in31(p->tdo);
+}
+
+INLINE void jtag_init(const struct jtag_pins *p)
+{
+	pin_clock_enable(p->tck);
+	pin_clock_enable(p->tms);
+	pin_clock_enable(p->tdi);
+	pin_clock_enable(p->tdo);
+
+	pin_set(p->tck, true);
+	pin_set(p->tms, true);
+	pin_set(p->tdi, true);
+
+	pin_output_pushpull(p->tck);
+	pin_output_pushpull(p->tms);
+	pin_output_pushpull(p->tdi);
+	pin_speed_high(p->tck);
+	pin_speed_high(p->tms);
+	pin_speed_high(p->tdi);
+
+	pin_input(p->tdo);
+	pin_pull_up(p->tdo);
+}
+
+INLINE void jtag_tms(const struct jtag_pins *p, uint32_t bits,
+		     uint32_t count)
+{
+	while (count--) {
+		_jtag_bit(p, bits, 1);
+		bits >>= 1;
+	}
+}
+
+INLINE uint32_t jtag_shift32(const struct jtag_pins *p, uint32_t tdi,
+			     uint32_t count, bool exit)
+{
+	const uint32_t shift = 32 - count;
+	uint32_t tdo = 0;
+
+	/* all bits but the last one with TMS low */
+	count--;
+	while (count >= 8) {
+		_PROBE_REPEAT8(tdo = (tdo >> 1) | _jtag_bit(p, 0, tdi);
+			       tdi >>= 1;)
+		count -= 8;
+	}
+	while (count--) {
+		tdo = (tdo >> 1) | _jtag_bit(p, 0, tdi);
+		tdi >>= 1;
+	}
+	tdo = (tdo >> 1) | _jtag_bit(p, exit, tdi);
+
+	return tdo >> shift;
+}
+
+INLINE void jtag_shift(const struct jtag_pins *p, const uint8_t *tdi,
+		       uint8_t *tdo, uint32_t count, bool exit)
+{
+	uint32_t bits, out;
+
+	while (count > 0) {
+		bits = (count > 8) ? 8 : count;
+		out = jtag_shift32(p, tdi ? *tdi++ : 0xFF, bits,
+				   exit && bits == count);
+		if (tdo)
+			*tdo++ = (uint8_t)out;
+		count -= bits;
+	}
+}
+
+INLINE void jtag_reset(const struct jtag_pins *p)
+{
+	jtag_tms(p, 0x1F, 6);
+}
+
+INLINE uint32_t jtag_ir(const struct jtag_pins *p, uint32_t ir,
+			uint32_t count)
+{
+	uint32_t val;
+
+	/* Select-DR, Select-IR, Capture-IR, Shift-IR */
+	jtag_tms(p, 0x3, 4);
+	val = jtag_shift32(p, ir, count, true);
+	/* Update-IR, Run-Test/Idle */
+	jtag_tms(p, 0x1, 2);
+	return val;
+}
+
+INLINE uint32_t jtag_dr(const struct jtag_pins *p, uint32_t dr,
+			uint32_t count)
+{
+	uint32_t val;
+
+	/* Select-DR, Capture-DR, Shift-DR */
+	jtag_tms(p, 0x1, 3);
+	val = jtag_shift32(p, dr, count, true);
+	/* Update-DR, Run-Test/Idle */
+	jtag_tms(p, 0x1, 2);
+	return val;
+}
+
+#endif /* HAL_PROBE_H_INCLUDED */
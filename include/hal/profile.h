@@ -0,0 +1,331 @@
+/*
+ * This file is part of the HAL project, inline library above libopencm3.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/** @defgroup PROFILE_module PROFILE module
+ *
+ * @brief Cycle profiler of code scopes
+ *
+ * @ingroup modules
+ *
+ * LGPL License Terms @ref lgpl_license
+ *
+ * The profiler is enabled by defining HAL_PROFILE before including the HAL
+ * headers. Without it, @ref HAL_PROFILE_SCOPE expands to nothing and the
+ * other functions do nothing, so the instrumentation can stay in the
+ * production code.
+ *
+ * @code
+ * void exti0_isr(void)
+ * {
+ *	HAL_PROFILE_SCOPE(PROF_EXTI0);
+ *	...
+ * }
+ * @endcode
+ *
+ * The scope reads the clock at the declaration, and again when it is left by
+ * any path, and accumulates the count, min, max and sum of the cycles spent
+ * to the entry of the table. The accumulation is lock-free on Cortex-M3 and
+ * above (LDREX/STREX), and masks interrupts for a few cycles on Cortex-M0/M0+
+ * (see @ref ATOMIC_module), so the same entry can be used by the thread and
+ * by the interrupt handlers.
+ *
+ * The clock is @ref cycle_counter_get by default. The cycles between the two
+ * clock reads measured by @ref profile_init are subtracted from every sample.
+ * The scope itself costs about 5 cycles at the entry and 40 cycles at the
+ * exit on Cortex-M3/M4, and about 60 cycles at the exit on Cortex-M0, spent
+ * outside of the measured interval.
+ *
+ * Defining HAL_PROFILE_HOST builds the profiler for the host, with the clock
+ * being the virtual counter advanced by @ref profile_clock_advance. The
+ * clock can be also replaced by defining HAL_PROFILE_CLOCK() to an expression
+ * returning uint32_t.
+ */
+#ifndef HAL_PROFILE_H_INCLUDED
+#define HAL_PROFILE_H_INCLUDED
+
+#include <hal/common.h>
+
+#if defined(HAL_PROFILE) && !defined(HAL_PROFILE_HOST)
+# include <hal/atomic.h>
+# include <hal/cycle.h>
+#endif
+
+/**@{*/
+
+/*****************************************************************************/
+/* API definitions                                                           */
+/*****************************************************************************/
+
+/** Entries of the table, the ids are 0 to HAL_PROFILE_SLOTS - 1 */
+#ifndef HAL_PROFILE_SLOTS
+#define HAL_PROFILE_SLOTS	16
+#endif
+
+struct profile_stats {
+	uint32_t count;		/* samples taken */
+	uint32_t min;		/* cycles */
+	uint32_t max;		/* cycles */
+	uint32_t mean;		/* cycles */
+	uint64_t sum;		/* cycles */
+};
+
+typedef void (*profile_print_t)(uint32_t id, const struct profile_stats *stats);
+
+#if defined(HAL_PROFILE)
+
+struct _profile_entry {
+	volatile uint32_t count;
+	volatile uint32_t min_inv;	/* ~min, so both are maximums */
+	volatile uint32_t max;
+	volatile uint32_t sum_lo;
+	volatile uint32_t sum_hi;
+};
+
+struct _profile_scope {
+	uint32_t id;
+	uint32_t start;
+};
+
+# define _PROFILE_JOIN2(a, b)	a##b
+# define _PROFILE_JOIN(a, b)	_PROFILE_JOIN2(a, b)
+
+/** Profile the rest of the enclosing scope to the entry id */
+# define HAL_PROFILE_SCOPE(id)						\
+	struct _profile_scope _PROFILE_JOIN(_profile_scope_, __LINE__)	\
+	__attribute__((cleanup(_profile_scope_exit))) =			\
+		_profile_scope_enter(id)
+
+#else
+
+# define HAL_PROFILE_SCOPE(id)
+
+#endif
+
+/*****************************************************************************/
+/* API Functions                                                             */
+/*****************************************************************************/
+
+BEGIN_DECLS
+
+/*---------------------------------------------------------------------------*/
+/** @brief Clear the table, and calibrate the clock read overhead
+ *
+ * The clock must be running already.
+ */
+static void profile_init(void);
+
+/*---------------------------------------------------------------------------*/
+/** @brief Get the statistics of the entry
+ *
+ * @param[in] id entry
+ * @param[out] stats statistics, zero when no sample was taken
+ */
+static void profile_get(uint32_t id, struct profile_stats *stats);
+
+/*---------------------------------------------------------------------------*/
+/** @brief Pass the statistics of all entries with samples to the function
+ *
+ * @param[in] print called for every entry with samples
+ */
+static void profile_report(profile_print_t print);
+
+/*---------------------------------------------------------------------------*/
+/** @brief Advance the virtual clock of the host build
+ *
+ * @param[in] cycles cycles to advance
+ */
+static void profile_clock_advance(uint32_t cycles);
+
+END_DECLS
+
+/**@}*/
+
+/*****************************************************************************/
+/* API implementations                                                       */
+/*****************************************************************************/
+
+#if defined(HAL_PROFILE)
+
+/* The state shared by all units */
+__attribute__((weak)) struct _profile_entry _profile_table[HAL_PROFILE_SLOTS];
+__attribute__((weak)) uint32_t _profile_overhead;
+
+#if defined(HAL_PROFILE_HOST)
+
+__attribute__((weak)) volatile uint32_t _profile_virtual_clock;
+
+# if !defined(HAL_PROFILE_CLOCK)
+#  define HAL_PROFILE_CLOCK()	(_profile_virtual_clock)
+# endif
+# define _PROFILE_MASK		0xFFFFFFFFUL
+
+INLINE uint32_t _profile_add(volatile uint32_t *addr, uint32_t val)
+{
+	return __atomic_add_fetch(addr, val, __ATOMIC_RELAXED);
+}
+
+INLINE void _profile_max(volatile uint32_t *addr, uint32_t val)
+{
+	uint32_t old = *addr;
+
+	while (val > old &&
+	       !__atomic_compare_exchange_n(addr, &old, val, true,
+					    __ATOMIC_RELAXED,
+					    __ATOMIC_RELAXED));
+}
+
+#else
+
+# if !defined(HAL_PROFILE_CLOCK)
+#  define HAL_PROFILE_CLOCK()	cycle_counter_get()
+# endif
+# define _PROFILE_MASK		CYCLE_COUNTER_MASK
+
+INLINE uint32_t _profile_add(volatile uint32_t *addr, uint32_t val)
+{
+	return atomic_add32(addr, val);
+}
+
+INLINE void _profile_max(volatile uint32_t *addr, uint32_t val)
+{
+	uint32_t old;
+
+	do {
+		old = *addr;
+		if (val <= old)
+			return;
+	} while (!atomic_cas32(addr, old, val));
+}
+
+#endif
+
+INLINE struct _profile_scope _profile_scope_enter(uint32_t id)
+{
+	struct _profile_scope scope;
+
+	scope.id = id;
+	scope.start = HAL_PROFILE_CLOCK();
+	return scope;
+}
+
+INLINE void _profile_scope_exit(struct _profile_scope *scope)
+{
+	uint32_t cycles = (HAL_PROFILE_CLOCK() - scope->start) & _PROFILE_MASK;
+	struct _profile_entry *entry = &_profile_table[scope->id];
+
+	cycles = (cycles > _profile_overhead) ? cycles - _profile_overhead : 0;
+
+	if (_profile_add(&entry->sum_lo, cycles) < cycles)
+		_profile_add(&entry->sum_hi, 1);
+
+	_profile_max(&entry->max, cycles);
+	_profile_max(&entry->min_inv, ~cycles);
+	_profile_add(&entry->count, 1);
+}
+
+INLINE void profile_init(void)
+{
+	uint32_t i, start, cycles;
+
+	for (i = 0; i < HAL_PROFILE_SLOTS; i++) {
+		_profile_table[i].count = 0;
+		_profile_table[i].min_inv = 0;
+		_profile_table[i].max = 0;
+		_profile_table[i].sum_lo = 0;
+		_profile_table[i].sum_hi = 0;
+	}
+
+	_profile_overhead = _PROFILE_MASK;
+	for (i = 0; i < 8; i++) {
+		start = HAL_PROFILE_CLOCK();
+		cycles = (HAL_PROFILE_CLOCK() - start) & _PROFILE_MASK;
+		if (cycles < _profile_overhead)
+			_profile_overhead = cycles;
+	}
+}
+
+INLINE void profile_get(uint32_t id, struct profile_stats *stats)
+{
+	const struct _profile_entry *entry = &_profile_table[id];
+	uint32_t hi;
+
+	/* the sum is consistent, when the upper part did not change */
+	do {
+		hi = entry->sum_hi;
+		stats->count = entry->count;
+		stats->min = ~entry->min_inv;
+		stats->max = entry->max;
+		stats->sum = ((uint64_t)hi << 32) | entry->sum_lo;
+	} while (hi != entry->sum_hi);
+
+	if (stats->count == 0) {
+		stats->min = 0;
+		stats->mean = 0;
+	} else {
+		stats->mean = (uint32_t)(stats->sum / stats->count);
+	}
+}
+
+INLINE void profile_report(profile_print_t print)
+{
+	struct profile_stats stats;
+	uint32_t id;
+
+	for (id = 0; id < HAL_PROFILE_SLOTS; id++) {
+		profile_get(id, &stats);
+		if (stats.count != 0)
+			print(id, &stats);
+	}
+}
+
+INLINE void profile_clock_advance(uint32_t cycles)
+{
+#if defined(HAL_PROFILE_HOST)
+	_profile_virtual_clock += cycles;
+#else
+	(void)cycles;
+#endif
+}
+
+#else
+
+INLINE void profile_init(void)
+{
+}
+
+INLINE void profile_get(uint32_t id, struct profile_stats *stats)
+{
+	(void)id;
+	stats->count = 0;
+	stats->min = 0;
+	stats->max = 0;
+	stats->mean = 0;
+	stats->sum = 0;
+}
+
+INLINE void profile_report(profile_print_t print)
+{
+	(void)print;
+}
+
+INLINE void profile_clock_advance(uint32_t cycles)
+{
+	(void)cycles;
+}
+
+#endif
+
+#endif /* HAL_PROFILE_H_INCLUDED */
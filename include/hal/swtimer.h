@@ -0,0 +1,392 @@
+/*
+ * This file is part of the HAL project, inline library above libopencm3.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/** @defgroup SWTIMER_module SWTIMER module
+ *
+ * @brief Software timers API
+ *
+ * @ingroup modules
+ *
+ * LGPL License Terms @ref lgpl_license
+ *
+ * The timers are kept in a hierarchical timing wheel of @ref SWTIMER_LEVELS
+ * levels, each of 2^@ref SWTIMER_SLOT_BITS slots. The start and the cancel
+ * of the timer are O(1), the tick is amortized O(1): every timer is moved to
+ * a lower level at most SWTIMER_LEVELS - 1 times before it expires. Timeouts
+ * longer than the wheel range are cascaded from the top level repeatedly.
+ *
+ * The timers are intrusive, the application allocates struct swtimer
+ * statically, and the wheel links them together. No memory is allocated.
+ *
+ * @ref swtimer_tick is expected to be called from the tick interrupt
+ * handler. The callbacks of the timers run directly in it, or with
+ * @ref SWTIMER_DEFERRED, they are queued to a lock-free list and run from the
+ * main loop by @ref swtimer_run_deferred. The deferred callback runs at least
+ * once after every expiration, the expirations coming before the main loop
+ * got to it are coalesced. The handler pushes the expired timers to the
+ * front of the list, and @ref swtimer_run_deferred reverses it, so the
+ * callbacks run in the order of the first expiration not yet run.
+ *
+ * The host benchmark tests/swtimer_host.c shows the flat cost per tick from
+ * 10 to 10,000 timers.
+ *
+ * Start and cancel from the thread mode mask the interrupts for a few cycles
+ * to keep the wheel consistent with the handler.
+ */
+#ifndef HAL_SWTIMER_H_INCLUDED
+#define HAL_SWTIMER_H_INCLUDED
+
+#include <hal/common.h>
+#include <hal/atomic.h>
+#include <libopencm3/cm3/cortex.h>
+
+/**@{*/
+
+/*****************************************************************************/
+/* API definitions                                                           */
+/*****************************************************************************/
+
+/** Slots per level of the wheel are 2^SWTIMER_SLOT_BITS */
+#ifndef SWTIMER_SLOT_BITS
+#define SWTIMER_SLOT_BITS	5
+#endif
+
+/** Levels of the wheel, the range is 2^(SWTIMER_SLOT_BITS * SWTIMER_LEVELS) */
+#ifndef SWTIMER_LEVELS
+#define SWTIMER_LEVELS		4
+#endif
+
+#define SWTIMER_SLOTS		(1 << SWTIMER_SLOT_BITS)
+#define SWTIMER_SLOT_MASK	(SWTIMER_SLOTS - 1)
+#define SWTIMER_RANGE		(1UL << (SWTIMER_SLOT_BITS * SWTIMER_LEVELS))
+
+/** Flag of the timer, run the callback from @ref swtimer_run_deferred */
+#define SWTIMER_DEFERRED	(1 << 0)
+
+#if SWTIMER_SLOT_BITS * SWTIMER_LEVELS > 30
+# error "hal/swtimer.h: wheel range exceeds 2^30 ticks"
+#endif
+
+struct swtimer;
+
+typedef void (*swtimer_callback_t)(struct swtimer *timer);
+
+struct swtimer_link {
+	struct swtimer_link *next;
+	struct swtimer_link *prev;
+};
+
+struct swtimer {
+	struct swtimer_link link;	/* must be first */
+	uint32_t expires;		/* tick of the expiration */
+	uint32_t period;		/* reload, or zero for one-shot */
+	swtimer_callback_t callback;
+	uint8_t flags;
+	volatile uint8_t queued;	/* in the deferred list */
+	volatile uint8_t fire;		/* deferred callback to be called */
+	struct swtimer *deferred_next;
+};
+
+struct swtimer_wheel {
+	uint32_t now;			/* the tick processed next */
+	struct swtimer_link slot[SWTIMER_LEVELS][SWTIMER_SLOTS];
+	volatile uint32_t deferred;	/* LIFO of fired deferred timers */
+};
+
+/*****************************************************************************/
+/* API Functions                                                             */
+/*****************************************************************************/
+
+BEGIN_DECLS
+
+/*---------------------------------------------------------------------------*/
+/** @brief Initialize the empty timer wheel
+ *
+ * @param[out] wheel timer wheel
+ */
+static void swtimer_wheel_init(struct swtimer_wheel *wheel);
+
+/*---------------------------------------------------------------------------*/
+/** @brief Initialize the stopped timer
+ *
+ * @param[out] timer timer
+ * @param[in] callback function called on expiration
+ * @param[in] flags 0 or @ref SWTIMER_DEFERRED
+ */
+static void swtimer_init(struct swtimer *timer, swtimer_callback_t callback,
+			 uint8_t flags);
+
+/*---------------------------------------------------------------------------*/
+/** @brief Start or restart the timer
+ *
+ * Can be called from the callback of the timer itself.
+ *
+ * @param[inout] wheel timer wheel
+ * @param[inout] timer timer
+ * @param[in] ticks ticks to the expiration, at least 1
+ * @param[in] period ticks between the following expirations, 0 for one-shot
+ */
+static void swtimer_start(struct swtimer_wheel *wheel, struct swtimer *timer,
+			  uint32_t ticks, uint32_t period);
+
+/*---------------------------------------------------------------------------*/
+/** @brief Stop the timer
+ *
+ * The deferred callback not yet run is cancelled too.
+ *
+ * @param[inout] timer timer
+ */
+static void swtimer_cancel(struct swtimer *timer);
+
+/*---------------------------------------------------------------------------*/
+/** @brief Check if the timer is running
+ *
+ * @param[in] timer timer
+ * @returns true when the timer waits for the expiration
+ */
+static bool swtimer_active(const struct swtimer *timer);
+
+/*---------------------------------------------------------------------------*/
+/** @brief Advance the wheel by one tick
+ *
+ * Call from the tick interrupt handler.
+ *
+ * @param[inout] wheel timer wheel
+ */
+static void swtimer_tick(struct swtimer_wheel *wheel);
+
+/*---------------------------------------------------------------------------*/
+/** @brief Run the callbacks of the expired deferred timers
+ *
+ * Call from the main loop. The callbacks run in the order of expiration.
+ *
+ * @param[inout] wheel timer wheel
+ * @returns count of the callbacks run
+ */
+static uint32_t swtimer_run_deferred(struct swtimer_wheel *wheel);
+
+END_DECLS
+
+/**@}*/
+
+/*****************************************************************************/
+/* API implementations                                                       */
+/*****************************************************************************/
+
+INLINE void _swtimer_unlink(struct swtimer_link *link)
+{
+	link->prev->next = link->next;
+	link->next->prev = link->prev;
+	link->next = NULL;
+}
+
+INLINE void _swtimer_link(struct swtimer_link *head, struct swtimer_link *link)
+{
+	link->next = head;
+	link->prev = head->prev;
+	head->prev->next = link;
+	head->prev = link;
+}
+
+/* Level is chosen by the distance, slot by the expiration tick itself */
+INLINE void _swtimer_add(struct swtimer_wheel *wheel, struct swtimer *timer)
+{
+	uint32_t delta = timer->expires - wheel->now;
+	uint32_t level = 0;
+
+	if ((int32_t)delta < 0) {
+		timer->expires = wheel->now;
+		delta = 0;
+	} else if (delta >= SWTIMER_RANGE) {
+		delta = SWTIMER_RANGE - 1;
+	}
+
+	while (delta >= (1UL << (SWTIMER_SLOT_BITS * (level + 1))))
+		level++;
+
+	_swtimer_link(&wheel->slot[level][((wheel->now + delta) >>
+					   (SWTIMER_SLOT_BITS * level)) &
+					  SWTIMER_SLOT_MASK],
+		      &timer->link);
+}
+
+INLINE void swtimer_wheel_init(struct swtimer_wheel *wheel)
+{
+	uint32_t level, i;
+
+	wheel->now = 0;
+	wheel->deferred = 0;
+
+	for (level = 0; level < SWTIMER_LEVELS; level++) {
+		for (i = 0; i < SWTIMER_SLOTS; i++) {
+			wheel->slot[level][i].next = &wheel->slot[level][i];
+			wheel->slot[level][i].prev = &wheel->slot[level][i];
+		}
+	}
+}
+
+INLINE void swtimer_init(struct swtimer *timer, swtimer_callback_t callback,
+			 uint8_t flags)
+{
+	timer->link.next = NULL;
+	timer->period = 0;
+	timer->callback = callback;
+	timer->flags = flags;
+	timer->queued = 0;
+	timer->fire = 0;
+	timer->deferred_next = NULL;
+}
+
+INLINE void swtimer_start(struct swtimer_wheel *wheel, struct swtimer *timer,
+			  uint32_t ticks, uint32_t period)
+{
+	const uint32_t mask = cm_mask_interrupts(1);
+
+	if (timer->link.next != NULL)
+		_swtimer_unlink(&timer->link);
+
+	timer->expires = wheel->now + ticks - 1;
+	timer->period = period;
+	_swtimer_add(wheel, timer);
+
+	cm_mask_interrupts(mask);
+}
+
+INLINE void swtimer_cancel(struct swtimer *timer)
+{
+	const uint32_t mask = cm_mask_interrupts(1);
+
+	if (timer->link.next != NULL)
+		_swtimer_unlink(&timer->link);
+
+	timer->fire = 0;
+	cm_mask_interrupts(mask);
+}
+
+INLINE bool swtimer_active(const struct swtimer *timer)
+{
+	return timer->link.next != NULL;
+}
+
+/* Moves all timers of the slot to the lower levels */
+INLINE void _swtimer_cascade(struct swtimer_wheel *wheel,
+			     struct swtimer_link *head)
+{
+	struct swtimer_link *link = head->next;
+
+	head->next = head;
+	head->prev = head;
+
+	while (link != head) {
+		struct swtimer_link *next = link->next;
+
+		_swtimer_add(wheel, (struct swtimer *)link);
+		link = next;
+	}
+}
+
+INLINE void _swtimer_fire(struct swtimer_wheel *wheel, struct swtimer *timer)
+{
+	if (!(timer->flags & SWTIMER_DEFERRED)) {
+		timer->callback(timer);
+		return;
+	}
+
+	timer->fire = 1;
+	if (!timer->queued) {
+		timer->queued = 1;
+		timer->deferred_next = (struct swtimer *)(uintptr_t)
+				       wheel->deferred;
+		wheel->deferred = (uint32_t)(uintptr_t)timer;
+	}
+}
+
+INLINE void swtimer_tick(struct swtimer_wheel *wheel)
+{
+	const uint32_t now = wheel->now;
+	struct swtimer_link *head = &wheel->slot[0][now & SWTIMER_SLOT_MASK];
+	struct swtimer_link expired;
+	uint32_t level;
+
+	/* entering the new round of the level, pull its slot down */
+	for (level = 1; level < SWTIMER_LEVELS; level++) {
+		if (now & ((1UL << (SWTIMER_SLOT_BITS * level)) - 1))
+			break;
+
+		_swtimer_cascade(wheel, &wheel->slot[level][
+				 (now >> (SWTIMER_SLOT_BITS * level)) &
+				 SWTIMER_SLOT_MASK]);
+	}
+
+	/* detach the due slot, so the restarted timers go to the next round */
+	if (head->next == head) {
+		wheel->now = now + 1;
+		return;
+	}
+
+	expired.next = head->next;
+	expired.prev = head->prev;
+	expired.next->prev = &expired;
+	expired.prev->next = &expired;
+	head->next = head;
+	head->prev = head;
+
+	wheel->now = now + 1;
+
+	while (expired.next != &expired) {
+		struct swtimer *timer = (struct swtimer *)expired.next;
+
+		_swtimer_unlink(&timer->link);
+
+		if (timer->period != 0) {
+			timer->expires += timer->period;
+			_swtimer_add(wheel, timer);
+		}
+
+		_swtimer_fire(wheel, timer);
+	}
+}
+
+INLINE uint32_t swtimer_run_deferred(struct swtimer_wheel *wheel)
+{
+	struct swtimer *timer, *prev = NULL, *next;
+	uint32_t count = 0;
+
+	timer = (struct swtimer *)(uintptr_t)atomic_swap32(&wheel->deferred, 0);
+
+	/* the list is LIFO, reverse it to run in the order of expiration */
+	while (timer != NULL) {
+		next = timer->deferred_next;
+		timer->deferred_next = prev;
+		prev = timer;
+		timer = next;
+	}
+
+	for (timer = prev; timer != NULL; timer = next) {
+		next = timer->deferred_next;
+		timer->queued = 0;
+
+		if (timer->fire) {
+			timer->fire = 0;
+			timer->callback(timer);
+			count++;
+		}
+	}
+
+	return count;
+}
+
+#endif /* HAL_SWTIMER_H_INCLUDED */
@@ -0,0 +1,306 @@
+/*
+ * This file is part of the HAL project, inline library above libopencm3.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/** @defgroup TASK_module TASK module
+ *
+ * @brief Stackless cooperative tasks API
+ *
+ * @ingroup modules
+ *
+ * LGPL License Terms @ref lgpl_license
+ *
+ * The task is a function called repeatedly by @ref task_run. It resumes
+ * where it stopped waiting, the position is kept in struct task as a line
+ * number, so the task needs no stack of its own. The local variables are not
+ * preserved across the waits, keep the state in static variables, or in the
+ * structure embedding struct task.
+ *
+ * @code
+ * static enum task_state blink(struct task *t)
+ * {
+ *	TASK_BEGIN(t);
+ *	while (true) {
+ *		pin_toggle(LED);
+ *		TASK_SLEEP_MS(t, 500);
+ *	}
+ *	TASK_END(t);
+ * }
+ * @endcode
+ *
+ * The waits are not allowed inside a switch statement of the task, and only
+ * one wait can be written on a line.
+ *
+ * The deadlines are kept in cycles of the @ref TIMEBASE_module, which must
+ * be initialized and maintained by the SysTick handler. When all tasks wait,
+ * the core sleeps by WFI until the next interrupt, nothing wakes it at the
+ * deadline itself. A periodic interrupt must wake it at the resolution of
+ * the deadlines, on every core: the SysTick programmed as the tick on the
+ * cores with DWT, another timer on STM32F0/L0, where the SysTick counts the
+ * timebase and wraps only every 2^24 cycles (350ms at 48MHz). Interrupt
+ * handlers completing the wait of a task call @ref task_signal to get it run
+ * without waiting for the tick.
+ *
+ * \includelineno task/blink_button.c
+ */
+#ifndef HAL_TASK_H_INCLUDED
+#define HAL_TASK_H_INCLUDED
+
+#include <hal/common.h>
+#include <hal/pin.h>
+#include <hal/timebase.h>
+#include <libopencm3/cm3/cortex.h>
+
+/**@{*/
+
+/*****************************************************************************/
+/* API definitions                                                           */
+/*****************************************************************************/
+
+enum task_state {
+	TASK_WAITING,		/* waits for a condition */
+	TASK_YIELDED,		/* can continue immediately */
+	TASK_DONE		/* finished, not called any more */
+};
+
+struct task;
+
+typedef enum task_state (*task_fn_t)(struct task *t);
+
+struct task {
+	task_fn_t fn;
+	uint16_t line;		/* resume point, 0 at the start */
+	uint8_t done;
+	uint8_t level;		/* pin level for the edge waits */
+	uint32_t deadline;	/* timebase_now32 cycles */
+};
+
+/** Static initializer of the task running function fn */
+#define TASK_INIT(fn)		{ (fn), 0, 0, 0, 0 }
+
+/** Start of the task body */
+#define TASK_BEGIN(t)							\
+	switch ((t)->line) {						\
+	case 0:
+
+/** End of the task body, the task is done when it gets here */
+#define TASK_END(t)							\
+	}								\
+	(t)->line = 0;							\
+	return TASK_DONE
+
+/** Wait until cond is true */
+#define TASK_AWAIT(t, cond)						\
+	do {								\
+		(t)->line = __LINE__;					\
+	case __LINE__:							\
+		if (!(cond))						\
+			return TASK_WAITING;				\
+	} while (0)
+
+/** Let the other tasks run, and continue without sleeping */
+#define TASK_YIELD(t)							\
+	do {								\
+		(t)->line = __LINE__;					\
+		return TASK_YIELDED;					\
+	case __LINE__:;							\
+	} while (0)
+
+/** Finish the task */
+#define TASK_EXIT(t)							\
+	do {								\
+		(t)->line = 0;						\
+		return TASK_DONE;					\
+	} while (0)
+
+/** Wait until the deadline set by @ref task_deadline_us passes */
+#define TASK_AWAIT_DEADLINE(t)						\
+	TASK_AWAIT(t, task_deadline_passed(t))
+
+/** Wait for the specified microseconds, max 2^31 cycles */
+#define TASK_SLEEP_US(t, us)						\
+	do {								\
+		task_deadline_us(t, us);				\
+		TASK_AWAIT_DEADLINE(t);					\
+	} while (0)
+
+/** Wait for the specified milliseconds, max 2^31 cycles */
+#define TASK_SLEEP_MS(t, ms)	TASK_SLEEP_US(t, (ms) * 1000UL)
+
+/** Wait until the pin has the level */
+#define TASK_AWAIT_PIN(t, pin, lvl)					\
+	TASK_AWAIT(t, pin_get(pin) == (lvl))
+
+/** Wait until the pin changes to the level, a rising or falling edge */
+#define TASK_AWAIT_EDGE(t, pin, lvl)					\
+	do {								\
+		(t)->level = pin_get(pin);				\
+		TASK_AWAIT(t, _task_edge(t, pin_get(pin), lvl));	\
+	} while (0)
+
+/** Wait until the flag is nonzero, and clear it */
+#define TASK_AWAIT_FLAG(t, flag)					\
+	do {								\
+		TASK_AWAIT(t, (flag) != 0);				\
+		(flag) = 0;						\
+	} while (0)
+
+/** Wait until cond is true or the timeout passes, check cond afterwards */
+#define TASK_AWAIT_TIMEOUT(t, cond, us)					\
+	do {								\
+		task_deadline_us(t, us);				\
+		TASK_AWAIT(t, (cond) || task_deadline_passed(t));	\
+	} while (0)
+
+/*****************************************************************************/
+/* API Functions                                                             */
+/*****************************************************************************/
+
+BEGIN_DECLS
+
+/*---------------------------------------------------------------------------*/
+/** @brief Set the deadline of the task
+ *
+ * @param[inout] t task
+ * @param[in] us microseconds from now, max 2^31 cycles
+ */
+static void task_deadline_us(struct task *t, uint32_t us);
+
+/*---------------------------------------------------------------------------*/
+/** @brief Check if the deadline of the task has passed
+ *
+ * @param[in] t task
+ * @returns true when the deadline passed
+ */
+static bool task_deadline_passed(const struct task *t);
+
+/*---------------------------------------------------------------------------*/
+/** @brief Request the next round of the tasks
+ *
+ * Call from the interrupt handler that completed the wait of some task, so
+ * the scheduler does not go to sleep.
+ */
+static void task_signal(void);
+
+/*---------------------------------------------------------------------------*/
+/** @brief Run all tasks once
+ *
+ * @param[inout] tasks array of tasks
+ * @param[in] count count of tasks
+ * @returns true when some task yielded, or some task is not done
+ */
+static bool task_run_once(struct task *tasks, uint32_t count);
+
+/*---------------------------------------------------------------------------*/
+/** @brief Run the tasks until all are done
+ *
+ * When all tasks wait, and no @ref task_signal came during the round, the
+ * core sleeps by WFI until the next interrupt. The deadlines overshoot by up
+ * to the period of the wakeup interrupt, which must be configured.
+ *
+ * @param[inout] tasks array of tasks
+ * @param[in] count count of tasks
+ */
+static void task_run(struct task *tasks, uint32_t count);
+
+END_DECLS
+
+/**@}*/
+
+/*****************************************************************************/
+/* API implementations                                                       */
+/*****************************************************************************/
+
+/* Set by task_signal, shared by all units */
+__attribute__((weak)) volatile uint32_t _task_signaled;
+
+INLINE bool _task_edge(struct task *t, bool now, bool level)
+{
+	if (now == t->level)
+		return false;
+
+	t->level = now;
+	return now == level;
+}
+
+INLINE void task_deadline_us(struct task *t, uint32_t us)
+{
+	t->deadline = timebase_now32() + (uint32_t)timebase_us_to_cycles(us);
+}
+
+INLINE bool task_deadline_passed(const struct task *t)
+{
+	return (int32_t)(timebase_now32() - t->deadline) >= 0;
+}
+
+INLINE void task_signal(void)
+{
+	_task_signaled = 1;
+}
+
+/* Returns true, when the round should be repeated without sleeping */
+INLINE bool _task_round(struct task *tasks, uint32_t count, bool *alive)
+{
+	bool again = false;
+	uint32_t i;
+
+	*alive = false;
+	for (i = 0; i < count; i++) {
+		if (tasks[i].done)
+			continue;
+
+		switch (tasks[i].fn(&tasks[i])) {
+		case TASK_DONE:
+			tasks[i].done = 1;
+			break;
+		case TASK_YIELDED:
+			again = true;
+			*alive = true;
+			break;
+		case TASK_WAITING:
+			*alive = true;
+			break;
+		}
+	}
+
+	return again;
+}
+
+INLINE bool task_run_once(struct task *tasks, uint32_t count)
+{
+	bool alive;
+
+	return _task_round(tasks, count, &alive) || alive;
+}
+
+INLINE void task_run(struct task *tasks, uint32_t count)
+{
+	bool alive = true;
+	uint32_t mask;
+
+	while (alive) {
+		_task_signaled = 0;
+		if (_task_round(tasks, count, &alive) || !alive)
+			continue;
+
+		/* the pending interrupt wakes the core even when masked */
+		mask = cm_mask_interrupts(1);
+		if (!_task_signaled)
+			__asm__ __volatile__ ("wfi");
+		cm_mask_interrupts(mask);
+	}
+}
+
+#endif /* HAL_TASK_H_INCLUDED */
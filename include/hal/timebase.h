@@ -0,0 +1,237 @@
+/*
+ * This file is part of the HAL project, inline library above libopencm3.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/** @defgroup TIMEBASE_module TIMEBASE module
+ *
+ * @brief 64-bit monotonic time API
+ *
+ * @ingroup modules
+ *
+ * LGPL License Terms @ref lgpl_license
+ *
+ * The timebase extends the @ref CYCLE_module counter to 64 bits, counting
+ * processor cycles since @ref timebase_init. The upper part is maintained by
+ * @ref timebase_isr, which must be called from the SysTick interrupt handler:
+ *
+ * - On STM32F0/L0, the SysTick is the counter itself, @ref timebase_init
+ *   enables its interrupt on every wrap of the 24-bit counter.
+ * - On other families, the counter is the 32-bit DWT cycle counter, and the
+ *   SysTick is left to the application. It must be running with interrupt
+ *   period shorter than 2^32 cycles (25 s @ 168MHz).
+ *
+ * The reads never disable the interrupts. The state updated by the handler
+ * is double-buffered, readers retry when the handler ran in the middle of the
+ * read, so the time is consistent from the thread and from any interrupt
+ * handler. On STM32F0/L0, the wrap not yet served by the handler is detected
+ * from the pending SysTick interrupt, so the readers must not preempt the
+ * SysTick handler itself (all exceptions have equal priority after reset).
+ *
+ * The state is shared by all compilation units.
+ */
+#ifndef HAL_TIMEBASE_H_INCLUDED
+#define HAL_TIMEBASE_H_INCLUDED
+
+#include <hal/common.h>
+#include <hal/cycle.h>
+
+/**@{*/
+
+/*****************************************************************************/
+/* API definitions                                                           */
+/*****************************************************************************/
+
+/* Upper part of the time, and the counter value seen by the handler */
+struct _timebase_slot {
+	uint32_t high;
+	uint32_t last;
+};
+
+struct _timebase {
+	volatile uint32_t seq;
+	volatile struct _timebase_slot slot[2];
+	uint64_t us_mul;	/* 32.32 fixed point, microseconds per cycle, <= 1 */
+	uint64_t cycles_mul;	/* 32.32 fixed point, cycles per microsecond */
+};
+
+/*****************************************************************************/
+/* API Functions                                                             */
+/*****************************************************************************/
+
+BEGIN_DECLS
+
+/*---------------------------------------------------------------------------*/
+/** @brief Start the timebase from zero
+ *
+ * Enables the cycle counter, and precomputes the conversion factors.
+ *
+ * @param[in] cpufreq CPU frequency in Hz, at least 1MHz
+ */
+static void timebase_init(uint32_t cpufreq);
+
+/*---------------------------------------------------------------------------*/
+/** @brief Maintain the upper part of the timebase
+ *
+ * Must be called from the SysTick interrupt handler.
+ */
+static void timebase_isr(void);
+
+/*---------------------------------------------------------------------------*/
+/** @brief Get the actual time in cycles
+ *
+ * @returns cycles elapsed since @ref timebase_init
+ */
+static uint64_t timebase_now(void);
+
+/*---------------------------------------------------------------------------*/
+/** @brief Get the lower 32 bits of the actual time in cycles
+ *
+ * Cheaper than @ref timebase_now, the differences of the values are valid
+ * for intervals shorter than 2^32 cycles.
+ *
+ * @returns cycles elapsed since @ref timebase_init, modulo 2^32
+ */
+static uint32_t timebase_now32(void);
+
+/*---------------------------------------------------------------------------*/
+/** @brief Get the actual time in microseconds
+ *
+ * @returns microseconds elapsed since @ref timebase_init
+ */
+static uint64_t timebase_now_us(void);
+
+/*---------------------------------------------------------------------------*/
+/** @brief Convert cycles to microseconds
+ *
+ * Uses the factor precomputed by @ref timebase_init. The factor is rounded
+ * up, so the whole microseconds do not fall one short; the result may
+ * exceed the exact value rounded down by 1us, plus 1us per 2^32 cycles.
+ *
+ * @param[in] cycles cycle count
+ * @returns microseconds
+ */
+static uint64_t timebase_cycles_to_us(uint64_t cycles);
+
+/*---------------------------------------------------------------------------*/
+/** @brief Convert microseconds to cycles
+ *
+ * Uses the factor precomputed by @ref timebase_init. The factor is rounded
+ * down, so the result may be below the exact value by up to 2 cycles.
+ *
+ * @param[in] us microseconds
+ * @returns cycle count
+ */
+static uint64_t timebase_us_to_cycles(uint32_t us);
+
+END_DECLS
+
+/**@}*/
+
+/*****************************************************************************/
+/* Architecture dependent implementations                                    */
+/*****************************************************************************/
+
+/* The state shared by all units */
+__attribute__((weak)) struct _timebase _timebase_state;
+
+#if CYCLE_COUNTER_BITS == 24
+# include <hal/arch/stm32/timebase_systick.h>
+#else
+# include <hal/arch/stm32/timebase_dwt.h>
+#endif
+
+INLINE void timebase_init(uint32_t cpufreq)
+{
+	/* rounded up, so the whole microseconds do not fall one short */
+	/* 2^32 at 1MHz, the 64 bits keep it */
+	_timebase_state.us_mul = ((1000000ULL << 32) + cpufreq - 1) / cpufreq;
+	_timebase_state.cycles_mul = ((uint64_t)cpufreq << 32) / 1000000;
+	_timebase_state.slot[0].high = 0;
+	_timebase_state.slot[0].last = 0;
+	_timebase_state.seq = 0;
+
+	_timebase_start();
+}
+
+/* Writes the slot not visible to the readers, then flips the sequence */
+INLINE void timebase_isr(void)
+{
+	const uint32_t seq = _timebase_state.seq;
+	const uint32_t low = cycle_counter_get();
+	volatile struct _timebase_slot *cur = &_timebase_state.slot[seq & 1];
+	volatile struct _timebase_slot *next = &_timebase_state.slot[~seq & 1];
+
+	next->high = cur->high + _timebase_isr_wrapped(low, cur->last);
+	next->last = low;
+	_timebase_state.seq = seq + 1;
+}
+
+/* Accounts the counter wraps missed by the handler, interrupts masked */
+INLINE void _timebase_add_wraps(uint32_t wraps)
+{
+	const uint32_t seq = _timebase_state.seq;
+	volatile struct _timebase_slot *cur = &_timebase_state.slot[seq & 1];
+	volatile struct _timebase_slot *next = &_timebase_state.slot[~seq & 1];
+
+	next->high = cur->high + wraps;
+	next->last = cur->last;
+	_timebase_state.seq = seq + 1;
+}
+
+/* Reads the counter into low, returns the matching upper part */
+INLINE uint32_t _timebase_read(uint32_t *low)
+{
+	uint32_t seq, high;
+
+	do {
+		seq = _timebase_state.seq;
+		high = _timebase_state.slot[seq & 1].high;
+		*low = cycle_counter_get();
+		high += _timebase_read_wrapped(*low,
+					_timebase_state.slot[seq & 1].last);
+	} while (seq != _timebase_state.seq);
+
+	return high;
+}
+
+INLINE uint64_t timebase_now(void)
+{
+	uint32_t low;
+	const uint32_t high = _timebase_read(&low);
+
+	return ((uint64_t)high << CYCLE_COUNTER_BITS) | low;
+}
+
+INLINE uint64_t timebase_now_us(void)
+{
+	return timebase_cycles_to_us(timebase_now());
+}
+
+INLINE uint64_t timebase_cycles_to_us(uint64_t cycles)
+{
+	const uint64_t mul = _timebase_state.us_mul;
+
+	return (cycles >> 32) * mul + (((cycles & 0xFFFFFFFFULL) * mul) >> 32);
+}
+
+INLINE uint64_t timebase_us_to_cycles(uint32_t us)
+{
+	const uint64_t mul = _timebase_state.cycles_mul;
+
+	return (uint64_t)us * (mul >> 32) +
+	       (((uint64_t)us * (mul & 0xFFFFFFFFULL)) >> 32);
+}
+
+#endif /* HAL_TIMEBASE_H_INCLUDED */
@@ -0,0 +1,374 @@
+/*
+ * This file is part of the HAL project, inline library above libopencm3.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/** @defgroup TOUCH_module TOUCH module
+ *
+ * @brief Capacitive touch pads sensed by the charge time
+ *
+ * @ingroup modules
+ *
+ * LGPL License Terms @ref lgpl_license
+ *
+ * Every pad is a pin with a resistor to VDD (about 1M, or the internal
+ * pull-up by @ref pin_pull_up for large pads, not on STM32F1). All pads of
+ * one port are discharged together by driving them low, released together
+ * by one mode register store, and the IDR register is polled until all of
+ * them read high. The @ref cycle_counter_get time of the crossing is
+ * recorded for every pad as it comes, so one pass measures the whole port;
+ * the touch adds capacitance and delays the crossing.
+ *
+ * The measured times are compared to the baseline of every pad with
+ * hysteresis and debouncing. The baseline follows slow drift of untouched
+ * pads (temperature, humidity), faster downwards than upwards, and is reset
+ * when the pad seems touched for too long.
+ *
+ * Interrupts are masked during the release and polling of every port, which
+ * takes the longest charge time of its pads. The scan takes the discharge
+ * and the longest charge time for every port, tens of microseconds per port
+ * with 1M resistors and pads of tens of pF.
+ */
+#ifndef HAL_TOUCH_H_INCLUDED
+#define HAL_TOUCH_H_INCLUDED
+
+#include <hal/common.h>
+#include <hal/pin.h>
+#include <hal/cycle.h>
+#include <libopencm3/cm3/cortex.h>
+
+/**@{*/
+
+/*****************************************************************************/
+/* API definitions                                                           */
+/*****************************************************************************/
+
+/** Max count of pads, at most 32 */
+#ifndef TOUCH_MAX_PADS
+#define TOUCH_MAX_PADS		24
+#endif
+
+/** Max count of ports with pads */
+#ifndef TOUCH_MAX_PORTS
+#define TOUCH_MAX_PORTS		3
+#endif
+
+/** Cycles of the discharge before the release */
+#ifndef TOUCH_DISCHARGE_CYCLES
+#define TOUCH_DISCHARGE_CYCLES	200
+#endif
+
+/** Polls of the port before the pads not crossing are given up */
+#ifndef TOUCH_TIMEOUT_POLLS
+#define TOUCH_TIMEOUT_POLLS	10000
+#endif
+
+/** Consecutive scans changing the state of the pad */
+#ifndef TOUCH_DEBOUNCE
+#define TOUCH_DEBOUNCE		2
+#endif
+
+/** Baseline follows the untouched pad by 1/2^TOUCH_DRIFT_SHIFT per scan */
+#ifndef TOUCH_DRIFT_SHIFT
+#define TOUCH_DRIFT_SHIFT	6
+#endif
+
+/** Scans of continuous touch resetting the baseline, 0 to disable */
+#ifndef TOUCH_STUCK_SCANS
+#define TOUCH_STUCK_SCANS	2000
+#endif
+
+#if TOUCH_MAX_PADS > 32
+# error "hal/touch.h: TOUCH_MAX_PADS must be at most 32"
+#endif
+
+/* Fractional bits of the baseline */
+#define _TOUCH_FRAC		4
+
+struct touch_pad {
+	uint32_t raw;		/* cycles of the last charge */
+	int32_t baseline;	/* cycles << 4 */
+	uint16_t stuck;		/* scans of the continuous touch */
+	uint8_t count;		/* scans of the opposite state */
+	uint8_t touched;
+};
+
+struct touch_port {
+	uint32_t port;
+	uint32_t mask;
+	uint8_t pad[16];	/* pad index of the pin */
+};
+
+struct touch_panel {
+	uint32_t count;		/* count of pads */
+	uint32_t ports;		/* count of ports */
+	uint32_t on;		/* delta of the touch, cycles */
+	uint32_t off;		/* delta of the release, cycles */
+	uint32_t touched;	/* bit mask of touched pads */
+	struct touch_port port[TOUCH_MAX_PORTS];
+	struct touch_pad pad[TOUCH_MAX_PADS];
+};
+
+/*****************************************************************************/
+/* API Functions                                                             */
+/*****************************************************************************/
+
+BEGIN_DECLS
+
+/*---------------------------------------------------------------------------*/
+/** @brief Configure the pads, and leave them discharged
+ *
+ * The pad index is its position in @p pins. The cycle counter must be
+ * enabled. The thresholds are the charge time increase over the baseline,
+ * @p off must be lower than @p on.
+ *
+ * @param[out] panel panel
+ * @param[in] pins pin names of the pads (@ref pin_name_base)
+ * @param[in] count count of pads, at most TOUCH_MAX_PADS
+ * @param[in] on delta of the touch, cycles
+ * @param[in] off delta of the release, cycles
+ * @returns false when there are more than TOUCH_MAX_PADS pads, or they span
+ * more than TOUCH_MAX_PORTS ports
+ */
+static bool touch_init(struct touch_panel *panel, const uint32_t *pins,
+		       uint32_t count, uint32_t on, uint32_t off);
+
+/*---------------------------------------------------------------------------*/
+/** @brief Measure the charge time of all pads
+ *
+ * Only the raw values are updated.
+ *
+ * @param[inout] panel panel
+ */
+static void touch_measure(struct touch_panel *panel);
+
+/*---------------------------------------------------------------------------*/
+/** @brief Set the baselines to the average of the measurements
+ *
+ * The pads must not be touched.
+ *
+ * @param[inout] panel panel
+ * @param[in] scans count of measurements, 1..256
+ */
+static void touch_calibrate(struct touch_panel *panel, uint32_t scans);
+
+/*---------------------------------------------------------------------------*/
+/** @brief Measure the pads, update the states and baselines
+ *
+ * @param[inout] panel panel
+ * @returns bit mask of the touched pads
+ */
+static uint32_t touch_scan(struct touch_panel *panel);
+
+/*---------------------------------------------------------------------------*/
+/** @brief Get the charge time increase of the pad over its baseline
+ *
+ * @param[in] panel panel
+ * @param[in] pad pad index
+ * @returns delta in cycles, negative below the baseline
+ */
+static int32_t touch_delta(const struct touch_panel *panel, uint32_t pad);
+
+END_DECLS
+
+/**@}*/
+
+/*****************************************************************************/
+/* API implementations                                                       */
+/*****************************************************************************/
+
+#if defined(HAL_PIN_STM32_V0_H_INCLUDED)
+# define _TOUCH_MODE_IN		(GPIO_MODE_INPUT | \
+				 (GPIO_CNF_INPUT_FLOAT << 2))
+# define _TOUCH_MODE_OUT	(GPIO_MODE_OUTPUT_50_MHZ | \
+				 (GPIO_CNF_OUTPUT_PUSHPULL << 2))
+#else
+# define _TOUCH_MODE_IN		GPIO_MODE_INPUT
+# define _TOUCH_MODE_OUT	GPIO_MODE_OUTPUT
+#endif
+
+INLINE bool touch_init(struct touch_panel *panel, const uint32_t *pins,
+		       uint32_t count, uint32_t on, uint32_t off)
+{
+	struct touch_port *tp;
+	uint32_t i, j, port;
+
+	if (count > TOUCH_MAX_PADS)
+		return false;
+
+	panel->count = count;
+	panel->ports = 0;
+	panel->on = on;
+	panel->off = off;
+	panel->touched = 0;
+
+	for (i = 0; i < count; i++) {
+		port = _pin_port(pins[i]);
+		for (j = 0; j < panel->ports; j++)
+			if (panel->port[j].port == port)
+				break;
+
+		if (j == panel->ports) {
+			if (j == TOUCH_MAX_PORTS)
+				return false;
+			panel->port[j].port = port;
+			panel->port[j].mask = 0;
+			panel->ports++;
+		}
+
+		tp = &panel->port[j];
+		tp->mask |= _pin_pin(pins[i]);
+		tp->pad[_pin_pinno(pins[i])] = (uint8_t)i;
+
+		panel->pad[i].raw = 0;
+		panel->pad[i].baseline = 0;
+		panel->pad[i].stuck = 0;
+		panel->pad[i].count = 0;
+		panel->pad[i].touched = 0;
+
+		pin_clock_enable(pins[i]);
+		pin_set(pins[i], false);
+		pin_output_pushpull(pins[i]);
+	}
+
+	return true;
+}
+
+INLINE void _touch_measure_port(struct touch_panel *panel,
+				const struct touch_port *tp)
+{
+	const uint32_t port = tp->port;
+	const uint32_t mask = tp->mask;
+	uint32_t pending = mask;
+	uint32_t polls = TOUCH_TIMEOUT_POLLS;
+	uint32_t start, now, crossed, bit, irq;
+
+	GPIO_BSRR(port) = mask << 16;
+	_pin_port_setmode(port, mask, _TOUCH_MODE_OUT);
+	start = cycle_counter_get();
+	while (cycle_diff(start, cycle_counter_get()) < TOUCH_DISCHARGE_CYCLES);
+
+	irq = cm_mask_interrupts(1);
+	_pin_port_setmode(port, mask, _TOUCH_MODE_IN);
+	start = cycle_counter_get();
+
+	while (pending != 0 && polls-- != 0) {
+		crossed = GPIO_IDR(port) & pending;
+		if (crossed == 0)
+			continue;
+
+		now = cycle_diff(start, cycle_counter_get());
+		pending &= ~crossed;
+		do {
+			bit = __builtin_ctz(crossed);
+			crossed &= crossed - 1;
+			panel->pad[tp->pad[bit]].raw = now;
+		} while (crossed != 0);
+	}
+
+	_pin_port_setmode(port, mask, _TOUCH_MODE_OUT);
+	cm_mask_interrupts(irq);
+
+	/* timed out pads */
+	now = cycle_diff(start, cycle_counter_get());
+	while (pending != 0) {
+		bit = __builtin_ctz(pending);
+		pending &= pending - 1;
+		panel->pad[tp->pad[bit]].raw = now;
+	}
+}
+
+INLINE void touch_measure(struct touch_panel *panel)
+{
+	uint32_t i;
+
+	for (i = 0; i < panel->ports; i++)
+		_touch_measure_port(panel, &panel->port[i]);
+}
+
+INLINE void touch_calibrate(struct touch_panel *panel, uint32_t scans)
+{
+	uint32_t i, n;
+
+	for (i = 0; i < panel->count; i++)
+		panel->pad[i].baseline = 0;
+
+	for (n = 0; n < scans; n++) {
+		touch_measure(panel);
+		for (i = 0; i < panel->count; i++)
+			panel->pad[i].baseline +=
+				(int32_t)(panel->pad[i].raw << _TOUCH_FRAC);
+	}
+
+	for (i = 0; i < panel->count; i++) {
+		panel->pad[i].baseline /= (int32_t)scans;
+		panel->pad[i].stuck = 0;
+		panel->pad[i].count = 0;
+		panel->pad[i].touched = 0;
+	}
+
+	panel->touched = 0;
+}
+
+INLINE int32_t touch_delta(const struct touch_panel *panel, uint32_t pad)
+{
+	const struct touch_pad *p = &panel->pad[pad];
+
+	return ((int32_t)(p->raw << _TOUCH_FRAC) - p->baseline) >> _TOUCH_FRAC;
+}
+
+INLINE void _touch_update(struct touch_panel *panel, uint32_t i)
+{
+	struct touch_pad *p = &panel->pad[i];
+	const int32_t diff = (int32_t)(p->raw << _TOUCH_FRAC) - p->baseline;
+	const int32_t delta = diff >> _TOUCH_FRAC;
+	bool change;
+
+	change = p->touched ? (delta < (int32_t)panel->off) :
+			      (delta > (int32_t)panel->on);
+	p->count = change ? (uint8_t)(p->count + 1) : 0;
+
+	if (p->count >= TOUCH_DEBOUNCE) {
+		p->count = 0;
+		p->stuck = 0;
+		p->touched = !p->touched;
+		panel->touched ^= 1UL << i;
+	}
+
+	if (!p->touched) {
+		/* the drift down is followed faster, it does not hide touch */
+		if (p->count == 0)
+			p->baseline += (diff < 0) ? diff >> 2 :
+						    diff >> TOUCH_DRIFT_SHIFT;
+	} else if (TOUCH_STUCK_SCANS != 0 && ++p->stuck >= TOUCH_STUCK_SCANS) {
+		p->baseline = (int32_t)(p->raw << _TOUCH_FRAC);
+		p->stuck = 0;
+		p->touched = 0;
+		panel->touched &= ~(1UL << i);
+	}
+}
+
+INLINE uint32_t touch_scan(struct touch_panel *panel)
+{
+	uint32_t i;
+
+	touch_measure(panel);
+
+	for (i = 0; i < panel->count; i++)
+		_touch_update(panel, i);
+
+	return panel->touched;
+}
+
+#endif /* HAL_TOUCH_H_INCLUDED */
@@ -0,0 +1,274 @@
+/*
+ * This file is part of the HAL project, inline library above libopencm3.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/*
+ * Host stress test of hal/atomic.h against a register model
+ *
+ * The tested operations run single-stepped by the x86 trap flag, and the
+ * SIGTRAP handler takes the test interrupt after pseudo-random instructions,
+ * so it lands between any two instructions of the tested code. The interrupt
+ * does a plain read-modify-write of its own bits of the register, as the
+ * interrupt handler reconfiguring other pin of the same port does.
+ *
+ * The LDREX/STREX path (Cortex-M3/M4/M7) runs on the model of the local
+ * exclusive monitor: the interrupt clears it, as the exception entry does,
+ * and the store is one step. The PRIMASK path (Cortex-M0/M0+) holds the
+ * interrupt pending while masked, and takes it when unmasked.
+ *
+ * The plain read-modify-write runs as the control, and must show lost
+ * updates, proving the model hits the window. _pin_modify forwards to
+ * atomic_modify32 with HAL_PIN_ATOMIC, so the test covers it too.
+ *
+ * Build and run from the repository root on the x86-64 Linux host, for both
+ * paths:
+ *
+ *	gcc -O2 -Wall -Iinclude -Itests/stub -D__ARM_ARCH_7M__ \
+ *		tests/atomic_host.c -o atomic_ldrex && ./atomic_ldrex
+ *	gcc -O2 -Wall -Iinclude -Itests/stub \
+ *		tests/atomic_host.c -o atomic_primask && ./atomic_primask
+ *
+ * Exits with nonzero status on any lost update of the atomic operations.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+
+#if !defined(__x86_64__) || !defined(__linux__)
+# error "tests/atomic_host.c: x86-64 Linux host needed for single-stepping"
+#endif
+
+#include <libopencm3/cm3/cortex.h>
+
+volatile uint32_t host_primask;
+
+#if defined(__ARM_ARCH_7M__)
+
+#define HAL_ATOMIC_HOST_MODEL
+
+/* Local exclusive monitor, cleared by the exception entry */
+static volatile uint32_t monitor;
+
+static inline uint32_t _atomic_ldrex(volatile uint32_t *addr)
+{
+	monitor = 1;
+	__asm__ __volatile__ ("" : : : "memory");
+	return *addr;
+}
+
+/* The store instruction is not interruptible */
+static inline uint32_t _atomic_strex(volatile uint32_t *addr,
+				     const uint32_t val)
+{
+	const uint32_t mask = cm_mask_interrupts(1);
+	uint32_t fail = 1;
+
+	if (monitor) {
+		*addr = val;
+		monitor = 0;
+		fail = 0;
+	}
+
+	cm_mask_interrupts(mask);
+	return fail;
+}
+
+static inline void _atomic_clrex(void)
+{
+	monitor = 0;
+}
+
+# define PATH	"LDREX/STREX"
+#else
+# define PATH	"PRIMASK"
+#endif
+
+#include <hal/atomic.h>
+
+#define ROUNDS		10000
+
+/* The register, main code owns the low half, the interrupt the high half */
+static volatile uint32_t reg;
+
+static volatile uint32_t irq_count;
+static volatile uint32_t irq_lost;	/* interrupt bits lost by main code */
+static volatile uint32_t irq_mode;	/* 0: add, 1: fields */
+static volatile uint32_t irq_pending;
+static volatile uint32_t irq_active;
+static uint32_t seed = 1;
+
+static void irq_body(void)
+{
+	uint32_t v;
+
+	irq_active = 1;
+#if defined(__ARM_ARCH_7M__)
+	monitor = 0;
+#endif
+
+	if (irq_mode == 0) {
+		reg += 0x10000;
+	} else {
+		/* the interrupt finds its last write, unless it was lost */
+		v = reg;
+		if ((v >> 16) != (irq_count & 0xFFFF))
+			irq_lost++;
+		reg = (v & 0xFFFF) | (((irq_count + 1) & 0xFFFF) << 16);
+	}
+
+	irq_count++;
+	irq_active = 0;
+}
+
+void host_irq_unmasked(void)
+{
+	while (irq_pending && !irq_active) {
+		irq_pending = 0;
+		irq_body();
+	}
+}
+
+/* Runs after every single-stepped instruction */
+static void trap_handler(int sig)
+{
+	(void)sig;
+
+	seed = seed * 1103515245 + 12345;
+	if ((seed >> 16) % 16 != 0)
+		return;
+
+	if (host_primask || irq_active)
+		irq_pending = 1;
+	else
+		irq_body();
+}
+
+/* Leaf functions without locals, the pushes do not hit the red zone */
+static void __attribute__((noinline)) trace_on(void)
+{
+	__asm__ __volatile__ ("pushfq\n\torq $0x100, (%%rsp)\n\tpopfq"
+			      : : : "memory", "cc");
+}
+
+static void __attribute__((noinline)) trace_off(void)
+{
+	__asm__ __volatile__ ("pushfq\n\tandq $~0x100, (%%rsp)\n\tpopfq"
+			      : : : "memory", "cc");
+}
+
+static void __attribute__((noinline)) plain_modify(volatile uint32_t *addr,
+						   uint32_t clear,
+						   uint32_t set)
+{
+	*addr = (*addr & ~clear) | set;
+}
+
+/* Fields test, returns the count of lost updates */
+static uint32_t run_fields(bool atomic)
+{
+	uint32_t i, lost_main = 0;
+
+	irq_mode = 1;
+	irq_lost = 0;
+	reg = (irq_count & 0xFFFF) << 16;
+
+	for (i = 0; i < ROUNDS; i++) {
+		trace_on();
+		if (atomic)
+			atomic_modify32(&reg, 0xFFFF, i & 0xFFFF);
+		else
+			plain_modify(&reg, 0xFFFF, i & 0xFFFF);
+		trace_off();
+
+		if ((reg & 0xFFFF) != (i & 0xFFFF))
+			lost_main++;
+	}
+
+	return irq_lost + lost_main;
+}
+
+/* Difference of the counter from the expected value */
+static uint32_t counter_lost(uint32_t irq_start)
+{
+	const uint32_t expected = ROUNDS + (irq_count - irq_start) * 0x10000;
+
+	return (reg - expected) != 0;
+}
+
+/* Counter test, returns nonzero on lost updates */
+static uint32_t run_add(void)
+{
+	const uint32_t irq_start = irq_count;
+	uint32_t i;
+
+	irq_mode = 0;
+	reg = 0;
+
+	for (i = 0; i < ROUNDS; i++) {
+		trace_on();
+		atomic_add32(&reg, 1);
+		trace_off();
+	}
+
+	return counter_lost(irq_start);
+}
+
+/* Compare-and-swap counter test, returns nonzero on lost updates */
+static uint32_t run_cas(void)
+{
+	const uint32_t irq_start = irq_count;
+	uint32_t i, old;
+
+	irq_mode = 0;
+	reg = 0;
+
+	for (i = 0; i < ROUNDS; i++) {
+		trace_on();
+		do {
+			old = reg;
+		} while (!atomic_cas32(&reg, old, old + 1));
+		trace_off();
+	}
+
+	return counter_lost(irq_start);
+}
+
+int main(void)
+{
+	struct sigaction sa = { .sa_handler = trap_handler };
+	uint32_t control, fields, add, cas;
+
+	sigaction(SIGTRAP, &sa, NULL);
+
+	control = run_fields(false);
+	fields = run_fields(true);
+	add = run_add();
+	cas = run_cas();
+
+	printf("%s: %u interrupts\n", PATH, irq_count);
+	printf("  plain read-modify-write (control): %u lost\n", control);
+	printf("  atomic_modify32: %u lost\n", fields);
+	printf("  atomic_add32: %s\n", add ? "lost updates" : "ok");
+	printf("  atomic_cas32: %s\n", cas ? "lost updates" : "ok");
+
+	if (control == 0) {
+		printf("  the control lost nothing, the model missed the "
+		       "window\n");
+		return EXIT_FAILURE;
+	}
+
+	return (fields || add || cas) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,305 @@
+/*
+ * This file is part of the HAL project, inline library above libopencm3.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/*
+ * Host replay of the IR receiver traces to hal/ir.h
+ *
+ * The traces of (timestamp, level) of the active low receiver output are
+ * synthesized at 72MHz, with the 24-bit counter of STM32F0/L0, the shorter
+ * one, starting just below its wrap. They are fed to ir_rx_edge, with
+ * ir_rx_idle called every 1 ms during the idle line, and the frames read by
+ * ir_rx_get are checked:
+ *
+ * - NEC frames with 8 and 16-bit addresses, and the repeat codes 40 and
+ *   100 ms apart accepted, 300 ms apart ignored, and 200 ms apart ignored
+ *   without the ir_rx_idle calls
+ * - RC5 frames with the toggle bit and the repeats, and the RC5X commands
+ *   with the bit 6 from the inverted field bit
+ * - SIRC frames of 12, 15 and 20 bits ended by ir_rx_idle, and the repeats
+ *
+ * Build and run from the repository root:
+ *
+ *	gcc -O2 -Wall -Iinclude -Itests/stub tests/ir_host.c \
+ *		-o ir_host && ./ir_host
+ *
+ * Exits with nonzero status on a wrong frame.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <libopencm3/cm3/common.h>
+
+/* The 24-bit counter replaces hal/cycle.h, the trace replaces hal/pin.h */
+#define HAL_CYCLE_H_INCLUDED
+#define HAL_PIN_H_INCLUDED
+
+#define CYCLE_COUNTER_BITS	24
+#define CYCLE_COUNTER_MASK	((1UL << CYCLE_COUNTER_BITS) - 1)
+
+volatile uint32_t host_exti_pr;
+
+static uint32_t now;		/* cycles, not wrapped */
+
+static inline uint32_t cycle_counter_get(void)
+{
+	return now & CYCLE_COUNTER_MASK;
+}
+
+static inline uint32_t cycle_diff(const uint32_t from, const uint32_t to)
+{
+	return (to - from) & CYCLE_COUNTER_MASK;
+}
+
+static inline uint32_t _pin_pin(uint32_t pin)
+{
+	return 1UL << (pin & 15);
+}
+
+static inline uint32_t _pin_port(uint32_t pin)
+{
+	return pin / 16;
+}
+
+static bool line = true;	/* receiver output, high when idle */
+
+static inline bool pin_get(uint32_t pin)
+{
+	(void)pin;
+	return line;
+}
+
+#include <hal/ir.h>
+
+#define CPU_MHZ		72
+
+static struct ir_rx rx;
+static uint32_t failed;
+
+/* Drives the mark or space for the time, edge when the level changes */
+static void send(bool mark, uint32_t us)
+{
+	if (line != !mark) {
+		line = !mark;
+		ir_rx_edge(&rx, cycle_counter_get(), line);
+	}
+
+	now += us * CPU_MHZ;
+}
+
+/* Idle line, ir_rx_idle called every 1 ms */
+static void idle(uint32_t ms)
+{
+	send(false, 0);
+	while (ms--) {
+		now += 1000 * CPU_MHZ;
+		ir_rx_idle(&rx, cycle_counter_get());
+	}
+}
+
+static void nec_frame(uint32_t data)
+{
+	uint32_t i;
+
+	send(true, 9000);
+	send(false, 4500);
+	for (i = 0; i < 32; i++) {
+		send(true, 562);
+		send(false, (data >> i) & 1 ? 1687 : 562);
+	}
+	send(true, 562);
+	send(false, 0);
+}
+
+static void nec_repeat(void)
+{
+	send(true, 9000);
+	send(false, 2250);
+	send(true, 562);
+	send(false, 0);
+}
+
+/* 1 is space then mark, the first half of the first start bit is idle */
+static void rc5_frame(bool toggle, uint32_t address, uint32_t command)
+{
+	const uint32_t d = (1UL << 13) | (!(command & 0x40) << 12) |
+			   (toggle << 11) | ((address & 0x1F) << 6) |
+			   (command & 0x3F);
+	int i;
+
+	for (i = 13; i >= 0; i--) {
+		send(!((d >> i) & 1), 889);
+		send((d >> i) & 1, 889);
+	}
+	send(false, 0);
+}
+
+/* Command 7 bits, address 5, 8 or 13 bits, LSB first */
+static void sirc_frame(uint32_t bits, uint32_t address, uint32_t command)
+{
+	const uint32_t d = (command & 0x7F) | (address << 7);
+	uint32_t i;
+
+	send(true, 2400);
+	for (i = 0; i < bits; i++) {
+		send(false, 600);
+		send(true, (d >> i) & 1 ? 1200 : 600);
+	}
+	send(false, 0);
+}
+
+/* Reads exactly one frame, and checks it */
+static void expect(const char *name, uint8_t protocol, uint8_t bits,
+		   uint16_t address, uint16_t command, uint8_t repeat,
+		   uint8_t toggle)
+{
+	struct ir_frame f;
+
+	if (!ir_rx_get(&rx, &f)) {
+		printf("%s: no frame\n", name);
+		failed++;
+		return;
+	}
+
+	if (f.protocol != protocol || f.bits != bits ||
+	    f.address != address || f.command != command ||
+	    f.repeat != repeat || f.toggle != toggle) {
+		printf("%s: protocol %u bits %u address %x command %x "
+		       "repeat %u toggle %u\n", name, f.protocol, f.bits,
+		       f.address, f.command, f.repeat, f.toggle);
+		failed++;
+	}
+
+	if (ir_rx_get(&rx, &f)) {
+		printf("%s: extra frame\n", name);
+		failed++;
+	}
+}
+
+static void expect_none(const char *name)
+{
+	struct ir_frame f;
+
+	if (ir_rx_get(&rx, &f)) {
+		printf("%s: unexpected frame\n", name);
+		failed++;
+	}
+}
+
+static void test_nec(void)
+{
+	/* address 0x10 with its complement, command 0x22 */
+	const uint32_t d8 = 0x10 | (0xEF << 8) | (0x22 << 16) | (0xDDUL << 24);
+	/* extended address 0x1234 */
+	const uint32_t d16 = 0x1234 | (0x56UL << 16) | (0xA9UL << 24);
+
+	ir_rx_init(&rx, CPU_MHZ * 1000000, false);
+
+	idle(10);
+	nec_frame(d8);
+	expect("NEC", IR_NEC, 32, 0x10, 0x22, 0, 0);
+
+	idle(40);
+	nec_repeat();
+	expect("NEC repeat 40 ms", IR_NEC, 32, 0x10, 0x22, 1, 0);
+
+	idle(100);
+	nec_repeat();
+	expect("NEC repeat 100 ms", IR_NEC, 32, 0x10, 0x22, 1, 0);
+
+	idle(300);
+	nec_repeat();
+	expect_none("NEC repeat 300 ms");
+
+	idle(10);
+	nec_frame(d16);
+	expect("NEC extended", IR_NEC, 32, 0x1234, 0x56, 0, 0);
+
+	/* without the idle calls, shorter than the 24-bit wrap at 72MHz */
+	now += 200000 * CPU_MHZ;
+	nec_repeat();
+	expect_none("NEC repeat 200 ms, no idle");
+}
+
+static void test_rc5(void)
+{
+	ir_rx_init(&rx, CPU_MHZ * 1000000, false);
+
+	idle(10);
+	rc5_frame(false, 5, 0x35);
+	expect("RC5", IR_RC5, 14, 5, 0x35, 0, 0);
+
+	idle(100);
+	rc5_frame(false, 5, 0x35);
+	expect("RC5 repeat", IR_RC5, 14, 5, 0x35, 1, 0);
+
+	idle(100);
+	rc5_frame(true, 5, 0x35);
+	expect("RC5 toggle", IR_RC5, 14, 5, 0x35, 0, 1);
+
+	idle(100);
+	rc5_frame(false, 0x1F, 0x45);
+	expect("RC5X", IR_RC5, 14, 0x1F, 0x45, 0, 0);
+
+	idle(100);
+	rc5_frame(true, 0, 0x7F);
+	expect("RC5X toggle", IR_RC5, 14, 0, 0x7F, 0, 1);
+}
+
+static void test_sirc(void)
+{
+	ir_rx_init(&rx, CPU_MHZ * 1000000, false);
+
+	idle(10);
+	sirc_frame(12, 0x01, 0x15);
+	idle(10);
+	expect("SIRC 12", IR_SIRC, 12, 0x01, 0x15, 0, 0);
+
+	sirc_frame(12, 0x01, 0x15);
+	idle(10);
+	expect("SIRC 12 repeat", IR_SIRC, 12, 0x01, 0x15, 1, 0);
+
+	sirc_frame(15, 0xA4, 0x7F);
+	idle(10);
+	expect("SIRC 15", IR_SIRC, 15, 0xA4, 0x7F, 0, 0);
+
+	sirc_frame(20, 0x1ABC, 0x2A);
+	idle(10);
+	expect("SIRC 20", IR_SIRC, 20, 0x1ABC, 0x2A, 0, 0);
+
+	idle(200);
+	sirc_frame(20, 0x1ABC, 0x2A);
+	idle(10);
+	expect("SIRC 20 after 200 ms", IR_SIRC, 20, 0x1ABC, 0x2A, 0, 0);
+}
+
+int main(void)
+{
+	/* the traces wrap the counter early */
+	now = CYCLE_COUNTER_MASK - 5000 * CPU_MHZ;
+
+	test_nec();
+	test_rc5();
+	test_sirc();
+
+	if (rx.overruns != 0) {
+		printf("queue overruns\n");
+		failed++;
+	}
+
+	printf("%s\n", failed ? "FAILED" : "all frames decoded");
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
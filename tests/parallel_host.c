@@ -0,0 +1,332 @@
+/*
+ * This file is part of the HAL project, inline library above libopencm3.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/*
+ * Host replay of hal/parallel.h against a timed register model of the IDR
+ *
+ * The capture loops of parallel_read8 and parallel_read16 run unchanged on
+ * the host. The IDR registers are on pages without access, so every read
+ * faults: the SIGSEGV handler advances the model time by the cycles the
+ * target spends since the previous read, stores the value of the signals at
+ * that time, and single-steps the read by the x86 trap flag; the SIGTRAP
+ * handler revokes the access again.
+ *
+ * The cycles follow the polling loop as compiled for the core, with the
+ * instruction timings of the Cortex-M0 and Cortex-M3 technical reference
+ * manuals, and the GPIO load latency of the bus of the family. The model
+ * mirrors the loop: the poll taken again, the poll falling through to the
+ * next wait, and the store of the sample after the active edge, with the
+ * loop overhead every 4 samples. Cortex-M4 and M7 use the M3 timings, the
+ * dual issue of M7 is not modeled.
+ *
+ * The pixel clock has the data changing on the falling edge and sampled on
+ * the rising edge, at the random phase against the CPU clock. Every family
+ * of the table in hal/parallel.h is replayed at its documented PCLK max,
+ * with PCLK on the data port and on another port, and must capture every
+ * sample. The highest rate passing is printed for comparison.
+ *
+ * Build and run from the repository root on the x86-64 Linux host:
+ *
+ *	gcc -O2 -Wall -Iinclude -Itests/stub tests/parallel_host.c \
+ *		-o parallel_host && ./parallel_host
+ *
+ * Exits with nonzero status when a documented rate loses samples.
+ */
+
+#define _GNU_SOURCE		/* REG_EFL */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <ucontext.h>
+#include <sys/mman.h>
+
+#if !defined(__x86_64__) || !defined(__linux__)
+# error "tests/parallel_host.c: x86-64 Linux host needed for single-stepping"
+#endif
+
+#include <libopencm3/cm3/common.h>
+
+/* The register model replaces hal/pin.h, pins are port * 16 + bit */
+#define HAL_PIN_H_INCLUDED
+
+#define MODEL_PORTS	2
+#define MODEL_PIN(port, bit)	((port) * 16 + (bit))
+
+static uint8_t *model_page[MODEL_PORTS];
+
+#define GPIO_IDR(port)	(*(volatile uint32_t *)(uintptr_t)((port) + 0x10))
+
+static inline uint32_t _pin_port(uint32_t pin)
+{
+	return (uint32_t)(uintptr_t)model_page[pin / 16];
+}
+
+static inline uint32_t _pin_pinno(uint32_t pin)
+{
+	return pin & 15;
+}
+
+static inline uint32_t _pin_pin(uint32_t pin)
+{
+	return 1UL << (pin & 15);
+}
+
+static inline void pin_input(uint32_t pin)
+{
+	(void)pin;
+}
+
+#include <hal/parallel.h>
+
+#define SAMPLES		256
+#define TRIALS		4
+
+#define DATA0		MODEL_PIN(0, 8)		/* D0..D7 on bits 8..15 */
+#define PCLK_SAME	MODEL_PIN(0, 6)
+#define PCLK_OTHER	MODEL_PIN(1, 6)
+
+/* Cycles of the polling loop on the core */
+struct core {
+	uint32_t poll;		/* the poll without the load and the branch */
+	uint32_t taken;		/* the branch back to the same poll */
+	uint32_t through;	/* the branch not taken */
+	uint32_t store;		/* shift, mask and store of the sample */
+	uint32_t loop;		/* the loop overhead every 4 samples */
+};
+
+/* and, cmp; and, lsr, str; sub, add, cmp, b */
+static const struct core core_m3 = { 2, 3, 1, 3, 6 };
+
+/* mov, ands, cmp, the spilled mask reloaded; ands, lsrs, strb; the loop */
+static const struct core core_m0 = { 5, 3, 1, 4, 7 };
+
+struct family {
+	const char *name;
+	const struct core *core;
+	uint32_t load;		/* cycles of the GPIO load */
+	double sysclk;		/* MHz */
+	double pclk;		/* documented PCLK max, MHz */
+};
+
+static const struct family families[] = {
+	{ "STM32F0", &core_m0, 2, 48, 1 },	/* AHB2 GPIO */
+	{ "STM32F1", &core_m3, 4, 72, 2 },	/* APB2 GPIO, bridge */
+	{ "STM32F3", &core_m3, 2, 72, 2.5 },	/* AHB2 GPIO */
+	{ "STM32F4", &core_m3, 2, 168, 6 },	/* AHB1 GPIO */
+	{ "STM32F7", &core_m3, 4, 216, 6 },	/* AHB1 GPIO, AHBP */
+};
+
+/* Model state, shared with the signal handlers */
+static const struct family *fam;
+static double period;		/* PCLK period in CPU cycles */
+static double phase;		/* time of the first falling edge */
+static double now;		/* CPU cycles */
+static uint32_t pclk_port, data_port, waiting_active, samples;
+static uint32_t pending;	/* cycles from the last read to the next one */
+static uint32_t stored;		/* cycles of the store after the data read */
+static uint16_t data[SAMPLES + 64];
+static uint8_t *protected_page;
+
+/* Value of the port at the time, PCLK low in the first half period */
+static uint32_t model_idr(uint32_t port)
+{
+	double t = now - phase;
+	uint32_t k, v = 0;
+
+	if (t < 0)
+		t = 0;
+	k = (uint32_t)(t / period);
+
+	if (port == data_port)
+		v = (uint32_t)data[k < SAMPLES + 63 ? k : SAMPLES + 63] << 8;
+	if (port == pclk_port && t - k * period >= period / 2)
+		v |= _pin_pin(PCLK_SAME);
+
+	return v;
+}
+
+/*
+ * On the read of PCLK, the cycles since the previous read follow its
+ * outcome: the wait went on, fell through to the wait for the active level,
+ * or saw the edge and stored the sample. The data read of the other port
+ * comes right after the edge, before the store.
+ */
+static void segv_handler(int sig, siginfo_t *si, void *ctx)
+{
+	ucontext_t *uc = ctx;
+	uint8_t *page = (uint8_t *)((uintptr_t)si->si_addr & ~4095UL);
+	const uint32_t port = (uint32_t)(uintptr_t)page;
+	const struct core *c = fam->core;
+	uint32_t v, level, after;
+
+	(void)sig;
+
+	now += pending + fam->load;
+	pending = 0;
+	v = model_idr(port);
+
+	if (port != pclk_port) {
+		pending = stored;
+	} else {
+		level = (v & _pin_pin(PCLK_SAME)) != 0;
+		if (level != waiting_active) {
+			pending = c->poll + c->taken;
+		} else if (!waiting_active) {
+			waiting_active = 1;
+			pending = c->poll + c->through;
+		} else {
+			waiting_active = 0;
+			after = c->store;
+			if (++samples % 4 == 0)
+				after += c->loop;
+
+			pending = c->poll + c->through;
+			if (pclk_port == data_port)
+				pending += after;
+			else
+				stored = after;
+		}
+	}
+
+	mprotect(page, 4096, PROT_READ | PROT_WRITE);
+	*(volatile uint32_t *)(page + 0x10) = v;
+	protected_page = page;
+	uc->uc_mcontext.gregs[REG_EFL] |= 0x100;
+}
+
+static void trap_handler(int sig, siginfo_t *si, void *ctx)
+{
+	ucontext_t *uc = ctx;
+
+	(void)sig;
+	(void)si;
+
+	mprotect(protected_page, 4096, PROT_NONE);
+	uc->uc_mcontext.gregs[REG_EFL] &= ~0x100UL;
+}
+
+static uint32_t seed = 1;
+
+static uint32_t random32(void)
+{
+	seed = seed * 1103515245 + 12345;
+	return seed >> 8;
+}
+
+/* Captures the samples at the rate, returns the count of wrong ones */
+static uint32_t replay(double pclk, uint32_t pclk_pin, bool wide)
+{
+	struct parallel_port p;
+	uint16_t buf16[SAMPLES];
+	uint8_t buf8[SAMPLES];
+	uint32_t i, wrong = 0;
+
+	for (i = 0; i < SAMPLES + 64; i++)
+		data[i] = (uint8_t)random32();
+
+	parallel_init(&p, DATA0, 8, pclk_pin, true);
+
+	period = fam->sysclk / pclk;
+	phase = (random32() % 1000) / 1000.0 * period;
+	now = 0;
+	pclk_port = _pin_port(pclk_pin);
+	data_port = _pin_port(DATA0);
+	waiting_active = 0;
+	samples = 0;
+	pending = 0;
+
+	/*
+	 * The first wait is for the inactive level, the capture starts with
+	 * the PCLK low in the first period, and samples the first rising edge
+	 */
+	if (wide) {
+		parallel_read16(&p, buf16, SAMPLES);
+		for (i = 0; i < SAMPLES; i++)
+			wrong += buf16[i] != data[i];
+	} else {
+		parallel_read8(&p, buf8, SAMPLES);
+		for (i = 0; i < SAMPLES; i++)
+			wrong += buf8[i] != data[i];
+	}
+
+	return wrong;
+}
+
+/* All trials of all paths, returns the count of wrong samples */
+static uint32_t replay_all(double pclk)
+{
+	uint32_t i, wrong = 0;
+
+	for (i = 0; i < TRIALS; i++) {
+		wrong += replay(pclk, PCLK_SAME, false);
+		wrong += replay(pclk, PCLK_OTHER, false);
+		wrong += replay(pclk, PCLK_SAME, true);
+		wrong += replay(pclk, PCLK_OTHER, true);
+	}
+
+	return wrong;
+}
+
+int main(void)
+{
+	struct sigaction sa;
+	uint32_t i, wrong;
+	double pclk, max;
+	bool ok = true;
+
+	for (i = 0; i < MODEL_PORTS; i++) {
+		model_page[i] = mmap(NULL, 4096, PROT_NONE,
+				     MAP_PRIVATE | MAP_ANONYMOUS | MAP_32BIT,
+				     -1, 0);
+		if (model_page[i] == MAP_FAILED) {
+			printf("no memory in the low 2GB\n");
+			return EXIT_FAILURE;
+		}
+	}
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_flags = SA_SIGINFO;
+	sa.sa_sigaction = segv_handler;
+	sigaction(SIGSEGV, &sa, NULL);
+	sa.sa_sigaction = trap_handler;
+	sigaction(SIGTRAP, &sa, NULL);
+
+	printf("%-8s %8s %14s %14s\n", "family", "SYSCLK", "PCLK max doc",
+	       "PCLK max model");
+
+	for (i = 0; i < sizeof(families) / sizeof(families[0]); i++) {
+		fam = &families[i];
+
+		wrong = replay_all(fam->pclk);
+		if (wrong != 0)
+			ok = false;
+
+		max = 0;
+		for (pclk = 0.5; pclk <= fam->sysclk / 4; pclk += 0.25) {
+			if (replay_all(pclk) != 0)
+				break;
+			max = pclk;
+		}
+
+		printf("%-8s %5.0fMHz %11.2fMHz %11.2fMHz%s\n", fam->name,
+		       fam->sysclk, fam->pclk, max,
+		       wrong ? "  samples lost at the documented rate" : "");
+	}
+
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,12 @@
+/* Host stand-in of libopencm3/cm3/common.h for the host tests */
+#ifndef LIBOPENCM3_CM3_COMMON_H
+#define LIBOPENCM3_CM3_COMMON_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define BEGIN_DECLS
+#define END_DECLS
+
+#endif
@@ -0,0 +1,24 @@
+/* Host model of PRIMASK for the host tests: the test interrupt is held
+ * pending while masked, and taken when unmasked.
+ */
+#ifndef LIBOPENCM3_CM3_CORTEX_H
+#define LIBOPENCM3_CM3_CORTEX_H
+
+#include <libopencm3/cm3/common.h>
+
+extern volatile uint32_t host_primask;
+void host_irq_unmasked(void);
+
+static inline uint32_t cm_mask_interrupts(uint32_t mask)
+{
+	const uint32_t old = host_primask;
+
+	__asm__ __volatile__ ("" : : : "memory");
+	host_primask = mask;
+	__asm__ __volatile__ ("" : : : "memory");
+	if (!mask)
+		host_irq_unmasked();
+	return old;
+}
+
+#endif
@@ -0,0 +1,23 @@
+/* Host stand-in of libopencm3/stm32/exti.h for the host tests, declarations
+ * only: the tests feed the decoders directly, not through the EXTI.
+ */
+#ifndef LIBOPENCM3_EXTI_H
+#define LIBOPENCM3_EXTI_H
+
+#include <libopencm3/cm3/common.h>
+
+enum exti_trigger_type {
+	EXTI_TRIGGER_RISING,
+	EXTI_TRIGGER_FALLING,
+	EXTI_TRIGGER_BOTH,
+};
+
+extern volatile uint32_t host_exti_pr;
+#define EXTI_PR		host_exti_pr
+
+void exti_set_trigger(uint32_t extis, enum exti_trigger_type trig);
+void exti_enable_request(uint32_t extis);
+void exti_reset_request(uint32_t extis);
+void exti_select_source(uint32_t exti, uint32_t gpioport);
+
+#endif
@@ -0,0 +1,231 @@
+/*
+ * This file is part of the HAL project, inline library above libopencm3.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/*
+ * Host benchmark of hal/swtimer.h from 10 to 10,000 timers
+ *
+ * N periodic timers run with the periods random from 8N to 16N ticks, so
+ * the expected expirations and cascade moves per tick do not depend on N.
+ * The cost per tick of the wheel stays flat, while the scan of the array of
+ * countdowns, run for comparison, grows with N.
+ *
+ * Every expiration is checked against its due tick, and the deferred
+ * callbacks are checked to run in the order of expiration. The deferred list
+ * keeps 32-bit pointers as on the target, so the timers are mapped to the
+ * low 2GB of the address space.
+ *
+ * Build and run from the repository root on the x86-64 Linux host:
+ *
+ *	gcc -O2 -Wall -Iinclude -Itests/stub tests/swtimer_host.c \
+ *		-o swtimer_host && ./swtimer_host
+ *
+ * Exits with nonzero status on a wrong expiration or order, the timings are
+ * informative only.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <sys/mman.h>
+
+#if !defined(__x86_64__) || !defined(__linux__)
+# error "tests/swtimer_host.c: x86-64 Linux host needed for MAP_32BIT"
+#endif
+
+#include <libopencm3/cm3/cortex.h>
+
+volatile uint32_t host_primask;
+
+void host_irq_unmasked(void)
+{
+}
+
+#include <hal/swtimer.h>
+
+#define MAX_TIMERS	10000
+#define PERIODS		4	/* longest periods run through */
+#define SCAN_STEPS	100000000	/* countdowns scanned in total */
+
+struct bench_timer {
+	struct swtimer timer;	/* must be first */
+	uint32_t due;		/* tick of the next expiration */
+};
+
+static struct swtimer_wheel wheel;
+static struct bench_timer *timers;
+static uint32_t countdown[MAX_TIMERS];
+static uint32_t reload[MAX_TIMERS];
+static uint32_t fired, wrong;
+static uint32_t seed = 1;
+
+static uint32_t random_range(uint32_t min, uint32_t max)
+{
+	seed = seed * 1103515245 + 12345;
+	return min + (seed >> 8) % (max - min);
+}
+
+static double now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* The tick being processed, wheel.now is already advanced */
+static void bench_callback(struct swtimer *timer)
+{
+	struct bench_timer *t = (struct bench_timer *)timer;
+
+	if (wheel.now - 1 != t->due)
+		wrong++;
+
+	t->due += timer->period;
+	fired++;
+}
+
+/* Wheel ticks, returns ns per tick */
+static double run_wheel(uint32_t n, uint32_t ticks)
+{
+	uint32_t i, period;
+	double start;
+
+	swtimer_wheel_init(&wheel);
+
+	for (i = 0; i < n; i++) {
+		period = random_range(8 * n, 16 * n);
+		swtimer_init(&timers[i].timer, bench_callback, 0);
+		swtimer_start(&wheel, &timers[i].timer,
+			      random_range(1, period + 1), period);
+		timers[i].due = timers[i].timer.expires;
+	}
+
+	start = now_ns();
+	for (i = 0; i < ticks; i++)
+		swtimer_tick(&wheel);
+
+	return (now_ns() - start) / ticks;
+}
+
+/* Scan of the countdowns, returns ns per tick */
+static double run_scan(uint32_t n, uint32_t ticks)
+{
+	uint32_t i, j;
+	double start;
+
+	for (i = 0; i < n; i++) {
+		reload[i] = random_range(8 * n, 16 * n);
+		countdown[i] = random_range(1, reload[i] + 1);
+	}
+
+	start = now_ns();
+	for (i = 0; i < ticks; i++) {
+		for (j = 0; j < n; j++) {
+			if (--countdown[j] == 0) {
+				countdown[j] = reload[j];
+				fired++;
+			}
+		}
+	}
+
+	return (now_ns() - start) / ticks;
+}
+
+static uint32_t order[4], order_count;
+
+static void order_callback(struct swtimer *timer)
+{
+	order[order_count++] = (uint32_t)((struct bench_timer *)timer - timers);
+}
+
+/* Deferred timers expiring on the ticks 3, 5, 5 and 7 */
+static bool check_deferred_order(void)
+{
+	static const uint32_t ticks[4] = { 7, 3, 5, 5 };
+	static const uint32_t expected[4] = { 1, 2, 3, 0 };
+	uint32_t i;
+
+	swtimer_wheel_init(&wheel);
+	order_count = 0;
+
+	for (i = 0; i < 4; i++) {
+		swtimer_init(&timers[i].timer, order_callback,
+			     SWTIMER_DEFERRED);
+		swtimer_start(&wheel, &timers[i].timer, ticks[i], 0);
+	}
+
+	for (i = 0; i < 8; i++)
+		swtimer_tick(&wheel);
+
+	if (swtimer_run_deferred(&wheel) != 4)
+		return false;
+
+	for (i = 0; i < 4; i++) {
+		if (order[i] != expected[i])
+			return false;
+	}
+
+	return true;
+}
+
+int main(void)
+{
+	static const uint32_t counts[] = { 10, 100, 1000, 10000 };
+	uint32_t i, n, ticks;
+	double wheel_ns, scan_ns;
+	bool ok = true;
+
+	timers = mmap(NULL, MAX_TIMERS * sizeof(*timers),
+		      PROT_READ | PROT_WRITE,
+		      MAP_PRIVATE | MAP_ANONYMOUS | MAP_32BIT, -1, 0);
+	if (timers == MAP_FAILED) {
+		printf("no memory in the low 2GB\n");
+		return EXIT_FAILURE;
+	}
+
+	printf("%6s %10s %12s %12s %12s\n", "timers", "ticks", "expired/tick",
+	       "wheel ns", "scan ns");
+
+	for (i = 0; i < sizeof(counts) / sizeof(counts[0]); i++) {
+		n = counts[i];
+		ticks = PERIODS * 16 * n;
+		if (ticks < 1000000)
+			ticks = 1000000;
+
+		fired = 0;
+		wrong = 0;
+		wheel_ns = run_wheel(n, ticks);
+		if (wrong != 0 || fired == 0) {
+			printf("%6u: %u of %u expirations off the due tick\n",
+			       n, wrong, fired);
+			ok = false;
+		}
+
+		printf("%6u %10u %12.3f %12.1f", n, ticks,
+		       (double)fired / ticks, wheel_ns);
+
+		fired = 0;
+		scan_ns = run_scan(n, SCAN_STEPS / n);
+		printf(" %12.1f\n", scan_ns);
+	}
+
+	if (!check_deferred_order()) {
+		printf("deferred callbacks out of the order of expiration\n");
+		ok = false;
+	}
+
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}